@@ -23,9 +23,39 @@
 #include <Cutelyst/Plugins/Authentication/authentication.h>
 #include <Cutelyst/Plugins/StatusMessage>
 
+#include <QNetworkCookie>
+#include <QDateTime>
+#include <QCryptographicHash>
+
 #include <QStringBuilder>
 #include <QDebug>
 
+#include "passwordverifier.h"
+#include "verifiedcredential.h"
+#include "servertiming.h"
+
+#include "libCMS/metrics.h"
+#include "libCMS/sqltrace.h"
+
+namespace {
+
+/**
+ * Compares the digests so the time taken doesn't
+ * tell how much of \p token was right
+ */
+bool tokenMatches(const QString &token, const QString &expected)
+{
+    const QByteArray a = QCryptographicHash::hash(token.toUtf8(), QCryptographicHash::Sha256);
+    const QByteArray b = QCryptographicHash::hash(expected.toUtf8(), QCryptographicHash::Sha256);
+    char diff = 0;
+    for (int i = 0; i < a.size(); ++i) {
+        diff |= a.at(i) ^ b.at(i);
+    }
+    return diff == 0;
+}
+
+}
+
 Admin::Admin(QObject *app) : Controller(app)
 {
 }
@@ -41,6 +71,13 @@ bool Admin::Auto(Context *c)
         return true;
     }
 
+    if (c->action() == CActionFor(QStringLiteral("metrics"))) {
+        const QString token = c->config(QStringLiteral("MetricsToken")).toString();
+        if (!token.isEmpty() && tokenMatches(c->req()->headers().authorizationBearer(), token)) {
+            return true;
+        }
+    }
+
     if (!Authentication::userExists(c)) {
         qDebug() << "*** Admin::Auto() User not found forwarding to /.admin/login";
         c->res()->redirect(c->uriFor(CActionFor(QStringLiteral("login"))));
@@ -78,19 +115,46 @@ void Admin::login(Context *c)
     Request *req = c->request();
     const ParamsMultiMap params = req->bodyParams();
     const QString username = params.value(QStringLiteral("email"));
+
+    c->setStash(QStringLiteral("username"), username);
+    c->setStash(QStringLiteral("no_wrapper"), true);
+    c->setStash(QStringLiteral("template"), QStringLiteral("login.html"));
+
     if (req->isPost()) {
         const QString password = params.value(QStringLiteral("password"));
         if (!username.isEmpty() && !password.isEmpty()) {
-
-            // Authenticate
-            if (Authentication::authenticate(c, params)) {
-                qDebug() << Q_FUNC_INFO << username << "is now Logged in";
-                c->res()->redirect(c->uriFor(QStringLiteral("/.admin/posts")));
+            const QString hash = engine->credentials(username).value(QStringLiteral("password"));
+            if (!hash.isEmpty()) {
+
+                // Hashing is slow on purpose, do it away from
+                // the event loop so other requests keep flowing
+                const bool queued = PasswordVerifier::verify(c, password.toUtf8(), hash.toLatin1(),
+                                                             [this, c, params, username, hash] (bool ok) {
+                    if (ok) {
+                        VerifiedCredential::setVerifiedHash(c, hash);
+                    }
+
+                    // Authenticate
+                    if (ok && Authentication::authenticate(c, params)) {
+                        qDebug() << Q_FUNC_INFO << username << "is now Logged in";
+                        c->res()->redirect(c->uriFor(QStringLiteral("/.admin/posts")));
+                    } else {
+                        loginFailed(c, username);
+                        c->res()->setStatus(Response::Forbidden);
+                    }
+                    c->attachAsync();
+                });
+
+                if (queued) {
+                    c->detachAsync();
+                } else {
+                    c->setStash(QStringLiteral("error_msg"), tr("Too many login attempts, please try again"));
+                    c->res()->setHeader(QStringLiteral("Retry-After"), QStringLiteral("5"));
+                    c->res()->setStatus(Response::ServiceUnavailable);
+                }
                 return;
-            } else {
-                c->setStash(QStringLiteral("error_msg"), tr("Wrong password or username"));
-                qDebug() << Q_FUNC_INFO << username << "user or password invalid";
             }
+            loginFailed(c, username);
         } else {
             qWarning() << "Empty username and password";
         }
@@ -98,8 +162,50 @@ void Admin::login(Context *c)
     } else {
         qWarning() << "Non POST method";
     }
+}
 
-    c->setStash(QStringLiteral("username"), username);
-    c->setStash(QStringLiteral("no_wrapper"), true);
-    c->setStash(QStringLiteral("template"), QStringLiteral("login.html"));
+void Admin::metrics(Context *c)
+{
+    Response *res = c->res();
+    if (!CMS::Metrics::isEnabled()) {
+        res->setStatus(Response::NotFound);
+        res->setBody(QByteArrayLiteral("Metrics are disabled\n"));
+        return;
+    }
+
+    res->setContentType(QStringLiteral("text/plain; version=0.0.4; charset=utf-8"));
+    res->headers().setHeader(QStringLiteral("Cache-Control"), QStringLiteral("no-store"));
+    // An empty body would make RenderView look for a template
+    const QByteArray body = CMS::Metrics::exposition();
+    res->setBody(body.isEmpty() ? QByteArrayLiteral("# No metrics recorded yet\n") : body);
+}
+
+void Admin::queries(Context *c)
+{
+    Response *res = c->res();
+    res->setContentType(QStringLiteral("text/plain; charset=utf-8"));
+    res->headers().setHeader(QStringLiteral("Cache-Control"), QStringLiteral("no-store"));
+    res->setBody(CMS::SqlTrace::report());
+}
+
+void Admin::timing(Context *c)
+{
+    const bool enabled = c->req()->cookie(ServerTiming::cookieName()) == QLatin1String("1");
+
+    QNetworkCookie cookie(ServerTiming::cookieName().toLatin1(), QByteArrayLiteral("1"));
+    cookie.setPath(QStringLiteral("/"));
+    cookie.setHttpOnly(true);
+    if (enabled) {
+        // Expires it
+        cookie.setExpirationDate(QDateTime::fromMSecsSinceEpoch(0));
+    }
+    c->res()->setCookie(cookie);
+
+    c->res()->redirect(c->uriFor(QStringLiteral("/")));
+}
+
+void Admin::loginFailed(Context *c, const QString &username)
+{
+    c->setStash(QStringLiteral("error_msg"), tr("Wrong password or username"));
+    qDebug() << Q_FUNC_INFO << username << "user or password invalid";
 }
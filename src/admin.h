@@ -42,12 +42,33 @@ public:
     C_ATTR(login, :Local :AutoArgs)
     void login(Context *c);
 
+    /**
+     * Prometheus metrics of all workers, besides logged
+     * users it accepts the MetricsToken as a bearer token
+     */
+    C_ATTR(metrics, :Local :AutoArgs)
+    void metrics(Context *c);
+
+    /**
+     * SQL statement totals of the worker that answers
+     */
+    C_ATTR(queries, :Local :AutoArgs)
+    void queries(Context *c);
+
+    /**
+     * Toggles the Server-Timing header for this browser
+     */
+    C_ATTR(timing, :Local :AutoArgs)
+    void timing(Context *c);
+
 private Q_SLOTS:
     bool Auto(Context *c);
 
 private:
     C_ATTR(End, :ActionClass(RenderView) :View(admin))
     bool End(Context *c);
+
+    void loginFailed(Context *c, const QString &username);
 };
 
 #endif // ADMIN_H
@@ -20,9 +20,15 @@
 #include "adminmedia.h"
 
 #include <Cutelyst/Upload>
+#include <Cutelyst/Plugins/Utils/Pagination>
+#include <Cutelyst/Plugins/StatusMessage>
+
+#include "libCMS/media.h"
 
 #include <QDir>
 #include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QStringBuilder>
 #include <QDebug>
 
@@ -38,67 +44,37 @@ AdminMedia::~AdminMedia()
 
 void AdminMedia::index(Context *c)
 {
-    const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
-
-    QStringList files;
-    QDirIterator it(mediaDir.absolutePath(),
-                    QDir::Files | QDir::NoDotAndDotDot,
-                    QDirIterator::Subdirectories);
-    while (it.hasNext()) {
-        files.append(it.next());
-    }
-    files.sort(Qt::CaseInsensitive);
-
-    int removeSize = mediaDir.absolutePath().size();
-    QVariantList filesHash;
-    for (const QString &file : files) {
-        QFileInfo fileInfo(file);
-
-        QString id = file.mid(removeSize);
+    static const int itemsPerPage = 30;
 
-        QString urlPath = QLatin1String("/.media") + id;
+    Pagination pagination(engine->countMedia(),
+                          itemsPerPage,
+                          c->request()->queryParam(QStringLiteral("page"), QStringLiteral("1")).toInt());
 
-        QVariantHash hash;
-        hash.insert(QStringLiteral("id"), id);
-        hash.insert(QStringLiteral("name"), fileInfo.fileName());
-        hash.insert(QStringLiteral("modified"), fileInfo.lastModified());
-        hash.insert(QStringLiteral("url"), c->uriFor(urlPath).toString());
-        filesHash.push_back(hash);
+    QVariantList files = engine->listMedia(pagination.offset(), pagination.limit());
+    for (QVariant &file : files) {
+        QVariantHash hash = file.toHash();
+        hash.insert(QStringLiteral("url"),
+                    c->uriFor(QLatin1String("/.media/") + hash.value(QStringLiteral("path")).toString()).toString());
+        file = hash;
     }
 
     c->stash({
                    {QStringLiteral("template"), QStringLiteral("media/index.html")},
-                   {QStringLiteral("files"), filesHash}
+                   {QStringLiteral("files"), files},
+                   {QStringLiteral("pagination"), pagination}
                });
 }
 
 void AdminMedia::upload(Context *c)
 {
-    const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
-
-    if (!mediaDir.exists() && !mediaDir.mkpath(mediaDir.absolutePath())) {
-        qWarning() << "Could not create media directory" << mediaDir.absolutePath();
-        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
-                                              ParamsMultiMap({
-                                                                 {QStringLiteral("error_msg"), QStringLiteral("Failed to save file")}
-                                                             })));
+    if (refuseShared(c)) {
         return;
     }
 
-    // TODO this is NOT working...
-    QFile link(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/.media"));
-    if (!link.exists() && !QFile::link(QStringLiteral("media"), link.fileName())) {
-        qWarning() << "Could not create link media directory" << mediaDir.absolutePath() << link.fileName();
-        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
-                                              ParamsMultiMap({
-                                                                 {QStringLiteral("error_msg"), QStringLiteral("Failed to save file")}
-                                                             })));
-        return;
-    }
+    const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
 
-    QDir fileDir(mediaDir.absolutePath() + QDateTime::currentDateTimeUtc().toString(QStringLiteral("/yyyy/MM")));
-    if (!fileDir.exists() && !fileDir.mkpath(fileDir.absolutePath())) {
-        qWarning() << "Could not create media directory" << fileDir.absolutePath();
+    if (!mediaDir.exists() && !mediaDir.mkpath(mediaDir.absolutePath())) {
+        qWarning() << "Could not create media directory" << mediaDir.absolutePath();
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
                                               ParamsMultiMap({
                                                                  {QStringLiteral("error_msg"), QStringLiteral("Failed to save file")}
@@ -117,9 +93,11 @@ void AdminMedia::upload(Context *c)
         return;
     }
 
-    QString filepath = fileDir.absoluteFilePath(upload->filename());
-    if (!upload->save(filepath)) {
-        qWarning() << "Could not save upload" << filepath;
+    // The content is stored once by its hash, the
+    // catalog maps the friendly name to it
+    const QString hash = CMS::Media::store(upload, mediaDir.absolutePath());
+    if (hash.isEmpty()) {
+        qWarning() << "Could not save upload" << upload->filename();
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
                                               ParamsMultiMap({
                                                                  {QStringLiteral("error_msg"), QStringLiteral("Failed to save file")}
@@ -127,11 +105,68 @@ void AdminMedia::upload(Context *c)
         return;
     }
 
+    const QString dir = QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyy/MM/"));
+    const QFileInfo uploadInfo(QFileInfo(upload->filename()).fileName());
+    QString path = dir + uploadInfo.fileName();
+    for (int i = 1; ; ++i) {
+        const QVariantHash existing = engine->media(path);
+        if (existing.isEmpty()) {
+            break;
+        }
+
+        if (existing.value(QStringLiteral("hash")).toString() == hash) {
+            // Same name and content, nothing to do
+            c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index"))));
+            return;
+        }
+
+        // Don't overwrite a different file with the same name
+        path = dir + uploadInfo.completeBaseName() + QLatin1Char('-') + QString::number(i);
+        if (!uploadInfo.suffix().isEmpty()) {
+            path.append(QLatin1Char('.') + uploadInfo.suffix());
+        }
+    }
+
+    QVariantHash media;
+    const QVariantHash duplicate = engine->mediaByHash(hash);
+    if (duplicate.isEmpty()) {
+        media = CMS::Media::inspect(mediaDir.absoluteFilePath(CMS::Media::objectPath(hash)), path, hash);
+    } else {
+        // Reuse what was found on the first upload, including variants
+        media = duplicate;
+        media.remove(QStringLiteral("id"));
+    }
+    media.insert(QStringLiteral("path"), path);
+    media.insert(QStringLiteral("name"), QFileInfo(path).fileName());
+    media.insert(QStringLiteral("uploaded_at"), QDateTime::currentDateTimeUtc());
+
+    if (engine->addMedia(media) && duplicate.isEmpty()) {
+        const static QVector<int> widths = [c] {
+            QVector<int> ret;
+            const QStringList sizes = c->config(QStringLiteral("MediaSizes"), QStringLiteral("480,1024,1920")).toString()
+                    .split(QLatin1Char(','), QString::SkipEmptyParts);
+            for (const QString &size : sizes) {
+                const int width = size.trimmed().toInt();
+                if (width > 0) {
+                    ret.push_back(width);
+                }
+            }
+            return ret;
+        }();
+        const static int thumbnailSize = c->config(QStringLiteral("MediaThumbnailSize"), 150).toInt();
+
+        CMS::Media::generateVariants(engine, mediaDir.absolutePath(), media, widths, thumbnailSize);
+    }
+
     c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index"))));
 }
 
 void AdminMedia::remove(Context *c, const QStringList &path)
 {
+    if (refuseShared(c)) {
+        return;
+    }
+
     const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
 
     QString file;
@@ -148,11 +183,103 @@ void AdminMedia::remove(Context *c, const QStringList &path)
         }
     }
 
-    QFile removeFile(mediaDir.absoluteFilePath(file));
-    if (!removeFile.remove()) {
-        qDebug() << "Failed to remove media file" << removeFile.fileName() << removeFile.errorString();
+    const QVariantHash media = engine->media(file);
+    if (!media.isEmpty() && engine->removeMedia(file)) {
+        // Only drop the content once no other name points to it
+        const QString hash = media.value(QStringLiteral("hash")).toString();
+        if (!hash.isEmpty() && engine->mediaByHash(hash).isEmpty()) {
+            const QVariantList variants = media.value(QStringLiteral("variants")).toList();
+            for (const QVariant &variant : variants) {
+                QFile::remove(mediaDir.absoluteFilePath(variant.toHash().value(QStringLiteral("path")).toString()));
+            }
+
+            QFile removeFile(mediaDir.absoluteFilePath(CMS::Media::objectPath(hash)));
+            if (!removeFile.remove()) {
+                qDebug() << "Failed to remove media file" << removeFile.fileName() << removeFile.errorString();
+            }
+        }
     }
 
     c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index"))));
 }
 
+void AdminMedia::reconcile(Context *c)
+{
+    if (!c->request()->isPost()) {
+        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index"))));
+        return;
+    }
+
+    if (refuseShared(c)) {
+        return;
+    }
+
+    const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
+    const QString objectsDir = mediaDir.absoluteFilePath(QStringLiteral("objects")) + QLatin1Char('/');
+
+    // Move files that were stored by name, before the catalog
+    // existed or by hand, into the content addressed store,
+    // MediaServer serves them from where they are until then
+    int added = 0;
+    QDirIterator it(mediaDir.absolutePath(),
+                    QDir::Files | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString filepath = it.next();
+        if (filepath.startsWith(objectsDir)) {
+            continue;
+        }
+
+        const QString path = mediaDir.relativeFilePath(filepath);
+        const QDateTime modified = it.fileInfo().lastModified().toUTC();
+        const QString hash = CMS::Media::storeFile(filepath, mediaDir.absolutePath());
+        if (hash.isEmpty()) {
+            continue;
+        }
+
+        QVariantHash media = engine->media(path);
+        if (media.isEmpty() || media.value(QStringLiteral("hash")).toString() != hash) {
+            media = CMS::Media::inspect(mediaDir.absoluteFilePath(CMS::Media::objectPath(hash)), path, hash);
+            media.insert(QStringLiteral("name"), QFileInfo(path).fileName());
+            media.insert(QStringLiteral("uploaded_at"), modified);
+            if (engine->addMedia(media)) {
+                ++added;
+            }
+        }
+    }
+
+    // Drop catalog entries whose content is gone
+    int removed = 0;
+    static const int batchSize = 500;
+    int offset = 0;
+    QVariantList files = engine->listMedia(offset, batchSize);
+    while (!files.isEmpty()) {
+        int missing = 0;
+        for (const QVariant &file : files) {
+            const QVariantHash media = file.toHash();
+            const QString objectFile = mediaDir.absoluteFilePath(CMS::Media::objectPath(media.value(QStringLiteral("hash")).toString()));
+            if (!QFile::exists(objectFile) && engine->removeMedia(media.value(QStringLiteral("path")).toString())) {
+                ++missing;
+            }
+        }
+        removed += missing;
+        offset += files.size() - missing;
+        files = engine->listMedia(offset, batchSize);
+    }
+
+    c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
+                                      StatusMessage::statusQuery(c, QStringLiteral("Media catalog reconciled, %1 added, %2 removed.")
+                                                                .arg(added).arg(removed))));
+}
+
+bool AdminMedia::refuseShared(Context *c)
+{
+    if (!engine->isShared()) {
+        return false;
+    }
+
+    c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("index")),
+                                      StatusMessage::errorQuery(c, QStringLiteral("Media files are kept on each node, "
+                                                                                  "they can't be changed while the content is in PostgreSQL."))));
+    return true;
+}
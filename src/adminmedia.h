@@ -23,9 +23,11 @@
 #include <QObject>
 #include <Cutelyst/Controller>
 
+#include "cmengine.h"
+
 using namespace Cutelyst;
 
-class AdminMedia : public Controller
+class AdminMedia : public Controller, public CMEngine
 {
     Q_OBJECT
     C_NAMESPACE(".admin/media")
@@ -41,6 +43,16 @@ public:
 
     C_ATTR(remove, :Local :AutoArgs)
     void remove(Context *c, const QStringList &path);
+
+    C_ATTR(reconcile, :Local :AutoArgs)
+    void reconcile(Context *c);
+
+private:
+    /**
+     * Media files live in each node's DataLocation, so they
+     * can't be changed when the nodes share the content
+     */
+    bool refuseShared(Context *c);
 };
 
 #endif // ADMINMEDIA_H
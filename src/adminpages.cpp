@@ -20,6 +20,7 @@
 #include "adminpages.h"
 
 #include <Cutelyst/Plugins/Authentication/authentication.h>
+#include <Cutelyst/Plugins/Utils/Pagination>
 #include <Cutelyst/Application>
 
 #include <QDebug>
@@ -64,17 +65,58 @@ void AdminPages::remove(Context *c, const QString &id)
 
 void AdminPages::index(Context *c, const QString &postType, CMS::Engine::Filter filters)
 {
+    static const int itemsPerPage = 25;
+
     c->setStash(QStringLiteral("post_type"), postType);
 
-    QList<CMS::Page *> pages;
-    if (filters == CMS::Engine::Pages) {
-        pages = engine->listPages(c, -1, -1);
-    } else {
-        pages = engine->listPosts(c, -1, -1);
+    const ParamsMultiMap params = c->request()->queryParams();
+
+    CMS::Engine::Filters listFilters = filters;
+    const QString status = params.value(QStringLiteral("status"));
+    if (status == QLatin1String("published")) {
+        listFilters |= CMS::Engine::OnlyPublished;
+    } else if (status == QLatin1String("draft")) {
+        listFilters |= CMS::Engine::OnlyDrafts;
+    }
+
+    const int authorId = params.value(QStringLiteral("author")).toInt();
+
+    const QString sort = params.value(QStringLiteral("sort"), QStringLiteral("created"));
+    CMS::Engine::SortField sortField = CMS::Engine::SortCreated;
+    if (sort == QLatin1String("updated")) {
+        sortField = CMS::Engine::SortUpdated;
+    } else if (sort == QLatin1String("published")) {
+        sortField = CMS::Engine::SortPublished;
+    } else if (sort == QLatin1String("title")) {
+        sortField = CMS::Engine::SortTitle;
     }
-    c->setStash(QStringLiteral("posts"), QVariant::fromValue(pages));
 
-    c->setStash(QStringLiteral("template"), QStringLiteral("posts/index.html"));
+    const QString order = params.value(QStringLiteral("order"), QStringLiteral("desc"));
+    const Qt::SortOrder sortOrder = order == QLatin1String("asc") ? Qt::AscendingOrder : Qt::DescendingOrder;
+
+    const int rows = engine->countPages(listFilters, authorId);
+    Pagination pagination(rows,
+                          itemsPerPage,
+                          params.value(QStringLiteral("page"), QStringLiteral("1")).toInt());
+
+    const QList<CMS::Page *> pages = engine->listPagesSummary(c,
+                                                              listFilters,
+                                                              authorId,
+                                                              sortField,
+                                                              sortOrder,
+                                                              pagination.offset(),
+                                                              pagination.limit());
+
+    c->stash({
+                 {QStringLiteral("posts"), QVariant::fromValue(pages)},
+                 {QStringLiteral("pagination"), pagination},
+                 {QStringLiteral("authors"), engine->users()},
+                 {QStringLiteral("status"), status},
+                 {QStringLiteral("author"), params.value(QStringLiteral("author"))},
+                 {QStringLiteral("sort"), sort},
+                 {QStringLiteral("order"), sortOrder == Qt::AscendingOrder ? QStringLiteral("asc") : QStringLiteral("desc")},
+                 {QStringLiteral("template"), QStringLiteral("posts/index.html")},
+             });
 }
 
 void AdminPages::create(Context *c, const QString &postType, bool isPage)
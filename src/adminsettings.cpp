@@ -20,6 +20,9 @@
 #include "adminsettings.h"
 
 #include "libCMS/page.h"
+#include "libCMS/menu.h"
+#include "libCMS/sqltrace.h"
+#include "libCMS/sqlwriter.h"
 
 #include <Cutelyst/Application>
 #include <Cutelyst/Upload>
@@ -27,7 +30,6 @@
 #include <Cutelyst/Plugins/Authentication/credentialpassword.h>
 #include <Cutelyst/Plugins/StatusMessage>
 
-#include <QRegularExpression>
 #include <QTimeZone>
 
 #include <QJsonDocument>
@@ -55,14 +57,16 @@ void AdminSettings::general(Context *c)
 
     if (c->req()->isPost()) {
         ParamsMultiMap params = c->request()->bodyParams();
-        engine->setSettingsValue(c, QStringLiteral("title"), params.value(QStringLiteral("title")));
-        engine->setSettingsValue(c, QStringLiteral("tagline"), params.value(QStringLiteral("tagline")));
-        engine->setSettingsValue(c, QStringLiteral("theme"), params.value(QStringLiteral("theme")));
-        engine->setSettingsValue(c, QStringLiteral("show_on_front"), params.value(QStringLiteral("show_on_front")));
-        engine->setSettingsValue(c, QStringLiteral("page_on_front"), params.value(QStringLiteral("page_on_front")));
-        engine->setSettingsValue(c, QStringLiteral("page_for_posts"), params.value(QStringLiteral("page_for_posts")));
-        engine->setSettingsValue(c, QStringLiteral("timezone"), params.value(QStringLiteral("timezone")));
-        engine->setSettingsValue(c, QStringLiteral("posts_per_page"), params.value(QStringLiteral("posts_per_page")));
+        engine->setSettingsValues(c, {
+                                      {QStringLiteral("title"), params.value(QStringLiteral("title"))},
+                                      {QStringLiteral("tagline"), params.value(QStringLiteral("tagline"))},
+                                      {QStringLiteral("theme"), params.value(QStringLiteral("theme"))},
+                                      {QStringLiteral("show_on_front"), params.value(QStringLiteral("show_on_front"))},
+                                      {QStringLiteral("page_on_front"), params.value(QStringLiteral("page_on_front"))},
+                                      {QStringLiteral("page_for_posts"), params.value(QStringLiteral("page_for_posts"))},
+                                      {QStringLiteral("timezone"), params.value(QStringLiteral("timezone"))},
+                                      {QStringLiteral("posts_per_page"), params.value(QStringLiteral("posts_per_page"))},
+                                  });
     }
 
     QStringList timezones;
@@ -98,8 +102,10 @@ void AdminSettings::code_injection(Context *c)
 {
     if (c->req()->isPost()) {
         ParamsMultiMap params = c->request()->bodyParams();
-        engine->setSettingsValue(c, QStringLiteral("cms_head"), params.value(QStringLiteral("cms_head")));
-        engine->setSettingsValue(c, QStringLiteral("cms_foot"), params.value(QStringLiteral("cms_foot")));
+        engine->setSettingsValues(c, {
+                                      {QStringLiteral("cms_head"), params.value(QStringLiteral("cms_head"))},
+                                      {QStringLiteral("cms_foot"), params.value(QStringLiteral("cms_foot"))},
+                                  });
     }
 
     auto settings = engine->settings();
@@ -137,39 +143,8 @@ void AdminSettings::user(Context *c, const QString &id)
 
 void AdminSettings::updateUserData(Context *c, const QString &id, const ParamsMultiMap params)
 {
-    QJsonObject obj;
-    obj.insert(QStringLiteral("location"),
-               params.value(QStringLiteral("location")).left(100).toHtmlEscaped());
-    obj.insert(QStringLiteral("facebook"),
-               params.value(QStringLiteral("facebook")).left(100).toHtmlEscaped());
-    obj.insert(QStringLiteral("twitter"),
-               params.value(QStringLiteral("twitter")).left(100).toHtmlEscaped());
-    obj.insert(QStringLiteral("website"),
-               params.value(QStringLiteral("website")).left(100).toHtmlEscaped());
-    QString name = params.value(QStringLiteral("name"));
-    obj.insert(QStringLiteral("name"),
-               name.left(150).toHtmlEscaped());
-    obj.insert(QStringLiteral("bio"),
-               params.value(QStringLiteral("bio")).left(200).toHtmlEscaped());
-
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE users SET "
-                                                                  "slug = :slug, "
-                                                                  "email = :email, "
-                                                                  "json = :json "
-                                                                  "WHERE slug = :slug_id "),
-                                                   QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":slug_id"), id);
-    QString slug = params.value(QStringLiteral("slug"));
-    if (slug.isEmpty()) {
-        slug  = name.section(QLatin1Char(' '), 0, 0);
-    }
-    slug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
-    slug = slug.left(50).toLower().toHtmlEscaped();
-    query.bindValue(QStringLiteral(":slug"), slug);
-    query.bindValue(QStringLiteral(":email"), params.value(QStringLiteral("email")).left(200).toHtmlEscaped());
-    query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
-    if (query.exec()) {
-        engine->setSettingsValue(c, QStringLiteral("modified"), QString());
+    const QString slug = engine->updateUser(c, id, params);
+    if (!slug.isEmpty()) {
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("user")), { slug }));
     } else {
         c->setStash(QStringLiteral("user"), params);
@@ -187,7 +162,14 @@ void AdminSettings::changePassword(Context *c, const QString &id, const ParamsMu
         } else {
             const AuthenticationUser user = Authentication::user(c);
 
-            const QString oldHash = user.value(QStringLiteral("password")).toString();
+            // The hash is not kept in the session
+            const QHash<QString, QString> credentials = engine->credentials(user.value(QStringLiteral("email")).toString());
+            if (credentials.value(QStringLiteral("id")) != user.id().toString()) {
+                c->setStash(QStringLiteral("error_msg"), QStringLiteral("Failed to find your user"));
+                return;
+            }
+
+            const QString oldHash = credentials.value(QStringLiteral("password"));
             if (!CredentialPassword::validatePassword(oldPass.toUtf8(), oldHash.toLatin1())) {
                 c->setStash(QStringLiteral("error_msg"), QStringLiteral("Old password does not match"));
                 return;
@@ -198,20 +180,12 @@ void AdminSettings::changePassword(Context *c, const QString &id, const ParamsMu
                                                                    QCryptographicHash::Sha256,
                                                                    100, 24, 24));
 
-            QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                        QStringLiteral("UPDATE users SET password = :password "
-                                       "WHERE id = :id AND password = :oldpw "),
-                        QStringLiteral("cmlyst"));
-            query.bindValue(QStringLiteral(":id"), user.id());
-            query.bindValue(QStringLiteral(":password"), hashedPassword);
-            query.bindValue(QStringLiteral(":oldpw"), oldHash);
-
-            if (query.exec() && query.numRowsAffected() == 1) {
+            if (engine->setPassword(c, user.id().toInt(), oldHash, hashedPassword)) {
                 Authentication::logout(c);
                 c->response()->redirect(c->uriFor(QStringLiteral("/.admin/login"),
                                                   StatusMessage::statusQuery(c, QStringLiteral("Password updated"))));
             } else {
-                c->setStash(QStringLiteral("error_msg"), query.lastError().text());
+                c->setStash(QStringLiteral("error_msg"), QStringLiteral("Failed to update the password"));
             }
         }
     } else {
@@ -277,6 +251,13 @@ void AdminSettings::database(Context *c)
 
 void AdminSettings::json_data(Context *c)
 {
+    // Both read and write the local SQLite file directly
+    if (engine->isShared()) {
+        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("database")),
+                                          StatusMessage::errorQuery(c, QStringLiteral("Import and export only work with the SQLite database."))));
+        return;
+    }
+
     if (c->request()->isPost()) {
         json_import(c);
     } else {
@@ -321,37 +302,42 @@ void AdminSettings::json_import(Context *c)
 
     auto settingsIt = data.constFind(QStringLiteral("settings"));
     if (settingsIt != data.constEnd()) {
+        QHash<QString, QString> values;
         for (const QJsonValue &jsonValue : settingsIt.value().toArray()) {
             QJsonObject settings = jsonValue.toObject();
             const QString key = settings.value(QStringLiteral("key")).toString();
             if (!key.isEmpty()) {
-                const QString value = settings.value(QStringLiteral("value")).toString();
-                engine->setSettingsValue(c, key, value);
+                values.insert(key, settings.value(QStringLiteral("value")).toString());
             }
         }
+        engine->setSettingsValues(c, values);
     }
 
     auto usersIt = data.constFind(QLatin1String("users"));
     if (usersIt != data.constEnd()) {
-        for (const QJsonValue &jsonValue : usersIt.value().toArray()) {
-            QJsonObject user = jsonValue.toObject();
+        const QJsonArray users = usersIt.value().toArray();
+        CMS::SqlWriter::exec([&] {
             QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO users "
                                                                           "(slug, email, password, json) "
                                                                           "VALUES "
                                                                           "(:slug, :email, :password, :json)"),
                                                            QStringLiteral("cmlyst"));
-            query.bindValue(QStringLiteral(":slug"), user.value(QStringLiteral("slug")).toString());
-            user.remove(QStringLiteral("slug"));
-            query.bindValue(QStringLiteral(":email"), user.value(QStringLiteral("email")).toString());
-            user.remove(QStringLiteral("email"));
-            query.bindValue(QStringLiteral(":password"), user.value(QStringLiteral("password")).toString());
-            user.remove(QStringLiteral("password"));
-            query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(user).toJson(QJsonDocument::Compact)));
-
-            if (!query.exec()) {
-                qWarning() << "Failed to import user" << query.lastError().databaseText();
+            for (const QJsonValue &jsonValue : users) {
+                QJsonObject user = jsonValue.toObject();
+                query.bindValue(QStringLiteral(":slug"), user.value(QStringLiteral("slug")).toString());
+                user.remove(QStringLiteral("slug"));
+                query.bindValue(QStringLiteral(":email"), user.value(QStringLiteral("email")).toString());
+                user.remove(QStringLiteral("email"));
+                query.bindValue(QStringLiteral(":password"), user.value(QStringLiteral("password")).toString());
+                user.remove(QStringLiteral("password"));
+                query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(user).toJson(QJsonDocument::Compact)));
+
+                if (!CMS::SqlTrace::exec(query)) {
+                    qWarning() << "Failed to import user" << query.lastError().databaseText();
+                }
             }
-        }
+        });
+        engine->invalidateUser(c, 0);
     }
 
     auto postsIt = data.constFind(QLatin1String("posts"));
@@ -411,7 +397,7 @@ void AdminSettings::json_export(Context *c)
                                    "FROM pages "
                                    ),
                     QStringLiteral("cmlyst"));
-        if (query.exec()) {
+        if (CMS::SqlTrace::exec(query)) {
             QJsonArray posts;
             while (query.next()) {
                 QJsonObject post;
@@ -446,7 +432,7 @@ void AdminSettings::json_export(Context *c)
                                    "FROM users "
                                    ),
                     QStringLiteral("cmlyst"));
-        if (query.exec()) {
+        if (CMS::SqlTrace::exec(query)) {
             QJsonArray users;
             while (query.next()) {
                 QJsonDocument doc = QJsonDocument::fromJson(query.value(QStringLiteral("json")).toString().toUtf8());
@@ -474,6 +460,31 @@ void AdminSettings::json_export(Context *c)
 
             ++settingsIt;
         }
+
+        // Menus have their own tables but are exported the way
+        // they used to be stored in settings, so old exports keep working
+        QJsonObject menusObj;
+        const QList<CMS::Menu *> menus = engine->menus();
+        for (CMS::Menu *menu : menus) {
+            QJsonObject objMenu;
+            objMenu.insert(QStringLiteral("name"), menu->name());
+            objMenu.insert(QStringLiteral("autoAddPages"), menu->autoAddPages());
+            objMenu.insert(QStringLiteral("locations"), QJsonArray::fromStringList(menu->locations()));
+
+            QJsonArray entriesJson;
+            const QList<QVariantHash> entries = menu->entries();
+            for (const QVariantHash &entry : entries) {
+                entriesJson.append(QJsonObject::fromVariantHash(entry));
+            }
+            objMenu.insert(QStringLiteral("entries"), entriesJson);
+
+            menusObj.insert(menu->id(), objMenu);
+        }
+        QJsonObject pair;
+        pair.insert(QStringLiteral("key"), QStringLiteral("menus"));
+        pair.insert(QStringLiteral("value"), QString::fromUtf8(QJsonDocument(menusObj).toJson(QJsonDocument::Compact)));
+        settingsArray.append(pair);
+
         data.insert(QStringLiteral("settings"), settingsArray);
     }
 
@@ -497,15 +508,23 @@ void AdminSettings::db_clean(Context *c)
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("database"))));
     }
 
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("DELETE FROM posts"),
-                QStringLiteral("cmlyst"));
-    if (query.exec()) {
+    QString error;
+    const bool ok = CMS::SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("DELETE FROM posts"),
+                    QStringLiteral("cmlyst"));
+        if (!CMS::SqlTrace::exec(query)) {
+            error = query.lastError().databaseText();
+            return false;
+        }
+        return true;
+    });
+    if (ok) {
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("database")),
                                           StatusMessage::statusQuery(c, QStringLiteral("Database wiped."))));
     } else {
         c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("database")),
                                           StatusMessage::errorQuery(c, QStringLiteral("Failed to wipe database '%1'.")
-                                                                    .arg(query.lastError().databaseText()))));
+                                                                    .arg(error))));
     }
 }
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "benchengine.h"
+
+#include <QHostAddress>
+#include <QEventLoop>
+
+BenchEngine::BenchEngine(Application *app, const QVariantMap &opts) : Engine(app, 0, opts)
+{
+}
+
+int BenchEngine::workerId() const
+{
+    return 0;
+}
+
+bool BenchEngine::init()
+{
+    return initApplication() && postForkApplication();
+}
+
+quint16 BenchEngine::get(const QString &path, const QByteArray &query, int *bodySize)
+{
+    BenchRequest req;
+    req.method = QStringLiteral("GET");
+    req.setPath(path);
+    req.query = query;
+    req.protocol = QStringLiteral("HTTP/1.1");
+    req.isSecure = false;
+    req.serverAddress = QStringLiteral("127.0.0.1");
+    req.remoteAddress = QHostAddress(QHostAddress::LocalHost);
+    req.remotePort = 3000;
+    req.elapsed.start();
+
+    processRequest(&req);
+
+    // Async engines finish it from the event loop
+    if (!req.finished) {
+        QEventLoop loop;
+        req.loop = &loop;
+        loop.exec();
+    }
+
+    if (bodySize) {
+        *bodySize = req.bodySize;
+    }
+    return req.statusCode;
+}
+
+qint64 BenchRequest::doWrite(const char *data, qint64 len)
+{
+    Q_UNUSED(data)
+    // Only the size matters, copying would be measured too
+    bodySize += int(len);
+    return len;
+}
+
+bool BenchRequest::writeHeaders(quint16 status, const Headers &headers)
+{
+    Q_UNUSED(headers)
+    statusCode = status;
+    return true;
+}
+
+void BenchRequest::processingFinished()
+{
+    finished = true;
+    if (loop) {
+        loop->quit();
+    }
+}
@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef BENCHENGINE_H
+#define BENCHENGINE_H
+
+#include <Cutelyst/Engine>
+#include <Cutelyst/EngineRequest>
+#include <Cutelyst/Headers>
+
+class QEventLoop;
+
+using namespace Cutelyst;
+
+/**
+ * Runs requests through the application without any
+ * socket, so only dispatching and rendering are measured
+ */
+class BenchEngine : public Engine
+{
+    Q_OBJECT
+public:
+    explicit BenchEngine(Application *app, const QVariantMap &opts = QVariantMap());
+
+    virtual int workerId() const override;
+
+    virtual bool init() override;
+
+    /**
+     * Processes a GET for \p path and returns the status code
+     */
+    quint16 get(const QString &path, const QByteArray &query = QByteArray(), int *bodySize = nullptr);
+};
+
+class BenchRequest : public EngineRequest
+{
+public:
+    virtual qint64 doWrite(const char *data, qint64 len) override;
+    virtual bool writeHeaders(quint16 status, const Headers &headers) override;
+    virtual void processingFinished() override;
+
+    quint16 statusCode = 0;
+    int bodySize = 0;
+    bool finished = false;
+    QEventLoop *loop = nullptr;
+};
+
+#endif // BENCHENGINE_H
@@ -0,0 +1,380 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "fixturegenerator.h"
+
+#include <Cutelyst/Plugins/Authentication/credentialpassword.h>
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUuid>
+#include <QDebug>
+
+#include <cmath>
+
+using namespace Cutelyst;
+
+// SQLITE_MAX_VARIABLE_NUMBER on older SQLite builds
+static const int MaxVariables = 999;
+
+// Rows buffered before they are written in a transaction
+static const int ChunkSize = 5000;
+
+static const char *Words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+    "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore",
+    "magna", "aliqua", "enim", "ad", "minim", "veniam", "quis", "nostrud",
+    "exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex", "ea", "commodo",
+    "consequat", "duis", "aute", "irure", "in", "reprehenderit", "voluptate",
+    "velit", "esse", "cillum", "fugiat", "nulla", "pariatur", "excepteur", "sint",
+    "occaecat", "cupidatat", "non", "proident", "sunt", "culpa", "qui", "officia",
+    "deserunt", "mollit", "anim", "id", "est", "laborum"
+};
+static const int WordsCount = sizeof(Words) / sizeof(Words[0]);
+
+FixtureGenerator::FixtureGenerator(const Options &options)
+    : m_options(options)
+    , m_random(options.seed)
+{
+}
+
+bool FixtureGenerator::generate(QSqlDatabase &db)
+{
+    // Losing the fixture on a crash is fine, it can be generated again
+    QSqlQuery query(db);
+    if (!query.exec(QStringLiteral("PRAGMA synchronous = OFF"))) {
+        qWarning() << "Failed to disable synchronous writes" << query.lastError().databaseText();
+    }
+
+    bool ret = insertUsers(db) && insertPosts(db) && insertMenus(db);
+    if (ret) {
+        // Other processes drop their cached users and reload settings and menus
+        ret = query.exec(QStringLiteral("INSERT INTO users_log (user_id) VALUES (0)")) &&
+                query.exec(QStringLiteral("INSERT OR REPLACE INTO settings (key, value) VALUES ('modified', ") +
+                           QString::number(QDateTime::currentSecsSinceEpoch()) + QLatin1Char(')'));
+        if (!ret) {
+            qWarning() << "Failed to update the fixture settings" << query.lastError().databaseText();
+        }
+    }
+
+    if (!query.exec(QStringLiteral("PRAGMA synchronous = FULL"))) {
+        qWarning() << "Failed to restore synchronous writes" << query.lastError().databaseText();
+    }
+
+    return ret;
+}
+
+QString FixtureGenerator::password()
+{
+    return QStringLiteral("fixture-password");
+}
+
+bool FixtureGenerator::insertUsers(QSqlDatabase &db)
+{
+    // Hashing is slow, so every author shares the same hash
+    const QString hash = QString::fromLatin1(CredentialPassword::createPassword(password().toUtf8(),
+                                                                                QCryptographicHash::Sha256,
+                                                                                1000, 24, 24));
+
+    QVector<QVariantList> rows;
+    for (int i = 0; i < m_options.users; ++i) {
+        QString name = words(1, 2);
+        name[0] = name.at(0).toUpper();
+
+        // The numeric suffix keeps slugs unique
+        QString slug = name + QString::number(i + 1);
+        slug.remove(QLatin1Char(' '));
+        slug = slug.toLower();
+        m_authorSlugs.append(slug);
+
+        QJsonObject obj;
+        obj.insert(QStringLiteral("name"), name);
+
+        rows.append({
+                        slug,
+                        QString(slug + QLatin1String("@example.com")),
+                        hash,
+                        QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)),
+                    });
+        if (rows.size() == ChunkSize || i == m_options.users - 1) {
+            if (!insertRows(db, QStringLiteral("users"), {
+                                QStringLiteral("slug"),
+                                QStringLiteral("email"),
+                                QStringLiteral("password"),
+                                QStringLiteral("json"),
+                            }, rows)) {
+                return false;
+            }
+            rows.clear();
+        }
+    }
+
+    // Ids are sequential and posts reference them, users
+    // that already existed are left untouched
+    QSqlQuery query(db);
+    if (!query.exec(QStringLiteral("SELECT COALESCE(MAX(id), 0) FROM users")) || !query.next()) {
+        qWarning() << "Failed to get the last user id" << query.lastError().databaseText();
+        return false;
+    }
+    m_firstUserId = query.value(0).toInt() - m_options.users + 1;
+
+    return true;
+}
+
+bool FixtureGenerator::insertPosts(QSqlDatabase &db)
+{
+    const QStringList columns = {
+        QStringLiteral("uuid"),
+        QStringLiteral("path"),
+        QStringLiteral("title"),
+        QStringLiteral("content"),
+        QStringLiteral("html"),
+        QStringLiteral("page"),
+        QStringLiteral("published"),
+        QStringLiteral("allow_comments"),
+        QStringLiteral("author_id"),
+        QStringLiteral("created_at"),
+        QStringLiteral("updated_at"),
+        QStringLiteral("published_at"),
+    };
+
+    // Fixed so the dates do not depend on when it runs
+    QDateTime date(QDate(2010, 1, 1), QTime(0, 0), Qt::UTC);
+
+    const int total = m_options.pages + m_options.posts;
+    QVector<QVariantList> rows;
+    for (int i = 0; i < total; ++i) {
+        const bool page = i < m_options.pages;
+        const QString title = words(2, 8);
+        QString slug = title;
+        slug.replace(QLatin1Char(' '), QLatin1Char('-'));
+
+        QString path;
+        if (page) {
+            // Most pages are children of an earlier one
+            if (!m_pagePaths.isEmpty() && m_random.bounded(5) != 0) {
+                const QString parent = m_pagePaths.at(int(m_random.bounded(m_pagePaths.size())));
+                path = uniquePath(parent + QLatin1Char('/') + slug);
+            } else {
+                path = uniquePath(slug);
+            }
+            m_pagePaths.append(path);
+        } else {
+            path = uniquePath(date.toString(QStringLiteral("yyyy/MM/")) + slug);
+            m_postPaths.append(path);
+        }
+
+        // Roughly one draft in twenty
+        const bool published = m_random.bounded(20) != 0;
+        const QString created = date.toString(QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+        const QString updated = date.addSecs(m_random.bounded(86400 * 30)).toString(QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+        const QString body = content();
+
+        rows.append({
+                        uuid(),
+                        path,
+                        title,
+                        body,
+                        body,
+                        page,
+                        published,
+                        m_random.bounded(2) == 1,
+                        author(),
+                        created,
+                        updated,
+                        published ? QVariant(created) : QVariant(),
+                    });
+
+        // Spreads the site over years instead of a single day
+        date = date.addSecs(3600 + m_random.bounded(86400 * 2));
+
+        if (rows.size() == ChunkSize || i == total - 1) {
+            if (!insertRows(db, QStringLiteral("posts"), columns, rows)) {
+                return false;
+            }
+            rows.clear();
+        }
+    }
+
+    return true;
+}
+
+bool FixtureGenerator::insertMenus(QSqlDatabase &db)
+{
+    QVector<QVariantList> menus;
+    QVector<QVariantList> entries;
+    for (int i = 0; i < m_options.menus; ++i) {
+        const QString id = uuid();
+        menus.append({
+                         id,
+                         words(1, 2),
+                         i == 0 ? QStringLiteral("[\"main\"]") : QStringLiteral("[]"),
+                         0,
+                         1,
+                     });
+
+        const int count = qMin(m_pagePaths.size(), 3 + int(m_random.bounded(8)));
+        for (int position = 0; position < count; ++position) {
+            const QString path = m_pagePaths.at(int(m_random.bounded(m_pagePaths.size())));
+            entries.append({
+                               id,
+                               position,
+                               path.section(QLatin1Char('/'), -1).replace(QLatin1Char('-'), QLatin1Char(' ')),
+                               QString(QLatin1Char('/') + path),
+                               QStringLiteral("{}"),
+                           });
+        }
+    }
+
+    return insertRows(db, QStringLiteral("menus"), {
+                          QStringLiteral("id"),
+                          QStringLiteral("name"),
+                          QStringLiteral("locations"),
+                          QStringLiteral("auto_add_pages"),
+                          QStringLiteral("version"),
+                      }, menus) &&
+            insertRows(db, QStringLiteral("menu_entries"), {
+                           QStringLiteral("menu_id"),
+                           QStringLiteral("position"),
+                           QStringLiteral("text"),
+                           QStringLiteral("url"),
+                           QStringLiteral("attr"),
+                       }, entries);
+}
+
+bool FixtureGenerator::insertRows(QSqlDatabase &db, const QString &table, const QStringList &columns, const QVector<QVariantList> &rows)
+{
+    if (rows.isEmpty()) {
+        return true;
+    }
+
+    const int perStatement = MaxVariables / columns.size();
+    const QString placeholders = QLatin1Char('(') + QStringLiteral("?, ").repeated(columns.size() - 1) + QLatin1String("?)");
+    const QString insert = QLatin1String("INSERT INTO ") + table +
+            QLatin1String(" (") + columns.join(QLatin1String(", ")) + QLatin1String(") VALUES ");
+
+    auto prepare = [&] (QSqlQuery &query, int count) {
+        QStringList values;
+        for (int i = 0; i < count; ++i) {
+            values.append(placeholders);
+        }
+        return query.prepare(insert + values.join(QLatin1String(", ")));
+    };
+
+    if (!db.transaction()) {
+        qWarning() << "Failed to start fixture transaction" << db.lastError().databaseText();
+        return false;
+    }
+
+    QSqlQuery full(db);
+    if (rows.size() >= perStatement && !prepare(full, perStatement)) {
+        qWarning() << "Failed to prepare fixture insert" << table << full.lastError().databaseText();
+        db.rollback();
+        return false;
+    }
+
+    int offset = 0;
+    while (offset < rows.size()) {
+        const int count = qMin(perStatement, rows.size() - offset);
+
+        QSqlQuery partial(db);
+        QSqlQuery &query = count == perStatement ? full : partial;
+        if (count != perStatement && !prepare(partial, count)) {
+            qWarning() << "Failed to prepare fixture insert" << table << partial.lastError().databaseText();
+            db.rollback();
+            return false;
+        }
+
+        for (int i = offset; i < offset + count; ++i) {
+            for (const QVariant &value : rows.at(i)) {
+                query.addBindValue(value);
+            }
+        }
+
+        if (!query.exec()) {
+            qWarning() << "Failed to insert fixture rows" << table << query.lastError().databaseText();
+            db.rollback();
+            return false;
+        }
+        offset += count;
+    }
+
+    return db.commit();
+}
+
+QString FixtureGenerator::words(int min, int max)
+{
+    const int count = min + int(m_random.bounded(max - min + 1));
+    QStringList ret;
+    for (int i = 0; i < count; ++i) {
+        ret.append(QLatin1String(Words[m_random.bounded(WordsCount)]));
+    }
+    return ret.join(QLatin1Char(' '));
+}
+
+QString FixtureGenerator::content()
+{
+    // Most posts are short, a few are very long
+    const double scale = std::exp(m_random.generateDouble() * 3.0);
+    const int paragraphs = qMax(1, int(scale * 2));
+
+    QString ret;
+    for (int i = 0; i < paragraphs; ++i) {
+        if (m_random.bounded(6) == 0) {
+            ret += QLatin1String("<h2>") + words(2, 6) + QLatin1String("</h2>\n");
+        }
+        ret += QLatin1String("<p>") + words(30, 120) + QLatin1String(".</p>\n");
+    }
+    return ret;
+}
+
+QString FixtureGenerator::uniquePath(const QString &path)
+{
+    QString ret = path;
+    int suffix = 1;
+    while (m_paths.contains(ret)) {
+        ret = path + QLatin1Char('-') + QString::number(++suffix);
+    }
+    m_paths.insert(ret);
+    return ret;
+}
+
+QString FixtureGenerator::uuid()
+{
+    // Version 4 layout, but taken from the seeded generator
+    quint32 data[4];
+    m_random.fillRange(data);
+    QUuid ret(data[0], quint16(data[1] >> 16), quint16((data[1] & 0x0fff) | 0x4000),
+            uchar(0x80 | ((data[2] >> 24) & 0x3f)), uchar(data[2] >> 16), uchar(data[2] >> 8), uchar(data[2]),
+            uchar(data[3] >> 24), uchar(data[3] >> 16), uchar(data[3] >> 8), uchar(data[3]));
+    return ret.toString().remove(QLatin1Char('{')).remove(QLatin1Char('}'));
+}
+
+int FixtureGenerator::author()
+{
+    if (m_options.users <= 0) {
+        return 0;
+    }
+
+    // A few prolific authors write most of the posts
+    const double skew = std::pow(m_random.generateDouble(), 3.0);
+    return m_firstUserId + qMin(m_options.users - 1, int(skew * m_options.users));
+}
@@ -0,0 +1,87 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef FIXTUREGENERATOR_H
+#define FIXTUREGENERATOR_H
+
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QDateTime>
+#include <QSet>
+
+/**
+ * Fills a CMlyst database with a synthetic site, the same
+ * seed and counts always produce the same rows
+ */
+class FixtureGenerator
+{
+public:
+    struct Options {
+        quint32 seed = 1;
+        int posts = 1000;
+        int pages = 100;
+        int users = 10;
+        int menus = 3;
+    };
+
+    explicit FixtureGenerator(const Options &options);
+
+    /**
+     * Inserts the rows using \p db, which must point
+     * to a database with the CMlyst schema
+     */
+    bool generate(QSqlDatabase &db);
+
+    QStringList pagePaths() const { return m_pagePaths; }
+    QStringList postPaths() const { return m_postPaths; }
+    QStringList authorSlugs() const { return m_authorSlugs; }
+
+    /**
+     * Password of all generated authors
+     */
+    static QString password();
+
+private:
+    bool insertUsers(QSqlDatabase &db);
+    bool insertPosts(QSqlDatabase &db);
+    bool insertMenus(QSqlDatabase &db);
+
+    /**
+     * Inserts \p rows using multi row INSERTs, each row
+     * must have one value per column
+     */
+    bool insertRows(QSqlDatabase &db, const QString &table, const QStringList &columns, const QVector<QVariantList> &rows);
+
+    QString words(int min, int max);
+    QString content();
+    QString uniquePath(const QString &path);
+    QString uuid();
+    int author();
+
+    Options m_options;
+    QRandomGenerator m_random;
+    QStringList m_pagePaths;
+    QStringList m_postPaths;
+    QStringList m_authorSlugs;
+    QSet<QString> m_paths;
+    int m_firstUserId = 1;
+};
+
+#endif // FIXTUREGENERATOR_H
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QSqlDatabase>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+#include "fixturegenerator.h"
+
+#include "libCMS/sqlengine.h"
+#include "libCMS/sqlwriter.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cmlyst-fixtures"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Creates a CMlyst site with generated content"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("DataLocation"), QStringLiteral("Directory where cmlyst.sqlite is created."));
+    const QCommandLineOption seedOpt(QStringLiteral("seed"), QStringLiteral("Seed of the generated content."), QStringLiteral("number"), QStringLiteral("1"));
+    const QCommandLineOption postsOpt(QStringLiteral("posts"), QStringLiteral("Number of posts to create."), QStringLiteral("count"), QStringLiteral("100000"));
+    const QCommandLineOption pagesOpt(QStringLiteral("pages"), QStringLiteral("Number of pages to create."), QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption usersOpt(QStringLiteral("users"), QStringLiteral("Number of authors to create."), QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption menusOpt(QStringLiteral("menus"), QStringLiteral("Number of menus to create."), QStringLiteral("count"), QStringLiteral("3"));
+    parser.addOptions({ seedOpt, postsOpt, pagesOpt, usersOpt, menusOpt });
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    const QDir dataDir(parser.positionalArguments().first());
+    if (!dataDir.exists() && !dataDir.mkpath(dataDir.absolutePath())) {
+        qCritical() << "Could not create DataLocation" << dataDir.absolutePath();
+        return 1;
+    }
+
+    // Paths would clash with the ones of an existing site
+    if (QFile::exists(dataDir.absoluteFilePath(QStringLiteral("cmlyst.sqlite")))) {
+        qCritical() << "DataLocation already has a database" << dataDir.absolutePath();
+        return 1;
+    }
+
+    FixtureGenerator::Options options;
+    options.seed = parser.value(seedOpt).toUInt();
+    options.posts = qMax(0, parser.value(postsOpt).toInt());
+    options.pages = qMax(0, parser.value(pagesOpt).toInt());
+    options.users = qMax(1, parser.value(usersOpt).toInt());
+    options.menus = qMax(0, parser.value(menusOpt).toInt());
+
+    // Creates the schema exactly like the application does
+    CMS::SqlEngine engine;
+    if (!engine.init({
+                         {QStringLiteral("root"), dataDir.absolutePath()}
+                     })) {
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The engine's own connection is read-only
+    FixtureGenerator generator(options);
+    const bool generated = CMS::SqlWriter::exec<bool>([&generator] () -> bool {
+        QSqlDatabase db = CMS::SqlWriter::database();
+        return generator.generate(db);
+    });
+    if (!generated) {
+        qCritical() << "Failed to generate the site";
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "Created " << options.posts << " posts, " << options.pages << " pages, "
+        << options.users << " authors and " << options.menus << " menus with seed "
+        << options.seed << " in " << timer.elapsed() << " ms\n";
+    out << "Database: " << dataDir.absoluteFilePath(QStringLiteral("cmlyst.sqlite")) << '\n';
+    if (!generator.authorSlugs().isEmpty()) {
+        out << "Login: " << generator.authorSlugs().first() << "@example.com / "
+            << FixtureGenerator::password() << '\n';
+    }
+
+    return 0;
+}
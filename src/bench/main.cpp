@@ -0,0 +1,222 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QDebug>
+
+#include <functional>
+#include <algorithm>
+
+#include "benchengine.h"
+#include "fixturegenerator.h"
+
+#include "cmlyst.h"
+#include "cmengine.h"
+#include "libCMS/engine.h"
+#include "libCMS/page.h"
+
+struct Scenario {
+    QString name;
+    std::function<bool()> run;
+};
+
+/**
+ * Fills the database created by CMlyst::postFork() using
+ * its own connection, so the application sees the
+ * data_version change like it would from another worker
+ */
+static bool seed(const QString &dbPath, FixtureGenerator &generator)
+{
+    bool ret = false;
+    {
+        auto db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("cmlyst-bench"));
+        db.setDatabaseName(dbPath);
+        if (!db.open()) {
+            qCritical() << "Failed to open database" << dbPath << db.lastError().databaseText();
+            return false;
+        }
+        ret = generator.generate(db);
+    }
+    QSqlDatabase::removeDatabase(QStringLiteral("cmlyst-bench"));
+
+    return ret;
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, int p)
+{
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    const int index = qMin(sorted.size() - 1, (sorted.size() * p) / 100);
+    return sorted.at(index);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cmlyst-bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measures CMlyst request handling against a generated site"));
+    parser.addHelpOption();
+    const QCommandLineOption seedOpt(QStringLiteral("seed"), QStringLiteral("Seed of the generated content."), QStringLiteral("number"), QStringLiteral("1"));
+    const QCommandLineOption postsOpt(QStringLiteral("posts"), QStringLiteral("Number of posts to create."), QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption pagesOpt(QStringLiteral("pages"), QStringLiteral("Number of pages to create."), QStringLiteral("count"), QStringLiteral("100"));
+    const QCommandLineOption usersOpt(QStringLiteral("users"), QStringLiteral("Number of authors to create."), QStringLiteral("count"), QStringLiteral("10"));
+    const QCommandLineOption menusOpt(QStringLiteral("menus"), QStringLiteral("Number of menus to create."), QStringLiteral("count"), QStringLiteral("3"));
+    const QCommandLineOption iterationsOpt(QStringLiteral("iterations"), QStringLiteral("Measured runs of each scenario."), QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption warmupOpt(QStringLiteral("warmup"), QStringLiteral("Unmeasured runs of each scenario."), QStringLiteral("count"), QStringLiteral("50"));
+    const QCommandLineOption readersOpt(QStringLiteral("readers"), QStringLiteral("SqlReaderThreads of the application."), QStringLiteral("count"), QStringLiteral("0"));
+    parser.addOptions({ seedOpt, postsOpt, pagesOpt, usersOpt, menusOpt, iterationsOpt, warmupOpt, readersOpt });
+    parser.process(app);
+
+    FixtureGenerator::Options counts;
+    counts.seed = parser.value(seedOpt).toUInt();
+    counts.posts = qMax(1, parser.value(postsOpt).toInt());
+    counts.pages = qMax(1, parser.value(pagesOpt).toInt());
+    counts.users = qMax(1, parser.value(usersOpt).toInt());
+    counts.menus = qMax(0, parser.value(menusOpt).toInt());
+    const int iterations = qMax(1, parser.value(iterationsOpt).toInt());
+    const int warmup = qMax(0, parser.value(warmupOpt).toInt());
+
+    QTemporaryDir dataDir;
+    if (!dataDir.isValid()) {
+        qCritical() << "Failed to create a temporary directory";
+        return 1;
+    }
+
+    auto cmlyst = new CMlyst;
+    BenchEngine engine(cmlyst);
+    engine.setConfig({
+                         {QStringLiteral("Cutelyst"), QVariantMap{
+                              {QStringLiteral("DataLocation"), dataDir.path()},
+                              {QStringLiteral("production"), true},
+                              {QStringLiteral("SqlReaderThreads"), qMax(0, parser.value(readersOpt).toInt())},
+                              {QStringLiteral("home"), QStringLiteral(CMLYST_SOURCE_DIR)},
+                          }},
+                     });
+    if (!engine.init()) {
+        qCritical() << "Failed to initialize the application";
+        return 1;
+    }
+
+    FixtureGenerator generator(counts);
+    if (!seed(dataDir.path() + QLatin1String("/cmlyst.sqlite"), generator)) {
+        return 1;
+    }
+
+    auto cms = dynamic_cast<CMEngine *>(cmlyst->controller(QStringLiteral("Root")));
+    if (!cms || !cms->engine) {
+        qCritical() << "Application has no CMS engine";
+        return 1;
+    }
+    CMS::Engine *cmsEngine = cms->engine;
+
+    auto request = [&engine] (const QString &path, quint16 expected) {
+        return [&engine, path, expected] {
+            return engine.get(path) == expected;
+        };
+    };
+
+    auto list = [] (const std::function<QList<CMS::Page *>(QObject *)> &call) {
+        return [call] {
+            QObject parent;
+            call(&parent);
+            return true;
+        };
+    };
+
+    const QString page = generator.pagePaths().at(counts.pages / 2);
+    const QString post = generator.postPaths().at(counts.posts / 2);
+    const QString author = QLatin1String(".author/") + generator.authorSlugs().first();
+
+    // The first author is the one with most posts
+    const int authorId = cmsEngine->user(generator.authorSlugs().first()).value(QStringLiteral("id")).toInt();
+
+    const QVector<Scenario> scenarios = {
+        { QStringLiteral("GET /"), request(QString(), 200) },
+        { QStringLiteral("GET /") + page, request(page, 200) },
+        { QStringLiteral("GET /") + post, request(post, 200) },
+        { QStringLiteral("GET /.feed"), request(QStringLiteral(".feed"), 200) },
+        { QStringLiteral("GET /") + author, request(author, 200) },
+        { QStringLiteral("GET /missing (404)"), request(QStringLiteral("missing"), 404) },
+        { QStringLiteral("listPostsPublished"), list([cmsEngine] (QObject *parent) {
+              return cmsEngine->listPostsPublished(parent, 0, 10);
+          }) },
+        { QStringLiteral("listAuthorPostsPublished"), list([cmsEngine, authorId] (QObject *parent) {
+              return cmsEngine->listAuthorPostsPublished(parent, authorId, 0, 10);
+          }) },
+        { QStringLiteral("listPagesSummary"), list([cmsEngine] (QObject *parent) {
+              return cmsEngine->listPagesSummary(parent, CMS::Engine::Pages, 0, CMS::Engine::SortTitle, Qt::AscendingOrder, 0, 20);
+          }) },
+        { QStringLiteral("countPages"), [cmsEngine] {
+              return cmsEngine->countPages(CMS::Engine::Posts | CMS::Engine::OnlyPublished, 0) > 0;
+          } },
+    };
+
+    QTextStream out(stdout);
+    out << "seed " << counts.seed << ", posts " << counts.posts << ", pages " << counts.pages
+        << ", users " << counts.users << ", menus " << counts.menus
+        << ", iterations " << iterations << "\n\n";
+    out.setFieldAlignment(QTextStream::AlignLeft);
+    out << qSetFieldWidth(34) << "scenario" << qSetFieldWidth(0);
+    out.setFieldAlignment(QTextStream::AlignRight);
+    out << qSetFieldWidth(12) << "req/s" << "p50 (us)" << "p99 (us)" << qSetFieldWidth(0) << '\n';
+
+    int failed = 0;
+    for (const Scenario &scenario : scenarios) {
+        for (int i = 0; i < warmup; ++i) {
+            scenario.run();
+        }
+
+        QVector<qint64> samples;
+        samples.reserve(iterations);
+        QElapsedTimer total;
+        QElapsedTimer timer;
+        bool ok = true;
+        total.start();
+        for (int i = 0; i < iterations; ++i) {
+            timer.start();
+            ok &= scenario.run();
+            samples.append(timer.nsecsElapsed());
+        }
+        const qint64 elapsed = total.nsecsElapsed();
+        std::sort(samples.begin(), samples.end());
+
+        if (!ok) {
+            ++failed;
+        }
+        out.setFieldAlignment(QTextStream::AlignLeft);
+        out << qSetFieldWidth(34) << (ok ? scenario.name : scenario.name + QLatin1String(" (FAILED)")) << qSetFieldWidth(0);
+        out.setFieldAlignment(QTextStream::AlignRight);
+        out << qSetFieldWidth(12)
+            << QString::number(iterations * 1e9 / qMax<qint64>(1, elapsed), 'f', 0)
+            << QString::number(percentile(samples, 50) / 1000.0, 'f', 1)
+            << QString::number(percentile(samples, 99) / 1000.0, 'f', 1)
+            << qSetFieldWidth(0) << '\n';
+    }
+
+    return failed ? 1 : 0;
+}
@@ -1,5 +1,7 @@
 #include "cmdispatcher.h"
 
+#include "servertiming.h"
+
 #include "libCMS/page.h"
 
 #include <Cutelyst/Action>
@@ -42,6 +44,13 @@ DispatchType::MatchType CMDispatcher::match(Context *c, const QString &path, con
         return NoMatch;
     }
 
+    // Media has its own controller, don't hit the database for it
+    if (path.startsWith(QLatin1String(".media/"))) {
+        return NoMatch;
+    }
+
+    ServerTiming::Scope timing(c, "match");
+
     auto settings = engine->loadSettings(c);
 
     // See if we are on front page path and the settings says
@@ -58,13 +67,23 @@ DispatchType::MatchType CMDispatcher::match(Context *c, const QString &path, con
         return ExactMatch;
     }
 
-    CMS::Page *page;
-    if (path.isEmpty() && !showPostsOnFront) {
-        page = engine->getPage(settings.value(QStringLiteral("page_on_front")), c);
-    } else {
-        page = engine->getPage(path, c);
+    const QString pagePath = path.isEmpty() ? settings.value(QStringLiteral("page_on_front")) : path;
+
+    // Waiting here would block the worker, the page action
+    // looks it up instead and answers 404 if there is none
+    if (engine->isAsync()) {
+        if (path.startsWith(QLatin1Char('.'))) {
+            return NoMatch;
+        }
+        c->setStash(QStringLiteral("page_path"), pagePath);
+        req->setArguments(args);
+        req->setMatch(path);
+        setupMatchedAction(c, m_pageAction);
+        return ExactMatch;
     }
 
+    CMS::Page *page = engine->getPage(pagePath, c);
+
     if (page && page->published()) {
         c->setStash(QStringLiteral("page"), QVariant::fromValue(page));
         req->setArguments(args);
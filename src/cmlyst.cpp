@@ -19,18 +19,29 @@
 #include "cmlyst.h"
 
 #include <Cutelyst/Application>
+#include <Cutelyst/Context>
+#include <Cutelyst/Action>
+#include <Cutelyst/Response>
+#include <Cutelyst/Engine>
+#include <Cutelyst/EngineRequest>
+#include <Cutelyst/Headers>
 #include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
 #include <Cutelyst/Plugins/Session/Session>
 #include <Cutelyst/Plugins/Authentication/authentication.h>
 #include <Cutelyst/Plugins/Authentication/authenticationrealm.h>
-#include <Cutelyst/Plugins/Authentication/credentialpassword.h>
 #include <Cutelyst/Plugins/Authentication/htpasswd.h>
 #include <Cutelyst/Plugins/StatusMessage>
 
 #include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QHostAddress>
+#include <QUrl>
 #include <QDir>
 #include <QDebug>
 
+#include <functional>
+
 #include "root.h"
 #include "admin.h"
 #include "adminappearance.h"
@@ -39,11 +50,24 @@
 #include "adminmedia.h"
 #include "adminsettings.h"
 #include "adminsetup.h"
+#include "mediaserver.h"
 
 #include "cmdispatcher.h"
 #include "sqluserstore.h"
+#include "sqlsessionstore.h"
+#include "passwordverifier.h"
+#include "verifiedcredential.h"
+#include "metricsview.h"
+#include "servertiming.h"
+#include "staticexport.h"
 
 #include "libCMS/sqlengine.h"
+#ifdef CMLYST_WITH_ASQL
+#include "libCMS/pgengine.h"
+#endif
+#include "libCMS/packengine.h"
+#include "libCMS/metrics.h"
+#include "libCMS/sqltrace.h"
 #include "libCMS/page.h"
 #include "libCMS/menu.h"
 
@@ -68,7 +92,7 @@ bool CMlyst::init()
     bool production = config(QStringLiteral("production")).toBool();
     qDebug() << "Production" << production;
 
-    auto view = new CuteleeView(this);
+    auto view = new MetricsView(this);
     view->setTemplateExtension(QStringLiteral(".html"));
     view->setWrapper(QStringLiteral("base.html"));
     view->setCache(production);
@@ -80,9 +104,46 @@ bool CMlyst::init()
     }
     setConfig(QStringLiteral("DataLocation"), dataDir.absolutePath());
 
+    // Only the warmup replays get through until the worker is ready
+    connect(this, &Application::beforePrepareAction, this, [this] (Context *c, bool *skipMethod) {
+        if (!m_ready && !m_replaying) {
+            Response *res = c->res();
+            res->setStatus(Response::ServiceUnavailable);
+            res->setContentType(QStringLiteral("text/plain"));
+            res->headers().setHeader(QStringLiteral("Retry-After"), QStringLiteral("1"));
+            res->setBody(QByteArrayLiteral("warming up\n"));
+            *skipMethod = true;
+        }
+    });
+
+    ServerTiming::setAlwaysOn(config(QStringLiteral("ServerTiming"), false).toBool());
+    connect(this, &Application::beforePrepareAction, this, [] (Context *c, bool *skipMethod) {
+        Q_UNUSED(skipMethod)
+        ServerTiming::begin(c);
+    });
+    connect(this, &Application::afterDispatch, this, &ServerTiming::finish);
+
+    CMS::SqlTrace::setSlowThreshold(config(QStringLiteral("SlowQueryThreshold"), 100).toInt());
+
+    // Set up before forking so every worker writes to the same memory
+    if (config(QStringLiteral("Metrics"), true).toBool() && CMS::Metrics::setup(dataDir.absolutePath())) {
+        static QElapsedTimer clock;
+        clock.start();
+
+        connect(this, &Application::beforeDispatch, this, [] (Context *c) {
+            c->setProperty("_metrics_start", clock.nsecsElapsed());
+        });
+        connect(this, &Application::afterDispatch, this, [] (Context *c) {
+            const qint64 elapsed = clock.nsecsElapsed() - c->property("_metrics_start").toLongLong();
+            const QString action = c->action() ? c->action()->reverse() : QStringLiteral("none");
+            CMS::Metrics::observe("cmlyst_action_duration_seconds{action=\"" + CMS::Metrics::label(action) + "\"}", elapsed);
+            CMS::Metrics::increment("cmlyst_http_responses_total{code=\"" + QByteArray::number(c->res()->status()) + "\"}");
+        });
+    }
+
     view->setIncludePaths({ pathTo(QStringLiteral("root/themes/default")) });
 
-    auto adminView = new CuteleeView(this, QStringLiteral("admin"));
+    auto adminView = new MetricsView(this, QStringLiteral("admin"));
     adminView->setTemplateExtension(QStringLiteral(".html"));
     adminView->setWrapper(QStringLiteral("wrapper.html"));
     adminView->setIncludePaths({ pathTo(QStringLiteral("root/admin")) });
@@ -98,19 +159,25 @@ bool CMlyst::init()
         new AdminPages(this);
         new AdminMedia(this);
         new AdminSettings(this);
+        new MediaServer(this);
     }
 
     new CMDispatcher(this);
 
     auto store = new SqlUserStore;
+    m_userStore = store;
 
-    auto password = new CredentialPassword;
-    password->setPasswordField(QStringLiteral("password"));
-    password->setPasswordType(CredentialPassword::Hashed);
+    // Passwords are checked on the verifier pool before
+    // authenticate() is called, see Admin::login()
+    PasswordVerifier::setLimits(config(QStringLiteral("LoginThreads"), 2).toInt(),
+                                config(QStringLiteral("LoginQueueSize"), 32).toInt());
+    auto password = new VerifiedCredential;
 
     auto realm = new AuthenticationRealm(store, password);
 
-    new Session(this);
+    // Shared by all workers and without a file per session
+    auto session = new Session(this);
+    session->setStorage(std::unique_ptr<SessionStore>(new SqlSessionStore(config(QStringLiteral("SessionSweepInterval"), 300).toInt())));
 
     auto auth = new Authentication(this);
     auth->addRealm(realm);
@@ -128,10 +195,71 @@ bool CMlyst::postFork()
 {
     QDir dataDir = config(QStringLiteral("DataLocation")).toString();
 
-    auto engine = new CMS::SqlEngine(this);
-    engine->init({
-                     {QStringLiteral("root"), dataDir.absolutePath()}
-                 });
+    // Sessions stay in the local SQLite database either way
+    QHash<QString, QString> sqlSettings = {
+        {QStringLiteral("root"), dataDir.absolutePath()},
+        {QStringLiteral("readerThreads"), config(QStringLiteral("SqlReaderThreads"), 0).toString()}
+    };
+    // Unset keys get the engine's defaults
+    const QHash<QString, QString> pragmaKeys = {
+        {QStringLiteral("SqliteMmapSize"), QStringLiteral("mmap_size")},
+        {QStringLiteral("SqliteCacheSize"), QStringLiteral("cache_size")},
+        {QStringLiteral("SqliteSynchronous"), QStringLiteral("synchronous")},
+        {QStringLiteral("SqliteBusyTimeout"), QStringLiteral("busy_timeout")},
+        {QStringLiteral("SqliteTempStore"), QStringLiteral("temp_store")},
+        {QStringLiteral("SqliteWalAutocheckpoint"), QStringLiteral("wal_autocheckpoint")},
+    };
+    auto it = pragmaKeys.constBegin();
+    while (it != pragmaKeys.constEnd()) {
+        sqlSettings.insert(it.value(), config(it.key()).toString());
+        ++it;
+    }
+
+    const QString pgConnection = config(QStringLiteral("PgConnection")).toString();
+    // Read-only replicas serve a pack exported from the main site
+    const QString packFile = config(QStringLiteral("PackFile")).toString();
+    if (!pgConnection.isEmpty() && !packFile.isEmpty()) {
+        qCritical() << "PgConnection and PackFile can't be set together";
+        return false;
+    }
+
+    CMS::SqlEngine *sqlEngine = nullptr;
+    CMS::Engine *engine = nullptr;
+    if (!pgConnection.isEmpty()) {
+#ifdef CMLYST_WITH_ASQL
+        auto pgEngine = new CMS::PgEngine(this);
+        if (!pgEngine->init({
+                                {QStringLiteral("connection"), pgConnection}
+                            })) {
+            return false;
+        }
+        engine = pgEngine;
+#else
+        qCritical() << "PgConnection is set but CMlyst was built without ASql";
+        return false;
+#endif
+    } else if (!packFile.isEmpty()) {
+        auto packEngine = new CMS::PackEngine(this);
+        if (!packEngine->init({
+                                  {QStringLiteral("file"), packFile}
+                              })) {
+            return false;
+        }
+        engine = packEngine;
+    } else {
+        sqlEngine = new CMS::SqlEngine(this);
+        if (!sqlEngine->init(sqlSettings)) {
+            return false;
+        }
+        engine = sqlEngine;
+    }
+
+    if (!sqlEngine && !CMS::SqlEngine::initSessions(sqlSettings)) {
+        return false;
+    }
+
+    m_userStore->engine = engine;
+    m_engine = engine;
 
     Q_FOREACH (Controller *controller, controllers()) {
         auto cmengine = dynamic_cast<CMEngine *>(controller);
@@ -147,5 +275,123 @@ bool CMlyst::postFork()
         }
     }
 
+    // Pay for lazy loading before taking traffic instead
+    // of on the first requests after a deploy
+    m_warmupTimer.start();
+    if (sqlEngine) {
+        Context c(this);
+        sqlEngine->warmup(&c);
+    }
+
+    const QStringList viewNames = { QString(), QStringLiteral("admin") };
+    for (const QString &name : viewNames) {
+        auto view = qobject_cast<CuteleeView *>(this->view(name));
+        if (view && view->isCaching()) {
+            view->preloadTemplates();
+        }
+    }
+
+    // Replays go through the event loop, requests arriving
+    // meanwhile are refused until finishWarmup(), the export
+    // command renders right away so it has nothing to warm
+    if (!qobject_cast<ExportEngine *>(this->engine())) {
+        m_warmupUrls = config(QStringLiteral("WarmupUrls")).toString().split(QLatin1Char(','), QString::SkipEmptyParts);
+    }
+    replayNext();
+
     return true;
 }
+
+void CMlyst::finishWarmup()
+{
+    qDebug() << "Worker warmed up in" << m_warmupTimer.elapsed() << "ms";
+
+    CMS::Engine *engine = m_engine;
+
+    // A single worker keeps the static copy current, saves made
+    // on it are written right away, other ones on the next poll
+    const QString exportDir = config(QStringLiteral("StaticExportDir")).toString();
+    if (!exportDir.isEmpty() && !qobject_cast<ExportEngine *>(this->engine()) &&
+            this->engine()->workerId() == 0 && this->engine()->workerCore() == 0) {
+        const QUrl baseUrl(config(QStringLiteral("StaticExportBaseUrl"), QStringLiteral("http://localhost")).toString());
+        auto staticExport = new StaticExport(this, engine, exportDir, baseUrl, this);
+
+        const int interval = config(QStringLiteral("StaticExportInterval"), 60).toInt();
+        if (interval > 0) {
+            auto poll = new QTimer(staticExport);
+            poll->setInterval(interval * 1000);
+            connect(poll, &QTimer::timeout, staticExport, &StaticExport::update);
+            poll->start();
+        }
+        staticExport->update();
+    }
+
+    m_ready = true;
+}
+
+namespace {
+
+class WarmupRequest : public EngineRequest
+{
+public:
+    qint64 doWrite(const char *data, qint64 len) override
+    {
+        Q_UNUSED(data)
+        return len;
+    }
+
+    bool writeHeaders(quint16 status, const Headers &headers) override
+    {
+        Q_UNUSED(headers)
+        statusCode = status;
+        return true;
+    }
+
+    void processingFinished() override
+    {
+        if (done) {
+            done();
+        }
+    }
+
+    quint16 statusCode = 0;
+    std::function<void()> done;
+};
+
+}
+
+void CMlyst::replayNext()
+{
+    if (m_warmupUrls.isEmpty()) {
+        finishWarmup();
+        return;
+    }
+
+    const QString url = m_warmupUrls.takeFirst().trimmed();
+    const QUrl parsed(url);
+
+    // Async engines finish it later, so it lives until then
+    auto req = new WarmupRequest;
+    req->method = QStringLiteral("GET");
+    req->setPath(parsed.path());
+    req->query = parsed.query(QUrl::FullyEncoded).toLatin1();
+    req->protocol = QStringLiteral("HTTP/1.1");
+    req->serverAddress = QStringLiteral("127.0.0.1");
+    req->remoteAddress = QHostAddress(QHostAddress::LocalHost);
+    req->elapsed.start();
+    req->done = [this, req, url] {
+        if (req->statusCode != Response::OK) {
+            qWarning() << "Warmup request returned" << req->statusCode << url;
+        }
+
+        // The request is still finalizing, delete it from the loop
+        QTimer::singleShot(0, this, [this, req] {
+            delete req;
+            replayNext();
+        });
+    };
+
+    m_replaying = true;
+    engine()->processRequest(req);
+    m_replaying = false;
+}
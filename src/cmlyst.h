@@ -22,6 +22,15 @@
 
 #include <Cutelyst/Application>
 
+#include <QStringList>
+#include <QElapsedTimer>
+
+namespace CMS {
+class Engine;
+}
+
+class SqlUserStore;
+
 class CMlyst : public Cutelyst::Application
 {
     Q_OBJECT
@@ -33,6 +42,22 @@ public:
     bool init() override;
 
     virtual bool postFork() override;
+
+private:
+    /**
+     * Replays the next WarmupUrls entry once the previous
+     * one finished, then marks the worker ready
+     */
+    void replayNext();
+    void finishWarmup();
+
+    SqlUserStore *m_userStore = nullptr;
+    CMS::Engine *m_engine = nullptr;
+    QStringList m_warmupUrls;
+    QElapsedTimer m_warmupTimer;
+    bool m_replaying = false;
+    // Requests other than the replays get 503 until set
+    bool m_ready = false;
 };
 
 #endif // CMLYST_H
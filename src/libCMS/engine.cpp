@@ -20,8 +20,13 @@
 #include "engine.h"
 #include "menu.h"
 #include "page.h"
+#include "media.h"
+#include "metrics.h"
+
+#include <cutelee/safestring.h>
 
 #include <QRegularExpression>
+#include <QThreadPool>
 #include <QStringList>
 #include <QDateTime>
 #include <QDebug>
@@ -35,7 +40,8 @@ Engine::Engine(QObject *parent) : QObject(parent)
 
 Engine::~Engine()
 {
-
+    // Variant jobs post their result to the engine that queued them
+    Media::variantsPool()->waitForDone();
 }
 
 int Engine::savePage(Cutelyst::Context *c, Page *page)
@@ -45,10 +51,10 @@ int Engine::savePage(Cutelyst::Context *c, Page *page)
         QList<Menu *> autoMenus = menus();
         Q_FOREACH (Menu *menu, autoMenus) {
             if (menu->autoAddPages()) {
-                menu->appendEntry(page->title(), page->path());
-                saveMenu(c, menu, true);
+                addMenuEntry(c, menu, page->title(), page->path());
             }
         }
+        Q_EMIT pagesChanged();
     }
     return ret;
 }
@@ -68,6 +74,42 @@ QVariant Engine::menusProperty()
     return QVariant::fromValue(menuLocations());
 }
 
+QVariantHash Engine::menusHtml(const QString &activePath)
+{
+    QVariantHash ret;
+    if (!m_menuTemplates) {
+        return ret;
+    }
+
+    const QHash<QString, Menu *> locations = menuLocations();
+    auto it = locations.constBegin();
+    while (it != locations.constEnd()) {
+        Menu *menu = it.value();
+        auto cached = m_menusHtml.find(it.key());
+        if (cached == m_menusHtml.end() || cached->menuId != menu->id() || cached->version != menu->version()) {
+            Metrics::increment("cmlyst_cache_requests_total{cache=\"menus_html\",result=\"miss\"}");
+            cached = m_menusHtml.insert(it.key(), MenuHtml::render(m_menuTemplates, menu));
+        } else {
+            Metrics::increment("cmlyst_cache_requests_total{cache=\"menus_html\",result=\"hit\"}");
+        }
+        ret.insert(it.key(), QVariant::fromValue(Cutelee::SafeString(cached->html(activePath), true)));
+        ++it;
+    }
+
+    return ret;
+}
+
+void Engine::setMenuTemplates(Cutelee::Engine *templates)
+{
+    m_menuTemplates = templates;
+    m_menusHtml.clear();
+}
+
+void Engine::clearMenusHtml()
+{
+    m_menusHtml.clear();
+}
+
 bool Engine::saveMenu(Cutelyst::Context *c, Menu *menu, bool replace)
 {
     Q_UNUSED(c)
@@ -83,6 +125,12 @@ bool Engine::removeMenu(Cutelyst::Context *c, const QString &name)
     return false;
 }
 
+bool Engine::addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url)
+{
+    menu->appendEntry(text, url);
+    return saveMenu(c, menu, true);
+}
+
 bool Engine::saveMenus(Cutelyst::Context *c, const QList<Menu *> &menus)
 {
     Q_FOREACH (Menu *menu, menus) {
@@ -94,11 +142,69 @@ bool Engine::saveMenus(Cutelyst::Context *c, const QList<Menu *> &menus)
     return true;
 }
 
+bool Engine::isAsync() const
+{
+    return false;
+}
+
+bool Engine::isShared() const
+{
+    return false;
+}
+
+void Engine::getPageAsync(const QString &path, QObject *parent, PageCallback cb)
+{
+    cb(getPage(path, parent));
+}
+
+void Engine::listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb)
+{
+    if (authorId > 0) {
+        cb(listAuthorPostsPublished(parent, authorId, offset, limit));
+    } else {
+        cb(listPostsPublished(parent, offset, limit));
+    }
+}
+
+void Engine::listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb)
+{
+    cb(listPagesSummary(parent, filters, authorId, sort, order, offset, limit));
+}
+
+void Engine::countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb)
+{
+    Q_UNUSED(receiver)
+    cb(countPages(filters, authorId));
+}
+
+void Engine::updateMediaHtml(const QString &hash)
+{
+    Q_UNUSED(hash)
+}
+
 QDateTime Engine::lastModified()
 {
     return QDateTime();
 }
 
+qint64 Engine::contentVersion(Cutelyst::Context *c)
+{
+    Q_UNUSED(c)
+    return -1;
+}
+
+bool Engine::setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values)
+{
+    auto it = values.constBegin();
+    while (it != values.constEnd()) {
+        if (!setSettingsValue(c, it.key(), it.value())) {
+            return false;
+        }
+        ++it;
+    }
+    return true;
+}
+
 QVariant Engine::settingsProperty()
 {
     return QVariant::fromValue(settings());
@@ -26,6 +26,10 @@
 
 #include <Cutelyst/ParamsMultiMap>
 
+#include <functional>
+
+#include "menuhtml.h"
+
 namespace Cutelyst {
 class Context;
 }
@@ -46,11 +50,23 @@ public:
         Pages         = 0x1,
         Posts         = 0x2,
         OnlyPublished = 0x4,
+        OnlyDrafts    = 0x8,
 
         NoFilter      = -1
     };
     Q_DECLARE_FLAGS(Filters, Filter)
 
+    enum SortField {
+        SortCreated,
+        SortUpdated,
+        SortPublished,
+        SortTitle
+    };
+
+    typedef std::function<void(Page *page)> PageCallback;
+    typedef std::function<void(const QList<Page *> &pages)> PagesCallback;
+    typedef std::function<void(int count)> CountCallback;
+
     explicit Engine(QObject *parent = 0);
     virtual ~Engine();
 
@@ -61,6 +77,10 @@ public:
      */
     virtual bool init(const QHash<QString, QString> &settings) = 0;
 
+    /**
+     * Public lookups and listings return the HTML stored on save,
+     * with srcset added, getPageById() the content as written
+     */
     virtual Page *getPage(const QString &path, QObject *parent) = 0;
 
     virtual Page *getPageById(const QString &id, QObject *parent) = 0;
@@ -94,6 +114,64 @@ public:
                                                    int offset,
                                                    int limit) = 0;
 
+    /**
+     * Returns pages or posts (depending on \p filters) without
+     * their content, only what is needed to build listings,
+     * when \p authorId is bigger than zero only the ones from
+     * that author are returned
+     */
+    virtual QList<Page *> listPagesSummary(QObject *parent,
+                                           Filters filters,
+                                           int authorId,
+                                           SortField sort,
+                                           Qt::SortOrder order,
+                                           int offset,
+                                           int limit) = 0;
+
+    /**
+     * Returns how many pages listPagesSummary() would
+     * return for the same \p filters and \p authorId
+     */
+    virtual int countPages(Filters filters, int authorId) = 0;
+
+    /**
+     * True when the *Async() methods return before their callback
+     * is called, callers then detach the Context while waiting.
+     * Engines that are async never call back from within the call
+     */
+    virtual bool isAsync() const;
+
+    /**
+     * True when several nodes share the content, the files
+     * kept in DataLocation are then not seen by the others
+     */
+    virtual bool isShared() const;
+
+    /**
+     * Calls \p cb with what getPage() returns, or nullptr
+     */
+    virtual void getPageAsync(const QString &path, QObject *parent, PageCallback cb);
+
+    /**
+     * Calls \p cb with the published posts, from all authors
+     * when \p authorId is zero, the callback is dropped
+     * if \p parent is destroyed first
+     */
+    virtual void listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb);
+
+    /**
+     * Calls \p cb with what listPagesSummary() returns, the
+     * callback is dropped if \p parent is destroyed first
+     */
+    virtual void listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb);
+
+    /**
+     * Calls \p cb with what countPages() returns, or -1 when the
+     * query failed, the callback is dropped if \p receiver is
+     * destroyed first
+     */
+    virtual void countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb);
+
     virtual QList<Menu *> menus() = 0;
 
     virtual Menu *menu(const QString &id);
@@ -102,18 +180,40 @@ public:
 
     QVariant menusProperty();
 
+    /**
+     * Returns the rendered menu of each location, with the
+     * entries pointing to \p activePath marked active
+     */
+    QVariantHash menusHtml(const QString &activePath);
+
     virtual bool saveMenu(Cutelyst::Context *c, Menu *menu, bool replace);
     virtual bool removeMenu(Cutelyst::Context *c, const QString &name);
+
+    /**
+     * Appends a single entry to \p menu and stores it
+     */
+    virtual bool addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url);
     bool saveMenus(Cutelyst::Context *c, const QList<Menu *> &menus);
 
     virtual QDateTime lastModified();
 
+    /**
+     * Returns a number that changes whenever posts or pages
+     * are committed, or -1 when the engine can't tell
+     */
+    virtual qint64 contentVersion(Cutelyst::Context *c);
+
     virtual bool settingsIsWritable() const = 0;
     virtual QHash<QString, QString> settings() const = 0;
     virtual QVariant settingsProperty();
     virtual QString settingsValue(const QString &key, const QString &defaultValue = QString()) const = 0;
     virtual bool setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value) = 0;
 
+    /**
+     * Stores all \p values at once, settings are reloaded a single time
+     */
+    virtual bool setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values);
+
     static QString normalizePath(const QString &path);
     static QString normalizeTitle(const QString &path);
 
@@ -125,15 +225,94 @@ public:
     virtual QString addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace) = 0;
     virtual bool removeUser(Cutelyst::Context *c, int id) = 0;
 
+    /**
+     * Updates the profile of the user with \p slug, returns the new slug
+     */
+    virtual QString updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user) = 0;
+
+    /**
+     * Drops the cached data of user \p id in every process,
+     * 0 drops all users, for changes made outside of the engine
+     */
+    virtual bool invalidateUser(Cutelyst::Context *c, int id) = 0;
+
 
     virtual QVariantList users() = 0;
     virtual QHash<QString, QString> user(const QString &slug) = 0;
     virtual QHash<QString, QString> user(int id) = 0;
 
+    /**
+     * Returns the id, email, password hash and version of
+     * the user with \p email, these are never cached
+     */
+    virtual QHash<QString, QString> credentials(const QString &email) = 0;
+
+    /**
+     * Replaces the password of user \p id if it still is \p oldHash,
+     * the version is bumped so sessions started before it end
+     */
+    virtual bool setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash) = 0;
+
+    /**
+     * Adds or replaces a media catalog entry, \p media
+     * is keyed by the catalog columns (path, name, size,
+     * mime, width, height, hash and uploaded_at),
+     * uploaded_at is in UTC both ways
+     */
+    virtual bool addMedia(const QVariantHash &media) = 0;
+    virtual bool removeMedia(const QString &path) = 0;
+    virtual QVariantHash media(const QString &path) = 0;
+
+    /**
+     * Returns one of the catalog entries pointing to the
+     * content with \p hash, or an empty hash if none does
+     */
+    virtual QVariantHash mediaByHash(const QString &hash) = 0;
+
+    /**
+     * Records the resized copies generated for the content with \p hash
+     */
+    virtual bool setMediaVariants(const QString &hash, const QVariantList &variants) = 0;
+
+    /**
+     * Stores again the HTML of the pages and posts showing the
+     * content with \p hash, so they get the srcset of variants
+     * that were done after they were saved
+     */
+    virtual void updateMediaHtml(const QString &hash);
+
+    /**
+     * Returns the media catalog entries, newest first
+     */
+    virtual QVariantList listMedia(int offset, int limit) = 0;
+    virtual int countMedia() = 0;
+
+Q_SIGNALS:
+    /**
+     * Emitted after a page or post is saved or removed by this
+     * engine, changes made by other processes are not seen
+     */
+    void pagesChanged();
+
 protected:
     virtual int savePageBackend(Page *page) = 0;
 
+    /**
+     * Sets the engine menu.html is loaded from, engines
+     * call it once they configured the view's theme
+     */
+    void setMenuTemplates(Cutelee::Engine *templates);
+
+    /**
+     * Renders the menus again on their next use
+     */
+    void clearMenusHtml();
+
     EnginePrivate *d_ptr;
+
+private:
+    Cutelee::Engine *m_menuTemplates = nullptr;
+    QHash<QString, MenuHtml> m_menusHtml;
 };
 
 typedef QHash<QString, QString> StringHash;
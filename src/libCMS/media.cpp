@@ -0,0 +1,389 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "media.h"
+#include "engine.h"
+
+#include <QCryptographicHash>
+#include <QImageReader>
+#include <QImage>
+#include <QMimeDatabase>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QThread>
+#include <QRegularExpression>
+#include <QTemporaryFile>
+#include <QDebug>
+
+#include <functional>
+#include <memory>
+
+using namespace CMS;
+
+namespace {
+
+class VariantsJob : public QRunnable
+{
+public:
+    VariantsJob(Engine *engine, const std::function<void ()> &finished, const std::shared_ptr<QVariantList> &result,
+                const QString &mediaRoot, const QString &hash, const QString &mime, const QVector<int> &widths, int thumbnailSize)
+        : m_engine(engine)
+        , m_finished(finished)
+        , m_result(result)
+        , m_mediaRoot(mediaRoot)
+        , m_hash(hash)
+        , m_mime(mime)
+        , m_widths(widths)
+        , m_thumbnailSize(thumbnailSize)
+    {
+    }
+
+    void run() override
+    {
+        const QDir mediaDir(m_mediaRoot);
+        const QString objectPath = Media::objectPath(m_hash);
+        const QString filePath = mediaDir.absoluteFilePath(objectPath);
+
+        QImageReader reader(filePath);
+        reader.setAutoTransform(true);
+        const QImage image = reader.read();
+        if (image.isNull()) {
+            qWarning() << "Failed to read image for variants" << filePath << reader.errorString();
+            return;
+        }
+
+        // Variants are named after the content, so
+        // duplicated uploads share them too
+        const QString suffix = m_mime == QLatin1String("image/png") ? QStringLiteral("png") : QStringLiteral("jpg");
+        const QString base = m_hash;
+        const QString dir = QFileInfo(objectPath).path();
+
+        QVariantList variants;
+        for (int width : m_widths) {
+            if (width >= image.width()) {
+                continue;
+            }
+
+            const QImage scaled = image.scaledToWidth(width, Qt::SmoothTransformation);
+            const QString name = base + QLatin1Char('-') + QString::number(width) + QLatin1String("w.") + suffix;
+            QVariantHash variant = save(scaled, mediaDir, dir, name);
+            if (!variant.isEmpty()) {
+                variants.push_back(variant);
+            }
+        }
+
+        if (m_thumbnailSize > 0) {
+            const QImage scaled = image.scaled(m_thumbnailSize, m_thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            const QString name = base + QLatin1String("-thumb.") + suffix;
+            QVariantHash variant = save(scaled, mediaDir, dir, name);
+            if (!variant.isEmpty()) {
+                variant.insert(QStringLiteral("thumbnail"), true);
+                variants.push_back(variant);
+            }
+        }
+
+        // The engine waits for this pool before going away
+        *m_result = variants;
+        QMetaObject::invokeMethod(m_engine, std::move(m_finished), Qt::QueuedConnection);
+    }
+
+private:
+    QVariantHash save(const QImage &image, const QDir &mediaDir, const QString &dir, const QString &name)
+    {
+        const QString path = dir == QLatin1String(".") ? name : dir + QLatin1Char('/') + name;
+        const QString filePath = mediaDir.absoluteFilePath(path);
+        if (!image.save(filePath, nullptr, 85)) {
+            qWarning() << "Failed to save image variant" << filePath;
+            return QVariantHash();
+        }
+
+        return {
+            {QStringLiteral("path"), path},
+            {QStringLiteral("width"), image.width()},
+            {QStringLiteral("height"), image.height()},
+            {QStringLiteral("size"), QFileInfo(filePath).size()},
+        };
+    }
+
+    Engine *m_engine;
+    std::function<void ()> m_finished;
+    std::shared_ptr<QVariantList> m_result;
+    QString m_mediaRoot;
+    QString m_hash;
+    QString m_mime;
+    QVector<int> m_widths;
+    int m_thumbnailSize;
+};
+
+const QRegularExpression imgRe(QStringLiteral("<img\\s[^>]*>"), QRegularExpression::CaseInsensitiveOption);
+const QRegularExpression srcRe(QStringLiteral("\\ssrc=\"([^\"]+)\""), QRegularExpression::CaseInsensitiveOption);
+
+}
+
+QVariantHash Media::inspect(const QString &filePath, const QString &path, const QString &hash)
+{
+    static QMimeDatabase mimeDb;
+
+    QVariantHash ret;
+    const QFileInfo fileInfo(filePath);
+    if (!fileInfo.exists()) {
+        return ret;
+    }
+
+    const QMimeType mime = mimeDb.mimeTypeForFile(fileInfo);
+    ret.insert(QStringLiteral("path"), path);
+    ret.insert(QStringLiteral("name"), fileInfo.fileName());
+    ret.insert(QStringLiteral("size"), fileInfo.size());
+    ret.insert(QStringLiteral("mime"), mime.name());
+    ret.insert(QStringLiteral("hash"), hash.isEmpty() ? fileHash(filePath) : hash);
+
+    if (mime.name().startsWith(QLatin1String("image/"))) {
+        // Only reads the image header
+        QImageReader reader(filePath);
+        const QSize size = reader.size();
+        if (size.isValid()) {
+            ret.insert(QStringLiteral("width"), size.width());
+            ret.insert(QStringLiteral("height"), size.height());
+        }
+    }
+
+    return ret;
+}
+
+QString Media::store(QIODevice *device, const QString &mediaRoot)
+{
+    const QDir mediaDir(mediaRoot);
+    if (!mediaDir.mkpath(QStringLiteral("objects"))) {
+        qWarning() << "Could not create media objects directory" << mediaDir.absoluteFilePath(QStringLiteral("objects"));
+        return QString();
+    }
+
+    QTemporaryFile tmp(mediaDir.absoluteFilePath(QStringLiteral("objects/upload-XXXXXX")));
+    if (!tmp.open()) {
+        qWarning() << "Could not create temporary media file" << tmp.errorString();
+        return QString();
+    }
+
+    if (!device->isSequential()) {
+        device->seek(0);
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    char buffer[64 * 1024];
+    qint64 len;
+    while ((len = device->read(buffer, sizeof(buffer))) > 0) {
+        hash.addData(buffer, int(len));
+        if (tmp.write(buffer, len) != len) {
+            qWarning() << "Failed to write media file" << tmp.fileName() << tmp.errorString();
+            return QString();
+        }
+    }
+
+    if (len < 0) {
+        qWarning() << "Failed to read media" << device->errorString();
+        return QString();
+    }
+
+    const QString hex = QString::fromLatin1(hash.result().toHex());
+    const QString objectFile = mediaDir.absoluteFilePath(objectPath(hex));
+    if (QFile::exists(objectFile)) {
+        // Same content is already stored, the temporary copy is discarded
+        return hex;
+    }
+
+    if (!mediaDir.mkpath(QFileInfo(objectFile).path())) {
+        qWarning() << "Could not create media objects directory" << QFileInfo(objectFile).path();
+        return QString();
+    }
+
+    if (!tmp.rename(objectFile)) {
+        if (QFile::exists(objectFile)) {
+            // Stored meanwhile by a concurrent upload
+            return hex;
+        }
+        qWarning() << "Failed to store media file" << objectFile << tmp.errorString();
+        return QString();
+    }
+    tmp.setAutoRemove(false);
+
+    return hex;
+}
+
+QString Media::storeFile(const QString &filePath, const QString &mediaRoot)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open media file" << filePath << file.errorString();
+        return QString();
+    }
+
+    const QString hash = store(&file, mediaRoot);
+    if (!hash.isEmpty()) {
+        file.remove();
+    }
+    return hash;
+}
+
+QString Media::objectPath(const QString &hash)
+{
+    return QLatin1String("objects/") + hash.leftRef(2) + QLatin1Char('/') + hash;
+}
+
+QString Media::fileHash(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open media file" << filePath << file.errorString();
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file)) {
+        return QString();
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+void Media::generateVariants(Engine *engine, const QString &mediaRoot, const QVariantHash &media, const QVector<int> &widths, int thumbnailSize)
+{
+    const QString mime = media.value(QStringLiteral("mime")).toString();
+    // Vector and animated images are served as they are
+    if (!mime.startsWith(QLatin1String("image/")) ||
+            mime == QLatin1String("image/svg+xml") ||
+            mime == QLatin1String("image/gif")) {
+        return;
+    }
+
+    // Built on the engine's thread, the job only fills in the result
+    const QString hash = media.value(QStringLiteral("hash")).toString();
+    auto result = std::make_shared<QVariantList>();
+    std::function<void ()> finished = [engine, hash, result] {
+        if (engine->setMediaVariants(hash, *result)) {
+            engine->updateMediaHtml(hash);
+        }
+    };
+
+    variantsPool()->start(new VariantsJob(engine,
+                                          finished,
+                                          result,
+                                          mediaRoot,
+                                          hash,
+                                          mime,
+                                          widths,
+                                          thumbnailSize));
+}
+
+QThreadPool *Media::variantsPool()
+{
+    static QThreadPool *pool = [] {
+        auto pool = new QThreadPool;
+        pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+        return pool;
+    }();
+    return pool;
+}
+
+QString Media::srcset(const QVariantHash &media, const QString &baseUrl)
+{
+    QStringList ret;
+    const QVariantList variants = media.value(QStringLiteral("variants")).toList();
+    for (const QVariant &variant : variants) {
+        const QVariantHash hash = variant.toHash();
+        if (hash.value(QStringLiteral("thumbnail")).toBool()) {
+            continue;
+        }
+        ret.append(baseUrl + hash.value(QStringLiteral("path")).toString() + QLatin1Char(' ')
+                   + QString::number(hash.value(QStringLiteral("width")).toInt()) + QLatin1Char('w'));
+    }
+
+    if (ret.isEmpty()) {
+        return QString();
+    }
+
+    const int width = media.value(QStringLiteral("width")).toInt();
+    if (width > 0) {
+        ret.append(baseUrl + media.value(QStringLiteral("path")).toString() + QLatin1Char(' ')
+                   + QString::number(width) + QLatin1Char('w'));
+    }
+    return ret.join(QLatin1String(", "));
+}
+
+QString Media::addSrcset(Engine *engine, const QString &html, const QString &baseUrl)
+{
+    if (!html.contains(baseUrl)) {
+        return html;
+    }
+
+    QString ret;
+    int last = 0;
+    QRegularExpressionMatchIterator it = imgRe.globalMatch(html);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch imgMatch = it.next();
+        const QString tag = imgMatch.captured(0);
+        if (tag.contains(QLatin1String("srcset="), Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        const QRegularExpressionMatch srcMatch = srcRe.match(tag);
+        const QString src = srcMatch.captured(1);
+        if (!src.startsWith(baseUrl)) {
+            continue;
+        }
+
+        const QString set = srcset(engine->media(src.mid(baseUrl.size())), baseUrl);
+        if (set.isEmpty()) {
+            continue;
+        }
+
+        ret.append(html.midRef(last, imgMatch.capturedStart() - last));
+        ret.append(tag.leftRef(srcMatch.capturedEnd()));
+        ret.append(QLatin1String(" srcset=\"") + set + QLatin1String("\" sizes=\"100vw\""));
+        ret.append(tag.midRef(srcMatch.capturedEnd()));
+        last = imgMatch.capturedEnd();
+    }
+
+    if (last == 0) {
+        return html;
+    }
+    ret.append(html.midRef(last));
+    return ret;
+}
+
+QStringList Media::references(const QString &html, const QString &baseUrl)
+{
+    QStringList ret;
+    if (!html.contains(baseUrl)) {
+        return ret;
+    }
+
+    QRegularExpressionMatchIterator it = imgRe.globalMatch(html);
+    while (it.hasNext()) {
+        const QString src = srcRe.match(it.next().captured(0)).captured(1);
+        if (src.startsWith(baseUrl)) {
+            const QString path = src.mid(baseUrl.size());
+            if (!ret.contains(path)) {
+                ret.append(path);
+            }
+        }
+    }
+    return ret;
+}
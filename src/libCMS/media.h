@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_MEDIA_H
+#define CMS_MEDIA_H
+
+#include <QVariantHash>
+#include <QStringList>
+#include <QVector>
+
+class QThreadPool;
+class QIODevice;
+
+namespace CMS {
+
+class Engine;
+class Media
+{
+public:
+    /**
+     * Inspects the file at \p filePath and returns its
+     * catalog entry, \p path is relative to the media root,
+     * when \p hash is empty the file is hashed
+     */
+    static QVariantHash inspect(const QString &filePath, const QString &path, const QString &hash = QString());
+
+    /**
+     * Copies \p device into the content addressed store under
+     * \p mediaRoot hashing it in the same pass, returns the hash
+     * of the content or an empty string on failure.
+     *
+     * Content that is already stored is not written twice.
+     */
+    static QString store(QIODevice *device, const QString &mediaRoot);
+
+    /**
+     * Moves the file at \p filePath into the store
+     */
+    static QString storeFile(const QString &filePath, const QString &mediaRoot);
+
+    /**
+     * Returns the path relative to the media root
+     * where the content with \p hash is stored
+     */
+    static QString objectPath(const QString &hash);
+
+    /**
+     * Returns the hex encoded SHA-256 of the file
+     * or an empty string if it can't be read
+     */
+    static QString fileHash(const QString &filePath);
+
+    /**
+     * Queues the generation of resized copies of the stored \p media
+     * image, one for each of \p widths smaller than the original
+     * plus a \p thumbnailSize square bound thumbnail.
+     *
+     * The work runs on variantsPool(), once done the variants
+     * are saved with Engine::setMediaVariants() on the thread
+     * \p engine lives in. Engines wait for the pool when they
+     * are destroyed, so the result always has one to go to.
+     */
+    static void generateVariants(Engine *engine,
+                                 const QString &mediaRoot,
+                                 const QVariantHash &media,
+                                 const QVector<int> &widths,
+                                 int thumbnailSize);
+
+    static QThreadPool *variantsPool();
+
+    /**
+     * Returns the srcset attribute value for the
+     * catalog entry \p media, with URLs under \p baseUrl
+     */
+    static QString srcset(const QVariantHash &media, const QString &baseUrl);
+
+    /**
+     * Adds srcset attributes to img tags in \p html that
+     * point to \p baseUrl and have generated variants,
+     * engines do it once when a page is saved
+     */
+    static QString addSrcset(Engine *engine, const QString &html, const QString &baseUrl);
+
+    /**
+     * Returns the media paths the img tags in \p html point
+     * to under \p baseUrl, engines keep them per page so a
+     * new variant only updates the pages that show it
+     */
+    static QStringList references(const QString &html, const QString &baseUrl);
+};
+
+}
+
+#endif // CMS_MEDIA_H
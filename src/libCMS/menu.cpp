@@ -54,6 +54,18 @@ void Menu::setName(const QString &name)
     d->name = name;
 }
 
+int Menu::version() const
+{
+    Q_D(const Menu);
+    return d->version;
+}
+
+void Menu::setVersion(int version)
+{
+    Q_D(Menu);
+    d->version = version;
+}
+
 bool Menu::autoAddPages() const
 {
     Q_D(const Menu);
@@ -43,6 +43,9 @@ public:
     QString name() const;
     void setName(const QString &name);
 
+    int version() const;
+    void setVersion(int version);
+
     bool autoAddPages() const;
     void setAutoAddPages(bool enable);
 
@@ -28,6 +28,7 @@ class MenuPrivate
 {
 public:
     bool autoAddPages = false;
+    int version = 0;
     QString id;
     QString name;
     QStringList locations;
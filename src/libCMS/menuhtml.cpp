@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "menuhtml.h"
+#include "menu.h"
+
+#include <cutelee/engine.h>
+#include <cutelee/context.h>
+#include <cutelee/template.h>
+
+#include <QDebug>
+
+using namespace CMS;
+
+namespace {
+
+// Private use characters, left alone by autoescaping
+const QChar markerStart(0xE000);
+const QChar markerEnd(0xE001);
+
+}
+
+MenuHtml MenuHtml::render(Cutelee::Engine *templates, Menu *menu)
+{
+    MenuHtml ret;
+    ret.menuId = menu->id();
+    ret.version = menu->version();
+
+    Cutelee::Template tmpl = templates->loadByName(QStringLiteral("menu.html"));
+    if (tmpl->error()) {
+        // Themes without a menu template get plain links
+        tmpl = templates->newTemplate(QStringLiteral("{% for entry in entries %}"
+                                                     "<a class=\"{{ entry.active }}\" href=\"{{ entry.url }}\">{{ entry.text }}</a>"
+                                                     "{% endfor %}"),
+                                      QStringLiteral("menu"));
+    }
+
+    QVariantList entries;
+    const QList<QVariantHash> menuEntries = menu->entries();
+    for (int i = 0; i < menuEntries.size(); ++i) {
+        QVariantHash entry = menuEntries.at(i);
+        entry.insert(QStringLiteral("active"), markerStart + QString::number(i) + markerEnd);
+        entries.append(entry);
+    }
+
+    Cutelee::Context context;
+    context.insert(QStringLiteral("menu"), QVariant::fromValue(menu));
+    context.insert(QStringLiteral("entries"), entries);
+    const QString html = tmpl->render(&context);
+    if (tmpl->error()) {
+        qWarning() << "Failed to render menu" << menu->id() << tmpl->errorString();
+    }
+
+    // Split once so marking the active entry is just a join
+    int pos = 0;
+    int start;
+    while ((start = html.indexOf(markerStart, pos)) != -1) {
+        const int end = html.indexOf(markerEnd, start);
+        if (end == -1) {
+            break;
+        }
+
+        const int index = html.midRef(start + 1, end - start - 1).toInt();
+        ret.m_chunks.append(html.mid(pos, start - pos));
+        ret.m_urls.append(menuEntries.value(index).value(QStringLiteral("url")).toString());
+        pos = end + 1;
+    }
+    ret.m_chunks.append(html.mid(pos));
+    ret.m_size = html.size();
+
+    return ret;
+}
+
+QString MenuHtml::html(const QString &activePath) const
+{
+    if (m_urls.isEmpty()) {
+        return m_chunks.value(0);
+    }
+
+    QString ret;
+    ret.reserve(m_size + 16);
+    for (int i = 0; i < m_urls.size(); ++i) {
+        ret.append(m_chunks.at(i));
+        if (m_urls.at(i) == activePath) {
+            ret.append(QLatin1String("active"));
+        }
+    }
+    ret.append(m_chunks.last());
+    return ret;
+}
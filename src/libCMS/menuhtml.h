@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_MENUHTML_H
+#define CMS_MENUHTML_H
+
+#include <QStringList>
+
+namespace Cutelee {
+class Engine;
+}
+
+namespace CMS {
+
+class Menu;
+class MenuHtml
+{
+public:
+    /**
+     * Renders \p menu with the menu.html template loaded by
+     * \p templates, leaving a marker where each entry's
+     * active class goes.
+     *
+     * The result is shared by all requests, so the template gets
+     * only "menu" and "entries" and not the request's "c" that
+     * tags such as c_uri_for need.
+     */
+    static MenuHtml render(Cutelee::Engine *templates, Menu *menu);
+
+    /**
+     * Returns the rendered menu with the entries
+     * pointing to \p activePath marked as active
+     */
+    QString html(const QString &activePath) const;
+
+    QString menuId;
+    int version = -1;
+
+private:
+    QStringList m_chunks;
+    QStringList m_urls;
+    int m_size = 0;
+};
+
+}
+
+#endif // CMS_MENUHTML_H
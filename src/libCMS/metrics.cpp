@@ -0,0 +1,326 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "metrics.h"
+
+#include <QSharedMemory>
+#include <QCryptographicHash>
+#include <QThread>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <QDebug>
+
+#include <cstring>
+
+using namespace CMS;
+
+namespace {
+
+const quint32 Magic = 0x434d4d31;
+const int SlotsCount = 1024;
+const int NameSize = 256;
+const int LabelSize = 160;
+
+// Upper bounds in nanoseconds, the last bucket is +Inf
+const qint64 Bounds[] = {
+    250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000,
+    50000000, 100000000, 250000000, 500000000, 1000000000, 2500000000
+};
+const int BoundsCount = sizeof(Bounds) / sizeof(Bounds[0]);
+
+enum Kind {
+    Counter = 1,
+    Histogram = 2
+};
+
+enum State {
+    Free = 0,
+    Claimed = 1,
+    Ready = 2
+};
+
+// Lives in shared memory, only POD atomics that are valid when zeroed
+struct Slot {
+    QBasicAtomicInt state;
+    int kind;
+    char name[NameSize];
+    QBasicAtomicInteger<quint64> count;
+    QBasicAtomicInteger<quint64> sum;
+    QBasicAtomicInteger<quint64> buckets[BoundsCount + 1];
+};
+
+struct Segment {
+    QBasicAtomicInteger<quint32> magic;
+    Slot slots[SlotsCount];
+};
+
+QSharedMemory *s_memory = nullptr;
+Segment *s_segment = nullptr;
+
+// Must not depend on the per process QHash seed
+quint32 hashName(const char *name)
+{
+    quint32 hash = 2166136261u;
+    while (*name) {
+        hash ^= uchar(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+Slot *findSlot(const QByteArray &name, int kind)
+{
+    static thread_local QHash<QByteArray, Slot *> cache;
+    auto it = cache.constFind(name);
+    if (it != cache.constEnd()) {
+        return it.value();
+    }
+
+    const QByteArray key = name.left(NameSize - 1);
+    const quint32 hash = hashName(key.constData());
+    for (int i = 0; i < SlotsCount; ++i) {
+        Slot *slot = &s_segment->slots[(hash + quint32(i)) % SlotsCount];
+
+        int state = slot->state.loadAcquire();
+        if (state == Free && slot->state.testAndSetAcquire(Free, Claimed)) {
+            slot->kind = kind;
+            std::memcpy(slot->name, key.constData(), size_t(key.size() + 1));
+            slot->state.storeRelease(Ready);
+            cache.insert(name, slot);
+            return slot;
+        }
+
+        // Another worker is writing the name
+        while ((state = slot->state.loadAcquire()) == Claimed) {
+            QThread::yieldCurrentThread();
+        }
+
+        if (std::strncmp(slot->name, key.constData(), NameSize) == 0) {
+            if (slot->kind != kind) {
+                qWarning() << "Metric registered with another type" << name;
+                return nullptr;
+            }
+            cache.insert(name, slot);
+            return slot;
+        }
+    }
+
+    static bool warned = false;
+    if (!warned) {
+        warned = true;
+        qWarning() << "No free metric slots, ignoring" << name;
+    }
+    return nullptr;
+}
+
+QByteArray seconds(quint64 nsecs)
+{
+    return QByteArray::number(double(nsecs) / 1e9, 'g', 9);
+}
+
+// Splits family{labels} into its parts, labels without braces
+void splitName(const QByteArray &name, QByteArray &family, QByteArray &labels)
+{
+    const int brace = name.indexOf('{');
+    if (brace == -1) {
+        family = name;
+        labels.clear();
+    } else {
+        family = name.left(brace);
+        labels = name.mid(brace + 1, name.size() - brace - 2);
+    }
+}
+
+QByteArray withLabels(const QByteArray &name, const QByteArray &labels, const QByteArray &extra = QByteArray())
+{
+    if (labels.isEmpty() && extra.isEmpty()) {
+        return name;
+    }
+    QByteArray ret = name + '{' + labels;
+    if (!labels.isEmpty() && !extra.isEmpty()) {
+        ret += ',';
+    }
+    return ret + extra + '}';
+}
+
+const char *help(const QByteArray &family)
+{
+    static const QHash<QByteArray, const char *> helps = {
+        { "cmlyst_action_duration_seconds", "Time spent dispatching requests per action" },
+        { "cmlyst_http_responses_total", "Responses sent per status code" },
+        { "cmlyst_sql_duration_seconds", "Time spent executing SQL statements" },
+        { "cmlyst_cache_requests_total", "Cache lookups per cache and result" },
+        { "cmlyst_settings_reloads_total", "Times the settings were read from the database" },
+        { "cmlyst_template_render_duration_seconds", "Time spent rendering templates" },
+        { "cmlyst_login_rejected_total", "Logins refused because the verification queue was full" },
+    };
+    return helps.value(family, nullptr);
+}
+
+}
+
+bool Metrics::setup(const QString &key)
+{
+    if (s_segment) {
+        return true;
+    }
+
+    // Keeps the key short and valid for every platform
+    const QString nativeKey = QLatin1String("cmlyst-metrics-") +
+            QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+
+    // SysV segments outlive the process, one left by a previous
+    // master is attached to and then reset like a new one
+    auto memory = new QSharedMemory(nativeKey);
+    if (!memory->create(int(sizeof(Segment))) &&
+            (memory->error() != QSharedMemory::AlreadyExists || !memory->attach())) {
+        qWarning() << "Failed to set up metrics shared memory" << memory->errorString();
+        delete memory;
+        return false;
+    }
+
+    if (memory->size() < int(sizeof(Segment))) {
+        qWarning() << "Metrics shared memory is too small, was it created by another version?" << memory->size();
+        delete memory;
+        return false;
+    }
+
+    memory->lock();
+    std::memset(memory->data(), 0, sizeof(Segment));
+    static_cast<Segment *>(memory->data())->magic.storeRelease(Magic);
+    memory->unlock();
+
+    s_memory = memory;
+    s_segment = static_cast<Segment *>(memory->data());
+    return true;
+}
+
+bool Metrics::isEnabled()
+{
+    return s_segment;
+}
+
+void Metrics::increment(const QByteArray &name, quint64 value)
+{
+    if (!s_segment) {
+        return;
+    }
+
+    Slot *slot = findSlot(name, Counter);
+    if (slot) {
+        slot->count.fetchAndAddRelaxed(value);
+    }
+}
+
+void Metrics::observe(const QByteArray &name, qint64 nsecs)
+{
+    if (!s_segment) {
+        return;
+    }
+
+    Slot *slot = findSlot(name, Histogram);
+    if (!slot) {
+        return;
+    }
+
+    const quint64 value = quint64(qMax<qint64>(0, nsecs));
+    int bucket = 0;
+    while (bucket < BoundsCount && value > quint64(Bounds[bucket])) {
+        ++bucket;
+    }
+    slot->buckets[bucket].fetchAndAddRelaxed(1);
+    slot->sum.fetchAndAddRelaxed(value);
+    slot->count.fetchAndAddRelaxed(1);
+}
+
+QByteArray Metrics::label(const QString &value)
+{
+    QByteArray ret = value.simplified().toUtf8();
+    ret.replace('\\', "\\\\");
+    ret.replace('"', "\\\"");
+
+    if (ret.size() > LabelSize) {
+        int size = LabelSize;
+        // Don't cut an UTF-8 sequence or an escape
+        while (size > 0 && (uchar(ret.at(size)) & 0xc0) == 0x80) {
+            --size;
+        }
+        int backslashes = 0;
+        while (size - backslashes > 0 && ret.at(size - backslashes - 1) == '\\') {
+            ++backslashes;
+        }
+        ret.truncate(size - backslashes % 2);
+    }
+    return ret;
+}
+
+QByteArray Metrics::exposition()
+{
+    if (!s_segment) {
+        return QByteArray();
+    }
+
+    QMap<QByteArray, QVector<Slot *> > families;
+    for (int i = 0; i < SlotsCount; ++i) {
+        Slot *slot = &s_segment->slots[i];
+        if (slot->state.loadAcquire() == Ready) {
+            QByteArray family;
+            QByteArray labels;
+            splitName(QByteArray(slot->name), family, labels);
+            families[family].append(slot);
+        }
+    }
+
+    QByteArray ret;
+    auto it = families.constBegin();
+    while (it != families.constEnd()) {
+        const QByteArray &family = it.key();
+        const bool histogram = it.value().first()->kind == Histogram;
+
+        const char *text = help(family);
+        if (text) {
+            ret += "# HELP " + family + ' ' + text + '\n';
+        }
+        ret += "# TYPE " + family + (histogram ? " histogram\n" : " counter\n");
+
+        for (Slot *slot : it.value()) {
+            QByteArray name;
+            QByteArray labels;
+            splitName(QByteArray(slot->name), name, labels);
+
+            if (!histogram) {
+                ret += withLabels(name, labels) + ' ' + QByteArray::number(slot->count.load()) + '\n';
+                continue;
+            }
+
+            quint64 cumulative = 0;
+            for (int bucket = 0; bucket <= BoundsCount; ++bucket) {
+                cumulative += slot->buckets[bucket].load();
+                const QByteArray le = bucket < BoundsCount ? seconds(quint64(Bounds[bucket])) : QByteArrayLiteral("+Inf");
+                ret += withLabels(name + "_bucket", labels, "le=\"" + le + '"') + ' ' + QByteArray::number(cumulative) + '\n';
+            }
+            ret += withLabels(name + "_sum", labels) + ' ' + seconds(slot->sum.load()) + '\n';
+            ret += withLabels(name + "_count", labels) + ' ' + QByteArray::number(slot->count.load()) + '\n';
+        }
+        ++it;
+    }
+
+    return ret;
+}
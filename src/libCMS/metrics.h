@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_METRICS_H
+#define CMS_METRICS_H
+
+#include <QByteArray>
+#include <QString>
+
+namespace CMS {
+
+/**
+ * Counters and latency histograms kept in shared memory,
+ * so all prefork workers add to the same values.
+ *
+ * Names are in the Prometheus form family{label="value"},
+ * until setup() is called every update is ignored.
+ */
+class Metrics
+{
+public:
+    /**
+     * Creates or attaches to the segment identified by \p key and
+     * zeroes it, must be called once by the master before forking
+     */
+    static bool setup(const QString &key);
+
+    static bool isEnabled();
+
+    static void increment(const QByteArray &name, quint64 value = 1);
+
+    /**
+     * Adds a duration of \p nsecs to a histogram
+     */
+    static void observe(const QByteArray &name, qint64 nsecs);
+
+    /**
+     * Returns \p value escaped and shortened to be used as a label value
+     */
+    static QByteArray label(const QString &value);
+
+    /**
+     * Returns all metrics in the Prometheus text format
+     */
+    static QByteArray exposition();
+};
+
+}
+
+#endif // CMS_METRICS_H
@@ -0,0 +1,1072 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+#include "packengine.h"
+#include "page.h"
+#include "menu.h"
+#include "metrics.h"
+
+#include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
+#include <Cutelyst/Context>
+#include <Cutelyst/Application>
+
+#include <QDir>
+#include <QMap>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFileSystemWatcher>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+Q_LOGGING_CATEGORY(CMS_PACKENGINE, "cms.packengine")
+
+using namespace CMS;
+
+namespace {
+
+/*
+ * Pack layout, in the byte order of the machine that wrote it:
+ *
+ *   PackHeader
+ *   UTF-8 strings, referenced by offset and size
+ *   PackRecord[recordCount]             every published page and post
+ *   quint32[recordCount]                records sorted by path bytes
+ *   quint32[postCount]                  posts, newest published first
+ *   quint32[pageCount]                  pages, newest created first
+ *   quint32[...]                        all, posts and pages in ascending
+ *                                       order of each SortField
+ *   quint32[...]                        each author's posts, newest created first
+ *   PackAuthor[authorCount]             sorted by id
+ *
+ * Arrays start at multiples of 8 so they can be used in place.
+ */
+const char packMagic[8] = { 'C', 'M', 'L', 'Y', 'P', 'A', 'C', 'K' };
+const quint32 packVersion = 2;
+const quint32 packByteOrder = 0x01020304;
+const qint64 invalidDate = std::numeric_limits<qint64>::min();
+
+// Pages read from the source engine at a time when writing
+const int writeBatch = 200;
+
+enum PackGroup {
+    PackAll,
+    PackPosts,
+    PackPages,
+    PackGroupCount
+};
+const int sortFieldCount = Engine::SortTitle + 1;
+
+struct PackString {
+    quint64 offset;
+    quint32 size;
+    quint32 reserved;
+};
+
+struct PackRecord {
+    quint32 id;
+    quint32 authorId;
+    qint64 created;
+    qint64 updated;
+    qint64 publishedAt;
+    quint8 page;
+    quint8 allowComments;
+    quint8 reserved[6];
+    PackString uuid;
+    PackString path;
+    PackString title;
+    PackString content;
+};
+
+struct PackAuthor {
+    quint32 id;
+    quint32 postCount;
+    quint32 pageCount;
+    quint32 reserved;
+    quint64 postsOffset;
+};
+
+struct PackHeader {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    qint64 created;
+    quint32 recordCount;
+    quint32 postCount;
+    quint32 pageCount;
+    quint32 authorCount;
+    quint64 recordsOffset;
+    quint64 pathIndexOffset;
+    quint64 postsOffset;
+    quint64 pagesOffset;
+    quint64 authorsOffset;
+    PackString settings;
+    PackString users;
+    PackString menus;
+    quint64 sortedOffsets[PackGroupCount][sortFieldCount];
+};
+
+static_assert(sizeof(PackString) == 16, "PackString must not be padded");
+static_assert(sizeof(PackRecord) == 104, "PackRecord must not be padded");
+static_assert(sizeof(PackAuthor) == 24, "PackAuthor must not be padded");
+static_assert(sizeof(PackHeader) == 224, "PackHeader must not be padded");
+
+// Engines hand out dates in the site time zone as local time,
+// the wall clock is stored as is so it reads back the same
+qint64 packDate(const QDateTime &dateTime)
+{
+    if (!dateTime.isValid()) {
+        return invalidDate;
+    }
+    QDateTime wallClock = dateTime;
+    wallClock.setTimeSpec(Qt::UTC);
+    return wallClock.toMSecsSinceEpoch();
+}
+
+QDateTime packDate(qint64 msecs)
+{
+    if (msecs == invalidDate) {
+        return QDateTime();
+    }
+    QDateTime ret = QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC);
+    ret.setTimeSpec(Qt::LocalTime);
+    return ret;
+}
+
+int compareBytes(const char *a, quint32 aSize, const char *b, quint32 bSize)
+{
+    const int ret = std::memcmp(a, b, qMin(aSize, bSize));
+    if (ret) {
+        return ret;
+    }
+    return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
+}
+
+// There are only published ones in a pack
+bool onlyDrafts(Engine::Filters filters)
+{
+    return filters.testFlag(Engine::OnlyDrafts) && !filters.testFlag(Engine::OnlyPublished);
+}
+
+bool hasPosts(Engine::Filters filters)
+{
+    return filters.testFlag(Engine::Posts) || !filters.testFlag(Engine::Pages);
+}
+
+bool hasPages(Engine::Filters filters)
+{
+    return filters.testFlag(Engine::Pages) || !filters.testFlag(Engine::Posts);
+}
+
+}
+
+struct PackEngine::Pack
+{
+    ~Pack()
+    {
+        if (data) {
+            file.unmap(data);
+        }
+    }
+
+    const PackHeader *header() const
+    {
+        return reinterpret_cast<const PackHeader *>(data);
+    }
+
+    template <typename T>
+    const T *at(quint64 offset) const
+    {
+        return reinterpret_cast<const T *>(data + offset);
+    }
+
+    const PackRecord &record(quint32 index) const
+    {
+        return at<PackRecord>(header()->recordsOffset)[index];
+    }
+
+    const char *bytes(const PackString &string) const
+    {
+        return reinterpret_cast<const char *>(data + string.offset);
+    }
+
+    QString string(const PackString &string) const
+    {
+        return QString::fromUtf8(bytes(string), int(string.size));
+    }
+
+    QByteArray rawData(const PackString &string) const
+    {
+        return QByteArray::fromRawData(bytes(string), int(string.size));
+    }
+
+    quint32 groupCount(int group) const
+    {
+        switch (group) {
+        case PackPosts:
+            return header()->postCount;
+        case PackPages:
+            return header()->pageCount;
+        default:
+            return header()->recordCount;
+        }
+    }
+
+    const PackAuthor *author(quint32 id) const
+    {
+        const PackAuthor *authors = at<PackAuthor>(header()->authorsOffset);
+        const PackAuthor *end = authors + header()->authorCount;
+        const PackAuthor *it = std::lower_bound(authors, end, id, [] (const PackAuthor &a, quint32 wanted) {
+            return a.id < wanted;
+        });
+        return it != end && it->id == id ? it : nullptr;
+    }
+
+    bool contains(quint64 offset, quint64 size) const
+    {
+        return offset <= quint64(this->size) && size <= quint64(this->size) - offset;
+    }
+
+    bool contains(const PackString &string) const
+    {
+        return contains(string.offset, string.size) && string.size <= quint32(std::numeric_limits<int>::max());
+    }
+
+    template <typename T>
+    bool containsArray(quint64 offset, quint64 count) const
+    {
+        return offset % alignof(T) == 0 && count <= quint64(size) / sizeof(T) && contains(offset, count * sizeof(T));
+    }
+
+    bool containsIndexes(quint64 offset, quint64 count) const
+    {
+        if (!containsArray<quint32>(offset, count)) {
+            return false;
+        }
+        const quint32 *indexes = at<quint32>(offset);
+        for (quint64 i = 0; i < count; ++i) {
+            if (indexes[i] >= header()->recordCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Checks every offset once, so requests can trust them
+     */
+    bool isValid() const
+    {
+        if (size < qint64(sizeof(PackHeader))) {
+            return false;
+        }
+
+        const PackHeader *h = header();
+        if (std::memcmp(h->magic, packMagic, sizeof(packMagic)) || h->version != packVersion || h->byteOrder != packByteOrder) {
+            return false;
+        }
+
+        if (!containsArray<PackRecord>(h->recordsOffset, h->recordCount) ||
+                !containsIndexes(h->pathIndexOffset, h->recordCount) ||
+                !containsIndexes(h->postsOffset, h->postCount) ||
+                !containsIndexes(h->pagesOffset, h->pageCount) ||
+                !containsArray<PackAuthor>(h->authorsOffset, h->authorCount) ||
+                !contains(h->settings) || !contains(h->users) || !contains(h->menus)) {
+            return false;
+        }
+
+        for (quint32 i = 0; i < h->recordCount; ++i) {
+            const PackRecord &r = record(i);
+            if (!contains(r.uuid) || !contains(r.path) || !contains(r.title) || !contains(r.content)) {
+                return false;
+            }
+        }
+
+        for (int group = 0; group < PackGroupCount; ++group) {
+            for (int field = 0; field < sortFieldCount; ++field) {
+                if (!containsIndexes(h->sortedOffsets[group][field], groupCount(group))) {
+                    return false;
+                }
+            }
+        }
+
+        // Looked up with a binary search
+        const PackAuthor *authors = at<PackAuthor>(h->authorsOffset);
+        for (quint32 i = 0; i < h->authorCount; ++i) {
+            if ((i && authors[i - 1].id >= authors[i].id) ||
+                    authors[i].pageCount > h->pageCount ||
+                    !containsIndexes(authors[i].postsOffset, authors[i].postCount)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QFile file;
+    uchar *data = nullptr;
+    qint64 size = 0;
+};
+
+PackEngine::PackEngine(QObject *parent) : Engine(parent)
+{
+
+}
+
+PackEngine::~PackEngine()
+{
+
+}
+
+bool PackEngine::init(const QHash<QString, QString> &settings)
+{
+    m_fileName = QFileInfo(settings.value(QStringLiteral("file"))).absoluteFilePath();
+    if (!load()) {
+        return false;
+    }
+
+    // New packs are renamed over the old one, a watch
+    // on the file itself would be lost on the first swap
+    m_watcher = new QFileSystemWatcher({ QFileInfo(m_fileName).absolutePath() }, this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, [this] {
+        const QFileInfo info(m_fileName);
+        if (info.exists() && info.lastModified() != m_fileModified) {
+            load();
+        }
+    });
+
+    return true;
+}
+
+bool PackEngine::load()
+{
+    std::unique_ptr<Pack> pack(new Pack);
+    pack->file.setFileName(m_fileName);
+    if (!pack->file.open(QIODevice::ReadOnly)) {
+        qCWarning(CMS_PACKENGINE) << "Failed to open pack" << m_fileName << pack->file.errorString();
+        return false;
+    }
+
+    pack->size = pack->file.size();
+    pack->data = pack->file.map(0, pack->size);
+    if (!pack->data) {
+        qCWarning(CMS_PACKENGINE) << "Failed to map pack" << m_fileName << pack->file.errorString();
+        return false;
+    }
+
+    // A broken pack leaves the current one in place
+    if (!pack->isValid()) {
+        qCWarning(CMS_PACKENGINE) << "Invalid pack" << m_fileName;
+        return false;
+    }
+
+    m_fileModified = QFileInfo(m_fileName).lastModified();
+    m_pack = std::move(pack);
+    m_packModified = QDateTime::fromMSecsSinceEpoch(m_pack->header()->created, Qt::UTC);
+
+    applySettings();
+    applyUsers();
+    applyMenus();
+    clearMenusHtml();
+
+    qCDebug(CMS_PACKENGINE) << "Pack loaded" << m_fileName << m_pack->header()->recordCount << "pages and posts";
+
+    return true;
+}
+
+void PackEngine::applySettings()
+{
+    QHash<QString, QString> settings;
+    const QJsonObject obj = QJsonDocument::fromJson(m_pack->rawData(m_pack->header()->settings)).object();
+    auto it = obj.constBegin();
+    while (it != obj.constEnd()) {
+        settings.insert(it.key(), it.value().toString());
+        ++it;
+    }
+    m_settings = settings;
+    Metrics::increment("cmlyst_settings_reloads_total");
+
+    const qint64 modified = m_settings.value(QStringLiteral("modified")).toLongLong();
+    m_settingsDateTime = QDateTime::fromMSecsSinceEpoch(modified * 1000);
+
+    configureView();
+}
+
+void PackEngine::applyUsers()
+{
+    m_users.clear();
+    m_usersSlug.clear();
+    m_usersId.clear();
+
+    const QJsonArray users = QJsonDocument::fromJson(m_pack->rawData(m_pack->header()->users)).array();
+    for (const QJsonValue &value : users) {
+        const QJsonObject obj = value.toObject();
+        QHash<QString, QString> user;
+        auto it = obj.constBegin();
+        while (it != obj.constEnd()) {
+            user.insert(it.key(), it.value().toString());
+            ++it;
+        }
+
+        const int id = user.value(QStringLiteral("id")).toInt();
+        m_usersSlug.insert(user.value(QStringLiteral("slug")), id);
+        m_usersId.insert(id, user);
+        m_users.push_back(QVariant::fromValue(user));
+    }
+}
+
+void PackEngine::applyMenus()
+{
+    qDeleteAll(m_menus);
+    m_menus.clear();
+    m_menuLocations.clear();
+
+    const QJsonArray menus = QJsonDocument::fromJson(m_pack->rawData(m_pack->header()->menus)).array();
+    for (const QJsonValue &value : menus) {
+        const QJsonObject obj = value.toObject();
+
+        auto menu = new Menu(obj.value(QStringLiteral("id")).toString(), this);
+        menu->setName(obj.value(QStringLiteral("name")).toString());
+        menu->setVersion(obj.value(QStringLiteral("version")).toInt());
+
+        QList<QVariantHash> entries;
+        const QJsonArray entriesJson = obj.value(QStringLiteral("entries")).toArray();
+        for (const QJsonValue &entry : entriesJson) {
+            entries.append(entry.toObject().toVariantHash());
+        }
+        menu->setEntries(entries);
+
+        QStringList locations;
+        const QJsonArray locationsJson = obj.value(QStringLiteral("locations")).toArray();
+        for (const QJsonValue &location : locationsJson) {
+            locations.append(location.toString());
+            if (!m_menuLocations.contains(location.toString())) {
+                m_menuLocations.insert(location.toString(), menu);
+            }
+        }
+        menu->setLocations(locations);
+
+        m_menus.push_back(menu);
+    }
+}
+
+bool PackEngine::write(Engine *source, const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(CMS_PACKENGINE) << "Failed to open pack" << fileName << file.errorString();
+        return false;
+    }
+
+    // The header is written last, once every offset is known
+    PackHeader header;
+    std::memset(&header, 0, sizeof(header));
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+
+    // Strings go to the file as each page is read, only the
+    // fixed size records are kept until the arrays are written
+    auto addString = [&file, &ok] (const QString &value) -> PackString {
+        const QByteArray utf8 = value.toUtf8();
+        PackString ret;
+        ret.offset = quint64(file.pos());
+        ret.size = quint32(utf8.size());
+        ret.reserved = 0;
+        ok = ok && file.write(utf8) == qint64(utf8.size());
+        return ret;
+    };
+
+    QVector<PackRecord> records;
+    QVector<QByteArray> paths;
+    QVector<QByteArray> titles;
+    auto addRecord = [&] (Page *page) -> quint32 {
+        PackRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.id = quint32(page->id());
+        record.authorId = quint32(page->author().value(QStringLiteral("id")).toInt());
+        record.created = packDate(page->created());
+        record.updated = packDate(page->updated());
+        record.publishedAt = packDate(page->publishedAt());
+        record.page = page->page();
+        record.allowComments = page->allowComments();
+        record.uuid = addString(page->uuid());
+        record.path = addString(page->path());
+        record.title = addString(page->title());
+        record.content = addString(page->content().get());
+
+        records.append(record);
+        paths.append(page->path().toUtf8());
+        titles.append(page->title().toUtf8());
+        return quint32(records.size() - 1);
+    };
+
+    // Read in batches so the pages are never all in memory
+    QVector<quint32> postsIndex;
+    for (int offset = 0; ok; offset += writeBatch) {
+        QObject parent;
+        const QList<Page *> posts = source->listPostsPublished(&parent, offset, writeBatch);
+        for (Page *post : posts) {
+            postsIndex.append(addRecord(post));
+        }
+        if (posts.size() < writeBatch) {
+            break;
+        }
+    }
+    QVector<quint32> pagesIndex;
+    for (int offset = 0; ok; offset += writeBatch) {
+        QObject parent;
+        const QList<Page *> pages = source->listPagesPublished(&parent, offset, writeBatch);
+        for (Page *page : pages) {
+            pagesIndex.append(addRecord(page));
+        }
+        if (pages.size() < writeBatch) {
+            break;
+        }
+    }
+
+    QVector<quint32> pathIndex(records.size());
+    for (int i = 0; i < pathIndex.size(); ++i) {
+        pathIndex[i] = quint32(i);
+    }
+    std::sort(pathIndex.begin(), pathIndex.end(), [&paths] (quint32 a, quint32 b) {
+        return compareBytes(paths.at(int(a)).constData(), quint32(paths.at(int(a)).size()),
+                            paths.at(int(b)).constData(), quint32(paths.at(int(b)).size())) < 0;
+    });
+
+    // listPagesSummary() slices these instead of sorting
+    const QVector<quint32> groups[PackGroupCount] = { postsIndex + pagesIndex, postsIndex, pagesIndex };
+    QVector<quint32> sorted[PackGroupCount][sortFieldCount];
+    for (int group = 0; group < PackGroupCount; ++group) {
+        for (int field = 0; field < sortFieldCount; ++field) {
+            QVector<quint32> &order = sorted[group][field];
+            order = groups[group];
+            std::stable_sort(order.begin(), order.end(), [&records, &titles, field] (quint32 a, quint32 b) {
+                const PackRecord &ra = records.at(int(a));
+                const PackRecord &rb = records.at(int(b));
+                switch (field) {
+                case SortUpdated:
+                    return ra.updated < rb.updated;
+                case SortPublished:
+                    return ra.publishedAt < rb.publishedAt;
+                case SortTitle:
+                    return compareBytes(titles.at(int(a)).constData(), quint32(titles.at(int(a)).size()),
+                                        titles.at(int(b)).constData(), quint32(titles.at(int(b)).size())) < 0;
+                default:
+                    return ra.created < rb.created;
+                }
+            });
+        }
+    }
+
+    static const QStringList userFields = {
+        QStringLiteral("id"),
+        QStringLiteral("slug"),
+        QStringLiteral("name"),
+        QStringLiteral("bio"),
+        QStringLiteral("location"),
+        QStringLiteral("website"),
+        QStringLiteral("twitter"),
+        QStringLiteral("facebook"),
+        QStringLiteral("image"),
+        QStringLiteral("cover"),
+        QStringLiteral("url"),
+    };
+
+    // Only what public pages show, no emails nor passwords
+    QJsonArray usersJson;
+    QMap<quint32, PackAuthor> authors;
+    QMap<quint32, QVector<quint32>> authorPosts;
+    const QVariantList users = source->users();
+    for (const QVariant &value : users) {
+        const auto user = value.value<QHash<QString, QString>>();
+        QJsonObject obj;
+        for (const QString &field : userFields) {
+            obj.insert(field, user.value(field));
+        }
+        usersJson.append(obj);
+
+        PackAuthor author;
+        std::memset(&author, 0, sizeof(author));
+        author.id = quint32(user.value(QStringLiteral("id")).toInt());
+        authors.insert(author.id, author);
+        authorPosts.insert(author.id, QVector<quint32>());
+    }
+
+    // Newest created first, the stored order is ascending
+    const QVector<quint32> &byCreated = sorted[PackPosts][SortCreated];
+    for (int i = byCreated.size() - 1; i >= 0; --i) {
+        auto it = authorPosts.find(records.at(int(byCreated.at(i))).authorId);
+        if (it != authorPosts.end()) {
+            it.value().append(byCreated.at(i));
+        }
+    }
+    for (quint32 index : pagesIndex) {
+        auto it = authors.find(records.at(int(index)).authorId);
+        if (it != authors.end()) {
+            ++it.value().pageCount;
+        }
+    }
+
+    QJsonArray menusJson;
+    const QList<Menu *> menus = source->menus();
+    for (Menu *menu : menus) {
+        QJsonArray entries;
+        const QList<QVariantHash> menuEntries = menu->entries();
+        for (const QVariantHash &entry : menuEntries) {
+            entries.append(QJsonObject::fromVariantHash(entry));
+        }
+        menusJson.append(QJsonObject{
+                             {QStringLiteral("id"), menu->id()},
+                             {QStringLiteral("name"), menu->name()},
+                             {QStringLiteral("version"), menu->version()},
+                             {QStringLiteral("locations"), QJsonArray::fromStringList(menu->locations())},
+                             {QStringLiteral("entries"), entries}
+                         });
+    }
+
+    QJsonObject settingsJson;
+    const QHash<QString, QString> settings = source->settings();
+    auto settingsIt = settings.constBegin();
+    while (settingsIt != settings.constEnd()) {
+        settingsJson.insert(settingsIt.key(), settingsIt.value());
+        ++settingsIt;
+    }
+
+    std::memcpy(header.magic, packMagic, sizeof(packMagic));
+    header.version = packVersion;
+    header.byteOrder = packByteOrder;
+    header.created = QDateTime::currentMSecsSinceEpoch();
+    header.recordCount = quint32(records.size());
+    header.postCount = quint32(postsIndex.size());
+    header.pageCount = quint32(pagesIndex.size());
+    header.authorCount = quint32(authors.size());
+    header.settings = addString(QString::fromUtf8(QJsonDocument(settingsJson).toJson(QJsonDocument::Compact)));
+    header.users = addString(QString::fromUtf8(QJsonDocument(usersJson).toJson(QJsonDocument::Compact)));
+    header.menus = addString(QString::fromUtf8(QJsonDocument(menusJson).toJson(QJsonDocument::Compact)));
+
+    auto append = [&file, &ok] (const void *array, qint64 size) -> quint64 {
+        static const char padding[8] = {};
+        const qint64 pad = (8 - file.pos() % 8) % 8;
+        ok = ok && file.write(padding, pad) == pad;
+        const quint64 offset = quint64(file.pos());
+        ok = ok && file.write(static_cast<const char *>(array), size) == size;
+        return offset;
+    };
+    auto appendIndexes = [&append] (const QVector<quint32> &indexes) -> quint64 {
+        return append(indexes.constData(), qint64(indexes.size()) * qint64(sizeof(quint32)));
+    };
+
+    header.recordsOffset = append(records.constData(), qint64(records.size()) * qint64(sizeof(PackRecord)));
+    header.pathIndexOffset = appendIndexes(pathIndex);
+    header.postsOffset = appendIndexes(postsIndex);
+    header.pagesOffset = appendIndexes(pagesIndex);
+    for (int group = 0; group < PackGroupCount; ++group) {
+        for (int field = 0; field < sortFieldCount; ++field) {
+            header.sortedOffsets[group][field] = appendIndexes(sorted[group][field]);
+        }
+    }
+
+    // Authors are written after their posts so the offsets are known
+    QVector<PackAuthor> authorsArray;
+    auto authorIt = authors.begin();
+    while (authorIt != authors.end()) {
+        const QVector<quint32> &posts = authorPosts.value(authorIt.key());
+        PackAuthor &author = authorIt.value();
+        author.postCount = quint32(posts.size());
+        author.postsOffset = appendIndexes(posts);
+        authorsArray.append(author);
+        ++authorIt;
+    }
+    header.authorsOffset = append(authorsArray.constData(), qint64(authorsArray.size()) * qint64(sizeof(PackAuthor)));
+
+    const qint64 size = file.pos();
+    ok = ok && file.seek(0) && file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+    if (!ok) {
+        qCWarning(CMS_PACKENGINE) << "Failed to write pack" << fileName << file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        qCWarning(CMS_PACKENGINE) << "Failed to write pack" << fileName << file.errorString();
+        return false;
+    }
+
+    qCDebug(CMS_PACKENGINE) << "Pack written" << fileName << records.size() << "pages and posts" << size << "bytes";
+    return true;
+}
+
+Page *PackEngine::createPage(quint32 index, QObject *parent, bool summary)
+{
+    const PackRecord &record = m_pack->record(index);
+
+    auto page = new Page(parent);
+    page->setId(int(record.id));
+    page->setUuid(m_pack->string(record.uuid));
+    page->setPath(m_pack->string(record.path));
+    page->setTitle(m_pack->string(record.title));
+    page->setAuthor(user(int(record.authorId)));
+    if (!summary) {
+        page->setContent(m_pack->string(record.content), true);
+    }
+    page->setCreated(packDate(record.created));
+    page->setUpdated(packDate(record.updated));
+    page->setPublishedAt(packDate(record.publishedAt));
+    page->setPage(record.page);
+    page->setAllowComments(record.allowComments);
+    page->setPublished(true);
+    return page;
+}
+
+QList<Page *> PackEngine::createPages(const quint32 *indexes, quint32 count, int offset, int limit, QObject *parent, bool summary)
+{
+    QList<Page *> ret;
+    const quint32 begin = qMin(quint32(qMax(0, offset)), count);
+    const quint32 end = limit < 0 ? count : begin + qMin(quint32(limit), count - begin);
+    for (quint32 i = begin; i < end; ++i) {
+        ret.append(createPage(indexes[i], parent, summary));
+    }
+    return ret;
+}
+
+QList<Page *> PackEngine::listSlice(int authorId, bool pages, int offset, int limit, QObject *parent)
+{
+    if (!m_pack) {
+        return QList<Page *>();
+    }
+
+    const PackHeader *header = m_pack->header();
+    if (pages) {
+        return createPages(m_pack->at<quint32>(header->pagesOffset), header->pageCount, offset, limit, parent, false);
+    }
+    if (authorId > 0) {
+        const PackAuthor *author = m_pack->author(quint32(authorId));
+        if (!author) {
+            return QList<Page *>();
+        }
+        return createPages(m_pack->at<quint32>(author->postsOffset), author->postCount, offset, limit, parent, false);
+    }
+    return createPages(m_pack->at<quint32>(header->postsOffset), header->postCount, offset, limit, parent, false);
+}
+
+Page *PackEngine::getPage(const QString &path, QObject *parent)
+{
+    if (!m_pack) {
+        return nullptr;
+    }
+
+    const QByteArray key = path.toUtf8();
+    const PackHeader *header = m_pack->header();
+    const quint32 *index = m_pack->at<quint32>(header->pathIndexOffset);
+    const quint32 *end = index + header->recordCount;
+    const quint32 *it = std::lower_bound(index, end, key, [this] (quint32 record, const QByteArray &wanted) {
+        const PackString &recordPath = m_pack->record(record).path;
+        return compareBytes(m_pack->bytes(recordPath), recordPath.size, wanted.constData(), quint32(wanted.size())) < 0;
+    });
+
+    if (it != end) {
+        const PackString &found = m_pack->record(*it).path;
+        if (compareBytes(m_pack->bytes(found), found.size, key.constData(), quint32(key.size())) == 0) {
+            return createPage(*it, parent, false);
+        }
+    }
+    return nullptr;
+}
+
+Page *PackEngine::getPageById(const QString &id, QObject *parent)
+{
+    if (!m_pack) {
+        return nullptr;
+    }
+
+    const quint32 wanted = id.toUInt();
+    const quint32 count = m_pack->header()->recordCount;
+    for (quint32 i = 0; i < count; ++i) {
+        if (m_pack->record(i).id == wanted) {
+            return createPage(i, parent, false);
+        }
+    }
+    return nullptr;
+}
+
+bool PackEngine::removePage(int id)
+{
+    Q_UNUSED(id)
+    return false;
+}
+
+QList<Page *> PackEngine::listPages(QObject *parent, int offset, int limit)
+{
+    return listSlice(0, true, offset, limit, parent);
+}
+
+QList<Page *> PackEngine::listPagesPublished(QObject *parent, int offset, int limit)
+{
+    return listSlice(0, true, offset, limit, parent);
+}
+
+QList<Page *> PackEngine::listPosts(QObject *parent, int offset, int limit)
+{
+    return listSlice(0, false, offset, limit, parent);
+}
+
+QList<Page *> PackEngine::listPostsPublished(QObject *parent, int offset, int limit)
+{
+    return listSlice(0, false, offset, limit, parent);
+}
+
+QList<Page *> PackEngine::listAuthorPostsPublished(QObject *parent, int authorId, int offset, int limit)
+{
+    return listSlice(authorId, false, offset, limit, parent);
+}
+
+QList<Page *> PackEngine::listPagesSummary(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit)
+{
+    QList<Page *> ret;
+    if (!m_pack || onlyDrafts(filters)) {
+        return ret;
+    }
+
+    const bool posts = hasPosts(filters);
+    const bool pages = hasPages(filters);
+    const int group = posts && pages ? PackAll : (posts ? PackPosts : PackPages);
+    const quint32 count = m_pack->groupCount(group);
+    const quint32 *sorted = m_pack->at<quint32>(m_pack->header()->sortedOffsets[group][sort]);
+
+    // Stored in ascending order, without an author to
+    // match the wanted slice is read where it starts
+    quint32 skip = quint32(qMax(0, offset));
+    quint32 i = 0;
+    if (authorId <= 0) {
+        i = qMin(skip, count);
+        skip = 0;
+    }
+    const int wanted = limit < 0 ? std::numeric_limits<int>::max() : limit;
+    for (; i < count && ret.size() < wanted; ++i) {
+        const quint32 index = order == Qt::AscendingOrder ? sorted[i] : sorted[count - 1 - i];
+        if (authorId > 0 && m_pack->record(index).authorId != quint32(authorId)) {
+            continue;
+        }
+        if (skip) {
+            --skip;
+            continue;
+        }
+        ret.append(createPage(index, parent, true));
+    }
+    return ret;
+}
+
+int PackEngine::countPages(Filters filters, int authorId)
+{
+    if (!m_pack || onlyDrafts(filters)) {
+        return 0;
+    }
+
+    quint32 posts = m_pack->header()->postCount;
+    quint32 pages = m_pack->header()->pageCount;
+    if (authorId > 0) {
+        const PackAuthor *author = m_pack->author(quint32(authorId));
+        posts = author ? author->postCount : 0;
+        pages = author ? author->pageCount : 0;
+    }
+    return int((hasPosts(filters) ? posts : 0) + (hasPages(filters) ? pages : 0));
+}
+
+QHash<QString, QString> PackEngine::settings() const
+{
+    return m_settings;
+}
+
+QString PackEngine::settingsValue(const QString &key, const QString &defaultValue) const
+{
+    return m_settings.value(key, defaultValue);
+}
+
+bool PackEngine::setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(key)
+    Q_UNUSED(value)
+    return false;
+}
+
+QList<Menu *> PackEngine::menus()
+{
+    return m_menus;
+}
+
+QHash<QString, Menu *> PackEngine::menuLocations()
+{
+    return m_menuLocations;
+}
+
+bool PackEngine::settingsIsWritable() const
+{
+    return false;
+}
+
+QHash<QString, QString> PackEngine::loadSettings(Cutelyst::Context *c)
+{
+    Q_UNUSED(c)
+    Metrics::increment("cmlyst_cache_requests_total{cache=\"settings\",result=\"hit\"}");
+    return m_settings;
+}
+
+QDateTime PackEngine::lastModified()
+{
+    return qMax(m_settingsDateTime, m_packModified);
+}
+
+QString PackEngine::addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(user)
+    Q_UNUSED(replace)
+    return QString();
+}
+
+bool PackEngine::removeUser(Cutelyst::Context *c, int id)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(id)
+    return false;
+}
+
+QString PackEngine::updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(slug)
+    Q_UNUSED(user)
+    return QString();
+}
+
+bool PackEngine::invalidateUser(Cutelyst::Context *c, int id)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(id)
+    return false;
+}
+
+QVariantList PackEngine::users()
+{
+    return m_users;
+}
+
+QHash<QString, QString> PackEngine::user(const QString &slug)
+{
+    auto it = m_usersSlug.constFind(slug);
+    if (it != m_usersSlug.constEnd()) {
+        return m_usersId.value(it.value());
+    }
+    return QHash<QString, QString>();
+}
+
+QHash<QString, QString> PackEngine::user(int id)
+{
+    return m_usersId.value(id);
+}
+
+QHash<QString, QString> PackEngine::credentials(const QString &email)
+{
+    Q_UNUSED(email)
+    // Packs carry no passwords, nobody logs in on these nodes
+    return QHash<QString, QString>();
+}
+
+bool PackEngine::setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(id)
+    Q_UNUSED(oldHash)
+    Q_UNUSED(newHash)
+    return false;
+}
+
+bool PackEngine::addMedia(const QVariantHash &media)
+{
+    Q_UNUSED(media)
+    return false;
+}
+
+bool PackEngine::removeMedia(const QString &path)
+{
+    Q_UNUSED(path)
+    return false;
+}
+
+QVariantHash PackEngine::media(const QString &path)
+{
+    Q_UNUSED(path)
+    return QVariantHash();
+}
+
+QVariantHash PackEngine::mediaByHash(const QString &hash)
+{
+    Q_UNUSED(hash)
+    return QVariantHash();
+}
+
+bool PackEngine::setMediaVariants(const QString &hash, const QVariantList &variants)
+{
+    Q_UNUSED(hash)
+    Q_UNUSED(variants)
+    return false;
+}
+
+QVariantList PackEngine::listMedia(int offset, int limit)
+{
+    Q_UNUSED(offset)
+    Q_UNUSED(limit)
+    return QVariantList();
+}
+
+int PackEngine::countMedia()
+{
+    return 0;
+}
+
+int PackEngine::savePageBackend(Page *page)
+{
+    Q_UNUSED(page)
+    return 0;
+}
+
+void PackEngine::configureView()
+{
+    const QString theme = m_settings.value(QStringLiteral("theme"), QStringLiteral("default"));
+
+    auto app = qobject_cast<Cutelyst::Application *>(parent());
+    if (!app || m_theme == theme) {
+        return;
+    }
+    m_theme = theme;
+
+    auto view = qobject_cast<Cutelyst::CuteleeView*>(app->view());
+
+    const QDir themeDir = app->pathTo(QStringLiteral("root/themes"));
+
+    view->setIncludePaths({ themeDir.absoluteFilePath(theme) });
+
+    // Menus get the same tag libraries and settings as the other templates
+    setMenuTemplates(view->engine());
+}
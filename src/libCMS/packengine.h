@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef PACKENGINE_H
+#define PACKENGINE_H
+
+#include <QObject>
+#include <QDateTime>
+
+#include <memory>
+
+#include "engine.h"
+
+class QFileSystemWatcher;
+
+namespace CMS {
+
+/**
+ * Serves a read-only snapshot of the published site from a pack
+ * file mapped in memory, for nodes that only take public traffic.
+ *
+ * The pack has fixed size page records, a path index sorted by
+ * bytes and the listings already in every order they are asked
+ * for, so a lookup is a binary search and a listing a slice. The
+ * content is stored as the final HTML, with srcset already added.
+ * Settings, users and menus are small and read once per pack.
+ *
+ * When a new pack is renamed over the file it is mapped and
+ * swapped in, pages hold copies so none point into the old one.
+ */
+class PackEngine : public Engine
+{
+    Q_OBJECT
+public:
+    explicit PackEngine(QObject *parent = 0);
+    ~PackEngine();
+
+    /**
+     * Needs the "file" setting, the pack to serve
+     */
+    virtual bool init(const QHash<QString, QString> &settings) override;
+
+    /**
+     * Writes the published content of \p source to a pack
+     * at \p fileName, the old file is replaced atomically
+     */
+    static bool write(Engine *source, const QString &fileName);
+
+    virtual Page *getPage(const QString &path, QObject *parent) override;
+
+    virtual Page *getPageById(const QString &id, QObject *parent) override;
+
+    virtual bool removePage(int id) override;
+
+    virtual QList<Page *> listPages(QObject *parent,
+                                    int offset,
+                                    int limit) override;
+
+    virtual QList<Page *> listPagesPublished(QObject *parent,
+                                             int offset,
+                                             int limit) override;
+
+    virtual QList<Page *> listPosts(QObject *parent,
+                                    int offset,
+                                    int limit) override;
+
+    virtual QList<Page *> listPostsPublished(QObject *parent,
+                                             int offset,
+                                             int limit) override;
+
+    virtual QList<Page *> listAuthorPostsPublished(QObject *parent,
+                                                   int authorId,
+                                                   int offset,
+                                                   int limit) override;
+
+    virtual QList<Page *> listPagesSummary(QObject *parent,
+                                           Filters filters,
+                                           int authorId,
+                                           SortField sort,
+                                           Qt::SortOrder order,
+                                           int offset,
+                                           int limit) override;
+
+    virtual int countPages(Filters filters, int authorId) override;
+
+    virtual QHash<QString, QString> settings() const override;
+
+    virtual QString settingsValue(const QString &key, const QString &defaultValue = QString()) const override;
+    virtual bool setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value) override;
+
+    virtual QList<Menu *> menus() override;
+    virtual QHash<QString, Menu *> menuLocations() override;
+
+    virtual bool settingsIsWritable() const override;
+
+    QHash<QString, QString> loadSettings(Cutelyst::Context *c) override;
+
+    /**
+     * The newest of the settings date and the pack's, so
+     * clients revalidate listings after a new pack lands
+     */
+    virtual QDateTime lastModified() override;
+
+    virtual QString addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace) override;
+    virtual bool removeUser(Cutelyst::Context *c, int id) override;
+    virtual QString updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user) override;
+    virtual bool invalidateUser(Cutelyst::Context *c, int id) override;
+    virtual QVariantList users() override;
+    virtual QHash<QString, QString> user(const QString &slug) override;
+    virtual QHash<QString, QString> user(int id) override;
+    virtual QHash<QString, QString> credentials(const QString &email) override;
+    virtual bool setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash) override;
+
+    virtual bool addMedia(const QVariantHash &media) override;
+    virtual bool removeMedia(const QString &path) override;
+    virtual QVariantHash media(const QString &path) override;
+    virtual QVariantHash mediaByHash(const QString &hash) override;
+    virtual bool setMediaVariants(const QString &hash, const QVariantList &variants) override;
+    virtual QVariantList listMedia(int offset, int limit) override;
+    virtual int countMedia() override;
+
+private:
+    struct Pack;
+
+    virtual int savePageBackend(Page *page) override;
+
+    bool load();
+    void applySettings();
+    void applyUsers();
+    void applyMenus();
+    void configureView();
+    Page *createPage(quint32 record, QObject *parent, bool summary);
+    QList<Page *> createPages(const quint32 *indexes, quint32 count, int offset, int limit, QObject *parent, bool summary);
+    /**
+     * Pages, posts or an author's posts, in the order stored in the pack
+     */
+    QList<Page *> listSlice(int authorId, bool pages, int offset, int limit, QObject *parent);
+
+    QString m_fileName;
+    QFileSystemWatcher *m_watcher = nullptr;
+    std::unique_ptr<Pack> m_pack;
+    QDateTime m_fileModified;
+    QDateTime m_packModified;
+    QString m_theme;
+    QVariantList m_users;
+    QHash<QString, int> m_usersSlug;
+    QHash<int, QHash<QString, QString> > m_usersId;
+    QHash<QString, QString> m_settings;
+    QDateTime m_settingsDateTime;
+    QList<CMS::Menu *> m_menus;
+    QHash<QString, CMS::Menu *> m_menuLocations;
+};
+
+}
+
+#endif // PACKENGINE_H
@@ -0,0 +1,1490 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+#include "pgengine.h"
+#include "page.h"
+#include "menu.h"
+#include "metrics.h"
+#include "media.h"
+
+#include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
+#include <Cutelyst/Context>
+#include <Cutelyst/Application>
+
+#include <apool.h>
+#include <apg.h>
+
+#include <QDir>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QRegularExpression>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QVector>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <QLoggingCategory>
+
+#include <chrono>
+
+Q_LOGGING_CATEGORY(CMS_PGENGINE, "cms.pgengine")
+
+using namespace CMS;
+using namespace ASql;
+
+namespace {
+
+const QString pool = QStringLiteral("cmlyst");
+const QString channel = QStringLiteral("cmlyst");
+
+const QString pageColumns = QStringLiteral("id, uuid, path, title, author_id, content,"
+                                           " created_at, updated_at, published_at, page, allow_comments, published ");
+// Public reads get the HTML stored with srcset added
+const QString publicColumns = QStringLiteral("id, uuid, path, title, author_id, COALESCE(html, content),"
+                                             " created_at, updated_at, published_at, page, allow_comments, published ");
+const QString summaryColumns = QStringLiteral("id, uuid, path, title, author_id, NULL,"
+                                              " created_at, updated_at, published_at, page, allow_comments, published ");
+const QString mediaColumns = QStringLiteral("id, path, name, size, mime, width, height, hash, uploaded_at, variants ");
+
+/**
+ * Media times are used for HTTP validators, so they stay in UTC
+ */
+QDateTime utcValue(const QVariant &value)
+{
+    QDateTime ret = value.type() == QVariant::String ?
+                QDateTime::fromString(value.toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss")) : value.toDateTime();
+    ret.setTimeSpec(Qt::UTC);
+    return ret;
+}
+
+}
+
+/**
+ * Rows read on the blocking connection, with the
+ * parts of AResult the shared code uses
+ */
+class PgEngine::SyncRow
+{
+public:
+    QVariant value(int column) const
+    {
+        return values.value(column);
+    }
+
+    QVariantList values;
+};
+
+class PgEngine::SyncResult
+{
+public:
+    bool error() const
+    {
+        return failed;
+    }
+
+    QString errorString() const
+    {
+        return errorText;
+    }
+
+    int size() const
+    {
+        return rows.size();
+    }
+
+    int numRowsAffected() const
+    {
+        return rowsAffected;
+    }
+
+    SyncRow operator[](int row) const
+    {
+        return rows.at(row);
+    }
+
+    QVector<SyncRow>::const_iterator begin() const
+    {
+        return rows.constBegin();
+    }
+
+    QVector<SyncRow>::const_iterator end() const
+    {
+        return rows.constEnd();
+    }
+
+    QVector<SyncRow> rows;
+    QString errorText;
+    int rowsAffected = -1;
+    bool failed = false;
+};
+
+PgEngine::PgEngine(QObject *parent) : Engine(parent)
+{
+
+}
+
+PgEngine::~PgEngine()
+{
+    if (m_blockingName.isEmpty()) {
+        return;
+    }
+
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_blockingName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_blockingName);
+}
+
+bool PgEngine::init(const QHash<QString, QString> &settings)
+{
+    m_connection = settings.value(QStringLiteral("connection"));
+    if (m_connection.isEmpty()) {
+        qCCritical(CMS_PGENGINE) << "No PostgreSQL connection configured";
+        return false;
+    }
+
+    APool::create(APg::factory(m_connection), pool);
+    APool::setMaxIdleConnections(4, pool);
+
+    // Queries sent while others are in flight go out at
+    // once instead of waiting for the previous result
+    APool::setSetupCallback(pool, [] (ADatabase db) {
+        db.enterPipelineMode(std::chrono::milliseconds(2));
+    });
+
+    if (!openBlocking() || !createDb()) {
+        return false;
+    }
+
+    applySettings(execSync(QStringLiteral("SELECT key, value FROM settings")));
+    reload(QStringLiteral("menus"));
+    reload(QStringLiteral("users"));
+    if (m_settings.isEmpty()) {
+        qCCritical(CMS_PGENGINE) << "Failed to load settings from" << m_connection;
+        return false;
+    }
+
+    listen();
+
+    return true;
+}
+
+bool PgEngine::isAsync() const
+{
+    return true;
+}
+
+bool PgEngine::isShared() const
+{
+    return true;
+}
+
+void PgEngine::exec(const QString &sql, const QVariantList &params, QObject *receiver, AResultFn cb)
+{
+    APool::database(pool).exec(sql, params, receiver, cb);
+}
+
+bool PgEngine::openBlocking()
+{
+    // One per engine, the test suite runs two on a thread
+    m_blockingName = QStringLiteral("cmlyst-pg-%1").arg(quintptr(this), 0, 16);
+    QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QPSQL"), m_blockingName);
+
+    const QUrl url(m_connection);
+    if (url.scheme() == QLatin1String("postgresql") || url.scheme() == QLatin1String("postgres")) {
+        // QPSQL wants the URI parts, the query has libpq keywords
+        db.setHostName(url.host());
+        db.setPort(url.port());
+        db.setUserName(url.userName());
+        db.setPassword(url.password());
+        db.setDatabaseName(url.path().mid(1));
+
+        QStringList options;
+        const QList<QPair<QString, QString> > items = QUrlQuery(url).queryItems(QUrl::FullyDecoded);
+        for (const auto &item : items) {
+            options.append(item.first + QLatin1Char('=') + item.second);
+        }
+        db.setConnectOptions(options.join(QLatin1Char(';')));
+    } else {
+        // The keyword form is passed on to libpq as it is
+        db.setConnectOptions(m_connection);
+    }
+
+    if (!db.open()) {
+        qCCritical(CMS_PGENGINE) << "Failed to open the blocking connection" << db.lastError().databaseText();
+        return false;
+    }
+    return true;
+}
+
+QSqlDatabase PgEngine::blockingDatabase() const
+{
+    QSqlDatabase db = QSqlDatabase::database(m_blockingName, false);
+    if (!db.isOpen() && !db.open()) {
+        qCWarning(CMS_PGENGINE) << "Failed to reopen the blocking connection" << db.lastError().databaseText();
+    }
+    return db;
+}
+
+PgEngine::SyncResult PgEngine::execSync(const QString &sql, const QVariantList &params)
+{
+    SyncResult ret;
+
+    QSqlDatabase db = blockingDatabase();
+    if (!db.isOpen()) {
+        ret.failed = true;
+        ret.errorText = db.lastError().databaseText();
+        return ret;
+    }
+
+    QSqlQuery query(db);
+    bool ok;
+    if (params.isEmpty()) {
+        // Also runs the schema statements that can't be prepared
+        ok = query.exec(sql);
+    } else {
+        ok = query.prepare(sql);
+        if (ok) {
+            for (const QVariant &param : params) {
+                query.addBindValue(param);
+            }
+            ok = query.exec();
+        }
+    }
+
+    if (!ok) {
+        const QSqlError error = query.lastError();
+        ret.failed = true;
+        ret.errorText = error.databaseText().isEmpty() ? error.text() : error.databaseText();
+        qCWarning(CMS_PGENGINE) << "Query failed" << sql << ret.errorText;
+        if (error.type() == QSqlError::ConnectionError) {
+            // Opened again on the next call
+            db.close();
+        }
+        return ret;
+    }
+
+    ret.rowsAffected = query.numRowsAffected();
+    const int columns = query.record().count();
+    while (query.next()) {
+        SyncRow row;
+        row.values.reserve(columns);
+        for (int i = 0; i < columns; ++i) {
+            row.values.append(query.value(i));
+        }
+        ret.rows.append(row);
+    }
+    return ret;
+}
+
+bool PgEngine::transaction(QList<Statement> statements, const QString &changed)
+{
+    statements.append(touchSettings());
+    statements.append({ QStringLiteral("SELECT pg_notify($1, $2)"), { channel, changed } });
+
+    QSqlDatabase db = blockingDatabase();
+    if (!db.transaction()) {
+        qCWarning(CMS_PGENGINE) << "Failed to begin transaction" << db.lastError().databaseText();
+        return false;
+    }
+
+    bool ok = true;
+    for (const Statement &statement : statements) {
+        SyncResult result = execSync(statement.sql, statement.params);
+        if (result.error()) {
+            ok = false;
+            break;
+        }
+        if (statement.result) {
+            *statement.result = result;
+        }
+    }
+
+    if (!ok || !db.commit()) {
+        db.rollback();
+        return false;
+    }
+
+    // Other nodes reload when notified, we do it right
+    // away so this request already sees the change
+    reload(QStringLiteral("settings"));
+    if (changed != QLatin1String("settings")) {
+        reload(changed);
+    }
+    return true;
+}
+
+PgEngine::Statement PgEngine::touchSettings() const
+{
+    const qint64 currentDateTime = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() / 1000;
+    return {
+        QStringLiteral("INSERT INTO settings (key, value) VALUES ('modified', $1) "
+                       "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value"),
+        { QString::number(currentDateTime) }
+    };
+}
+
+void PgEngine::listen()
+{
+    m_listener = ADatabase(APg::factory(m_connection));
+    m_listener.onStateChanged(this, [this] (ADatabase::State state, const QString &status) {
+        if (state != ADatabase::State::Disconnected) {
+            return;
+        }
+
+        // Changes made while we were away were not notified
+        qCWarning(CMS_PGENGINE) << "Lost the notifications connection" << status;
+        QTimer::singleShot(1000, this, [this] {
+            listen();
+            reload(QStringLiteral("settings"));
+            reload(QStringLiteral("menus"));
+            reload(QStringLiteral("users"));
+        });
+    });
+
+    m_listener.open(this, [this] (bool isOpen, const QString &error) {
+        if (!isOpen) {
+            qCWarning(CMS_PGENGINE) << "Failed to open the notifications connection" << error;
+            return;
+        }
+
+        m_listener.subscribeToNotification(channel, this, [this] (const ADatabaseNotification &notification) {
+            if (notification.self) {
+                return;
+            }
+
+            const QString changed = notification.payload.toString();
+            if (changed != QLatin1String("settings")) {
+                reload(changed);
+            }
+            reload(QStringLiteral("settings"));
+        });
+    });
+}
+
+void PgEngine::reload(const QString &changed)
+{
+    ++m_contentVersion;
+    if (changed == QLatin1String("settings")) {
+        applySettings(execSync(QStringLiteral("SELECT key, value FROM settings")));
+    } else if (changed == QLatin1String("menus")) {
+        applyMenus(execSync(QStringLiteral("SELECT m.id, m.name, m.locations, m.auto_add_pages, m.version,"
+                                           " e.text, e.url, e.attr "
+                                           "FROM menus m "
+                                           "LEFT JOIN menu_entries e ON e.menu_id = m.id "
+                                           "ORDER BY m.id, e.position")));
+    } else if (changed == QLatin1String("users")) {
+        applyUsers(execSync(QStringLiteral("SELECT id, slug, email, json, version FROM users")));
+    }
+}
+
+void PgEngine::applySettings(const SyncResult &result)
+{
+    if (result.error()) {
+        return;
+    }
+
+    QHash<QString, QString> settings;
+    for (const SyncRow &row : result) {
+        settings.insert(row.value(0).toString(), row.value(1).toString());
+    }
+    m_settings = settings;
+    Metrics::increment("cmlyst_settings_reloads_total");
+
+    const qint64 modified = m_settings.value(QStringLiteral("modified")).toLongLong();
+    m_settingsDateTime = QDateTime::fromMSecsSinceEpoch(modified * 1000);
+
+    const QString tz = m_settings.value(QStringLiteral("timezone"));
+    m_timezone = tz.isEmpty() ? QTimeZone() : QTimeZone(tz.toUtf8());
+    if (!m_timezone.isValid()) {
+        m_timezone = QTimeZone::systemTimeZone();
+    }
+
+    configureView();
+}
+
+void PgEngine::applyMenus(const SyncResult &result)
+{
+    if (result.error()) {
+        return;
+    }
+
+    QHash<QString, CMS::Menu *> current;
+    for (CMS::Menu *menu : m_menus) {
+        current.insert(menu->id(), menu);
+    }
+
+    // One row per entry, menus without entries have a NULL one
+    QList<CMS::Menu *> menus;
+    QList<QVariantHash> entries;
+    CMS::Menu *menu = nullptr;
+    for (const SyncRow &row : result) {
+        const QString id = row.value(0).toString();
+        if (!menu || menu->id() != id) {
+            if (menu) {
+                menu->setEntries(entries);
+                entries.clear();
+            }
+
+            menu = current.take(id);
+            if (!menu) {
+                menu = new Menu(id, this);
+            }
+            menu->setName(row.value(1).toString());
+
+            QStringList locations;
+            const QJsonArray locationsJson = QJsonDocument::fromJson(row.value(2).toString().toUtf8()).array();
+            for (const QJsonValue &location : locationsJson) {
+                locations.append(location.toString());
+            }
+            menu->setLocations(locations);
+            menu->setAutoAddPages(row.value(3).toBool());
+            menu->setVersion(row.value(4).toInt());
+            menus.push_back(menu);
+        }
+
+        if (!row.value(5).isNull()) {
+            entries.append({
+                               {QStringLiteral("text"), row.value(5).toString()},
+                               {QStringLiteral("url"), row.value(6).toString()},
+                               {QStringLiteral("attr"), row.value(7).toString()}
+                           });
+        }
+    }
+    if (menu) {
+        menu->setEntries(entries);
+    }
+
+    // What is left was removed
+    qDeleteAll(current);
+
+    QHash<QString, CMS::Menu *> menuLocations;
+    for (CMS::Menu *menu : menus) {
+        const QStringList locations = menu->locations();
+        for (const QString &location : locations) {
+            if (!menuLocations.contains(location)) {
+                menuLocations.insert(location, menu);
+            }
+        }
+    }
+
+    m_menus = menus;
+    m_menuLocations = menuLocations;
+}
+
+void PgEngine::applyUsers(const SyncResult &result)
+{
+    if (result.error()) {
+        return;
+    }
+
+    static const QStringList fields = {
+        QStringLiteral("name"),
+        QStringLiteral("bio"),
+        QStringLiteral("location"),
+        QStringLiteral("website"),
+        QStringLiteral("twitter"),
+        QStringLiteral("facebook"),
+        QStringLiteral("image"),
+        QStringLiteral("cover"),
+        QStringLiteral("url"),
+    };
+
+    m_users.clear();
+    m_usersSlug.clear();
+    m_usersId.clear();
+    for (const SyncRow &row : result) {
+        QHash<QString, QString> user;
+
+        const QString id = row.value(0).toString();
+        user.insert(QStringLiteral("id"), id);
+        const QString slug = row.value(1).toString();
+        user.insert(QStringLiteral("slug"), slug);
+        user.insert(QStringLiteral("email"), row.value(2).toString());
+        user.insert(QStringLiteral("version"), row.value(4).toString());
+
+        const QJsonObject obj = QJsonDocument::fromJson(row.value(3).toString().toUtf8()).object();
+        for (const QString &field : fields) {
+            user.insert(field, obj.value(field).toString());
+        }
+
+        m_usersSlug.insert(slug, id.toInt());
+        m_usersId.insert(id.toInt(), user);
+        m_users.push_back(QVariant::fromValue(user));
+    }
+}
+
+template <typename Result>
+QList<Page *> PgEngine::createPages(Result &result, QObject *parent, bool summary)
+{
+    QList<Page *> ret;
+    if (result.error()) {
+        qCWarning(CMS_PGENGINE) << "Failed to list pages" << result.errorString();
+        return ret;
+    }
+
+    for (auto row : result) {
+        auto page = new Page(parent);
+        page->setId(row.value(0).toInt());
+        page->setUuid(row.value(1).toString());
+        page->setPath(row.value(2).toString());
+        page->setTitle(row.value(3).toString());
+        page->setAuthor(user(row.value(4).toInt()));
+        if (!summary) {
+            page->setContent(row.value(5).toString(), true);
+        }
+        page->setCreated(dateTimeValue(row.value(6)));
+        page->setUpdated(dateTimeValue(row.value(7)));
+        page->setPublishedAt(dateTimeValue(row.value(8)));
+        page->setPage(row.value(9).toBool());
+        page->setAllowComments(row.value(10).toBool());
+        page->setPublished(row.value(11).toBool());
+        ret.append(page);
+    }
+    return ret;
+}
+
+QDateTime PgEngine::dateTimeValue(const QVariant &value) const
+{
+    QDateTime ret = value.type() == QVariant::String ?
+                QDateTime::fromString(value.toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss")) : value.toDateTime();
+    ret.setTimeSpec(Qt::UTC);
+    ret = ret.toTimeZone(m_timezone);
+    ret.setTimeSpec(Qt::LocalTime);
+    return ret;
+}
+
+QString PgEngine::pagesWhere(Filters filters, int authorId) const
+{
+    QStringList where;
+    if (filters.testFlag(Pages) && !filters.testFlag(Posts)) {
+        where.append(QStringLiteral("page"));
+    } else if (filters.testFlag(Posts) && !filters.testFlag(Pages)) {
+        where.append(QStringLiteral("NOT page"));
+    }
+
+    if (filters.testFlag(OnlyPublished)) {
+        where.append(QStringLiteral("published"));
+    } else if (filters.testFlag(OnlyDrafts)) {
+        where.append(QStringLiteral("NOT published"));
+    }
+
+    // Always the first parameter
+    if (authorId > 0) {
+        where.append(QStringLiteral("author_id = $1"));
+    }
+
+    if (where.isEmpty()) {
+        return QString();
+    }
+    return QLatin1String("WHERE ") + where.join(QLatin1String(" AND ")) + QLatin1Char(' ');
+}
+
+Page *PgEngine::getPage(const QString &path, QObject *parent)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + publicColumns + QLatin1String("FROM posts WHERE path = $1"),
+                                 { path.isNull() ? QStringLiteral("") : path });
+    const QList<Page *> pages = createPages(result, parent, false);
+    return pages.value(0);
+}
+
+void PgEngine::getPageAsync(const QString &path, QObject *parent, PageCallback cb)
+{
+    exec(QLatin1String("SELECT ") + publicColumns + QLatin1String("FROM posts WHERE path = $1"),
+         { path.isNull() ? QStringLiteral("") : path },
+         parent,
+         [this, parent, cb] (AResult &result) {
+        const QList<Page *> pages = createPages(result, parent, false);
+        cb(pages.value(0));
+    });
+}
+
+Page *PgEngine::getPageById(const QString &id, QObject *parent)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + pageColumns + QLatin1String("FROM posts WHERE id = $1"),
+                                 { id.toInt() });
+    const QList<Page *> pages = createPages(result, parent, false);
+    if (pages.isEmpty()) {
+        qWarning() << "Page not found for id" << id;
+    }
+    return pages.value(0);
+}
+
+bool PgEngine::removePage(int id)
+{
+    SyncResult result = execSync(QStringLiteral("DELETE FROM posts WHERE id = $1"), { id });
+    if (!result.error() && result.numRowsAffected() == 1) {
+        Q_EMIT pagesChanged();
+        return true;
+    }
+    qWarning() << "Failed to remove page" << id << result.errorString();
+    return false;
+}
+
+QList<Page *> PgEngine::listPages(QObject *parent, int offset, int limit)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + pageColumns +
+                                 QLatin1String("FROM posts "
+                                               "WHERE page "
+                                               "ORDER BY created_at DESC "
+                                               "LIMIT $1 OFFSET $2"),
+                                 { limit, offset });
+    return createPages(result, parent, false);
+}
+
+QList<Page *> PgEngine::listPagesPublished(QObject *parent, int offset, int limit)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + publicColumns +
+                                 QLatin1String("FROM posts "
+                                               "WHERE page AND published "
+                                               "ORDER BY created_at DESC "
+                                               "LIMIT $1 OFFSET $2"),
+                                 { limit, offset });
+    return createPages(result, parent, false);
+}
+
+QList<Page *> PgEngine::listPosts(QObject *parent, int offset, int limit)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + pageColumns +
+                                 QLatin1String("FROM posts "
+                                               "WHERE NOT page "
+                                               "ORDER BY created_at DESC "
+                                               "LIMIT $1 OFFSET $2"),
+                                 { limit, offset });
+    return createPages(result, parent, false);
+}
+
+QList<Page *> PgEngine::listPostsPublished(QObject *parent, int offset, int limit)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + publicColumns +
+                                 QLatin1String("FROM posts "
+                                               "WHERE NOT page AND published "
+                                               "ORDER BY published_at DESC "
+                                               "LIMIT $1 OFFSET $2"),
+                                 { limit, offset });
+    return createPages(result, parent, false);
+}
+
+QList<Page *> PgEngine::listAuthorPostsPublished(QObject *parent, int authorId, int offset, int limit)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + publicColumns +
+                                 QLatin1String("FROM posts "
+                                               "WHERE NOT page AND published AND author_id = $1 "
+                                               "ORDER BY created_at DESC "
+                                               "LIMIT $2 OFFSET $3"),
+                                 { authorId, limit, offset });
+    return createPages(result, parent, false);
+}
+
+void PgEngine::listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb)
+{
+    auto done = [this, parent, cb] (AResult &result) {
+        cb(createPages(result, parent, false));
+    };
+
+    if (authorId > 0) {
+        exec(QLatin1String("SELECT ") + publicColumns +
+             QLatin1String("FROM posts "
+                           "WHERE NOT page AND published AND author_id = $1 "
+                           "ORDER BY created_at DESC "
+                           "LIMIT $2 OFFSET $3"),
+             { authorId, limit, offset }, parent, done);
+    } else {
+        exec(QLatin1String("SELECT ") + publicColumns +
+             QLatin1String("FROM posts "
+                           "WHERE NOT page AND published "
+                           "ORDER BY published_at DESC "
+                           "LIMIT $1 OFFSET $2"),
+             { limit, offset }, parent, done);
+    }
+}
+
+QList<Page *> PgEngine::listPagesSummary(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit)
+{
+    QVariantList params;
+    SyncResult result = execSync(summaryQuery(filters, authorId, sort, order, offset, limit, &params), params);
+    return createPages(result, parent, true);
+}
+
+void PgEngine::listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb)
+{
+    QVariantList params;
+    const QString sql = summaryQuery(filters, authorId, sort, order, offset, limit, &params);
+    exec(sql, params, parent, [this, parent, cb] (AResult &result) {
+        cb(createPages(result, parent, true));
+    });
+}
+
+QString PgEngine::summaryQuery(Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, QVariantList *params) const
+{
+    QString orderBy;
+    switch (sort) {
+    case SortUpdated:
+        orderBy = QStringLiteral("updated_at");
+        break;
+    case SortPublished:
+        orderBy = QStringLiteral("published_at");
+        break;
+    case SortTitle:
+        orderBy = QStringLiteral("title");
+        break;
+    default:
+        orderBy = QStringLiteral("created_at");
+    }
+
+    if (order == Qt::DescendingOrder) {
+        orderBy.append(QLatin1String(" DESC"));
+    }
+
+    if (authorId > 0) {
+        params->append(authorId);
+    }
+    params->append(limit);
+    params->append(offset);
+
+    return QLatin1String("SELECT ") + summaryColumns + QLatin1String("FROM posts ")
+            + pagesWhere(filters, authorId)
+            + QLatin1String("ORDER BY ") + orderBy
+            + QLatin1String(" LIMIT $") + QString::number(params->size() - 1)
+            + QLatin1String(" OFFSET $") + QString::number(params->size());
+}
+
+int PgEngine::countPages(Filters filters, int authorId)
+{
+    QVariantList params;
+    if (authorId > 0) {
+        params.append(authorId);
+    }
+
+    SyncResult result = execSync(QLatin1String("SELECT count(*) FROM posts ") + pagesWhere(filters, authorId), params);
+    if (!result.error() && result.size()) {
+        return result[0].value(0).toInt();
+    }
+    return 0;
+}
+
+void PgEngine::countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb)
+{
+    QVariantList params;
+    if (authorId > 0) {
+        params.append(authorId);
+    }
+
+    exec(QLatin1String("SELECT count(*) FROM posts ") + pagesWhere(filters, authorId), params, receiver,
+         [cb] (AResult &result) {
+        if (result.error() || !result.size()) {
+            qCWarning(CMS_PGENGINE) << "Failed to count pages" << result.errorString();
+            cb(-1);
+        } else {
+            cb(result[0].value(0).toInt());
+        }
+    });
+}
+
+QHash<QString, QString> PgEngine::settings() const
+{
+    return m_settings;
+}
+
+QString PgEngine::settingsValue(const QString &key, const QString &defaultValue) const
+{
+    return m_settings.value(key, defaultValue);
+}
+
+bool PgEngine::setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value)
+{
+    return setSettingsValues(c, {
+                                 {key, value}
+                             });
+}
+
+bool PgEngine::setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values)
+{
+    Q_UNUSED(c)
+
+    QList<Statement> statements;
+    bool menus = false;
+    auto it = values.constBegin();
+    while (it != values.constEnd()) {
+        if (it.key() == QLatin1String("menus")) {
+            // Imported data may still have menus in the old format
+            statements.append(importMenus(it.value()));
+            menus = true;
+        } else if (it.key() != QLatin1String("modified")) {
+            statements.append({
+                                  QStringLiteral("INSERT INTO settings (key, value) VALUES ($1, $2) "
+                                                 "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value"),
+                                  { it.key(), it.value() }
+                              });
+        }
+        ++it;
+    }
+
+    return transaction(statements, menus ? QStringLiteral("menus") : QStringLiteral("settings"));
+}
+
+QList<Menu *> PgEngine::menus()
+{
+    return m_menus;
+}
+
+bool PgEngine::saveMenu(Cutelyst::Context *c, Menu *menu, bool replace)
+{
+    Q_UNUSED(c)
+    return transaction(writeMenu(menu, replace), QStringLiteral("menus"));
+}
+
+bool PgEngine::removeMenu(Cutelyst::Context *c, const QString &name)
+{
+    Q_UNUSED(c)
+    return transaction({
+                           { QStringLiteral("DELETE FROM menu_entries WHERE menu_id = $1"), { name } },
+                           { QStringLiteral("DELETE FROM menus WHERE id = $1"), { name } },
+                       }, QStringLiteral("menus"));
+}
+
+bool PgEngine::addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url)
+{
+    Q_UNUSED(c)
+
+    // Only the new row is written, the others are left untouched
+    return transaction({
+                           {
+                               QStringLiteral("INSERT INTO menu_entries "
+                                              "(menu_id, position, text, url, attr) "
+                                              "SELECT $1, COALESCE(MAX(position), -1) + 1, $2, $3, '' "
+                                              "FROM menu_entries WHERE menu_id = $1"),
+                               { menu->id(), text, url }
+                           },
+                           { QStringLiteral("UPDATE menus SET version = version + 1 WHERE id = $1"), { menu->id() } },
+                       }, QStringLiteral("menus"));
+}
+
+QList<PgEngine::Statement> PgEngine::writeMenu(Menu *menu, bool replace) const
+{
+    const QString locations = QString::fromUtf8(QJsonDocument(QJsonArray::fromStringList(menu->locations()))
+                                                .toJson(QJsonDocument::Compact));
+
+    QList<Statement> ret;
+    if (replace) {
+        ret.append({
+                       QStringLiteral("INSERT INTO menus "
+                                      "(id, name, locations, auto_add_pages, version) "
+                                      "VALUES ($1, $2, $3, $4, 1) "
+                                      "ON CONFLICT (id) DO UPDATE SET "
+                                      "name = EXCLUDED.name, locations = EXCLUDED.locations, "
+                                      "auto_add_pages = EXCLUDED.auto_add_pages, version = menus.version + 1"),
+                       { menu->id(), menu->name(), locations, menu->autoAddPages() }
+                   });
+    } else {
+        ret.append({
+                       QStringLiteral("INSERT INTO menus "
+                                      "(id, name, locations, auto_add_pages, version) "
+                                      "VALUES ($1, $2, $3, $4, 1)"),
+                       { menu->id(), menu->name(), locations, menu->autoAddPages() }
+                   });
+    }
+
+    ret.append({ QStringLiteral("DELETE FROM menu_entries WHERE menu_id = $1"), { menu->id() } });
+
+    const QList<QVariantHash> entries = menu->entries();
+    for (int i = 0; i < entries.size(); ++i) {
+        const QVariantHash &entry = entries.at(i);
+        ret.append({
+                       QStringLiteral("INSERT INTO menu_entries "
+                                      "(menu_id, position, text, url, attr) "
+                                      "VALUES ($1, $2, $3, $4, $5)"),
+                       {
+                           menu->id(),
+                           i,
+                           entry.value(QStringLiteral("text")).toString(),
+                           entry.value(QStringLiteral("url")).toString(),
+                           entry.value(QStringLiteral("attr")).toString()
+                       }
+                   });
+    }
+
+    return ret;
+}
+
+QList<PgEngine::Statement> PgEngine::importMenus(const QString &json) const
+{
+    QList<Statement> ret;
+
+    // The format menus used to have when stored in settings
+    const QJsonObject menusObj = QJsonDocument::fromJson(json.toUtf8()).object();
+    auto it = menusObj.constBegin();
+    while (it != menusObj.constEnd()) {
+        const QJsonObject obj = it.value().toObject();
+
+        Menu menu(it.key());
+        menu.setName(obj.value(QStringLiteral("name")).toString());
+        menu.setAutoAddPages(obj.value(QStringLiteral("autoAddPages")).toBool());
+
+        QList<QVariantHash> entries;
+        const QJsonArray entriesJson = obj.value(QStringLiteral("entries")).toArray();
+        for (const QJsonValue &entry : entriesJson) {
+            entries.append(entry.toObject().toVariantHash());
+        }
+        menu.setEntries(entries);
+
+        QStringList locations;
+        const QJsonArray locationsJson = obj.value(QStringLiteral("locations")).toArray();
+        for (const QJsonValue &location : locationsJson) {
+            locations.append(location.toString());
+        }
+        menu.setLocations(locations);
+
+        ret.append(writeMenu(&menu, true));
+
+        ++it;
+    }
+
+    return ret;
+}
+
+QHash<QString, Menu *> PgEngine::menuLocations()
+{
+    return m_menuLocations;
+}
+
+bool PgEngine::settingsIsWritable() const
+{
+    return true;
+}
+
+QHash<QString, QString> PgEngine::loadSettings(Cutelyst::Context *c)
+{
+    Q_UNUSED(c)
+    Metrics::increment("cmlyst_cache_requests_total{cache=\"settings\",result=\"hit\"}");
+    return m_settings;
+}
+
+QDateTime PgEngine::lastModified()
+{
+    return m_settingsDateTime;
+}
+
+qint64 PgEngine::contentVersion(Cutelyst::Context *c)
+{
+    Q_UNUSED(c)
+    return m_contentVersion;
+}
+
+QString PgEngine::addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace)
+{
+    Q_UNUSED(c)
+
+    const QString name = user.value(QStringLiteral("name"));
+    QString slug = name;
+    if (slug.isEmpty()) {
+        slug  = name.section(QLatin1Char(' '), 0, 0);
+    }
+    slug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
+    slug = slug.left(50).toLower().toHtmlEscaped();
+
+    QJsonObject obj;
+    obj.insert(QStringLiteral("name"),
+               name.left(150).toHtmlEscaped());
+
+    QString sql = QStringLiteral("INSERT INTO users "
+                                 "(slug, email, password, json) "
+                                 "VALUES "
+                                 "($1, $2, $3, $4)");
+    if (replace) {
+        sql.append(QLatin1String(" ON CONFLICT (email) DO UPDATE SET "
+                                 "slug = EXCLUDED.slug, password = EXCLUDED.password, "
+                                 "json = EXCLUDED.json, version = users.version + 1"));
+    }
+
+    const bool ok = transaction({
+                                    {
+                                        sql,
+                                        {
+                                            slug,
+                                            user.value(QStringLiteral("email")),
+                                            user.value(QStringLiteral("password")),
+                                            QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact))
+                                        }
+                                    }
+                                }, QStringLiteral("users"));
+    if (!ok) {
+        qDebug() << "Failed to add new user:" << user;
+        return QString();
+    }
+    return slug;
+}
+
+bool PgEngine::removeUser(Cutelyst::Context *c, int id)
+{
+    Q_UNUSED(c)
+
+    SyncResult result;
+    Statement statement = { QStringLiteral("DELETE FROM users WHERE id = $1"), { id } };
+    statement.result = &result;
+    return transaction({ statement }, QStringLiteral("users")) && result.numRowsAffected() == 1;
+}
+
+QString PgEngine::updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user)
+{
+    Q_UNUSED(c)
+
+    const int id = this->user(slug).value(QStringLiteral("id")).toInt();
+    if (!id) {
+        return QString();
+    }
+
+    QJsonObject obj;
+    obj.insert(QStringLiteral("location"),
+               user.value(QStringLiteral("location")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("facebook"),
+               user.value(QStringLiteral("facebook")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("twitter"),
+               user.value(QStringLiteral("twitter")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("website"),
+               user.value(QStringLiteral("website")).left(100).toHtmlEscaped());
+    const QString name = user.value(QStringLiteral("name"));
+    obj.insert(QStringLiteral("name"),
+               name.left(150).toHtmlEscaped());
+    obj.insert(QStringLiteral("bio"),
+               user.value(QStringLiteral("bio")).left(200).toHtmlEscaped());
+
+    QString newSlug = user.value(QStringLiteral("slug"));
+    if (newSlug.isEmpty()) {
+        newSlug  = name.section(QLatin1Char(' '), 0, 0);
+    }
+    newSlug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
+    newSlug = newSlug.left(50).toLower().toHtmlEscaped();
+
+    const bool ok = transaction({
+                                    {
+                                        QStringLiteral("UPDATE users SET slug = $1, email = $2, json = $3 WHERE id = $4"),
+                                        {
+                                            newSlug,
+                                            user.value(QStringLiteral("email")).left(200).toHtmlEscaped(),
+                                            QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)),
+                                            id
+                                        }
+                                    }
+                                }, QStringLiteral("users"));
+    if (!ok) {
+        qWarning() << "Failed to update user:" << id;
+        return QString();
+    }
+    return newSlug;
+}
+
+bool PgEngine::invalidateUser(Cutelyst::Context *c, int id)
+{
+    Q_UNUSED(c)
+    Q_UNUSED(id)
+    return transaction({}, QStringLiteral("users"));
+}
+
+QVariantList PgEngine::users()
+{
+    return m_users;
+}
+
+QHash<QString, QString> PgEngine::user(const QString &slug)
+{
+    auto it = m_usersSlug.constFind(slug);
+    if (it != m_usersSlug.constEnd()) {
+        return m_usersId.value(it.value());
+    }
+    return QHash<QString, QString>();
+}
+
+QHash<QString, QString> PgEngine::user(int id)
+{
+    return m_usersId.value(id);
+}
+
+QHash<QString, QString> PgEngine::credentials(const QString &email)
+{
+    SyncResult result = execSync(QStringLiteral("SELECT id, email, password, version FROM users WHERE email = $1"),
+                                 { email });
+    if (result.error() || !result.size()) {
+        return QHash<QString, QString>();
+    }
+
+    const SyncRow row = result[0];
+    return {
+        {QStringLiteral("id"), row.value(0).toString()},
+        {QStringLiteral("email"), row.value(1).toString()},
+        {QStringLiteral("password"), row.value(2).toString()},
+        {QStringLiteral("version"), row.value(3).toString()},
+    };
+}
+
+bool PgEngine::setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash)
+{
+    Q_UNUSED(c)
+
+    SyncResult result;
+    Statement statement = {
+        QStringLiteral("UPDATE users SET password = $1, version = version + 1 "
+                       "WHERE id = $2 AND password = $3"),
+        { newHash, id, oldHash }
+    };
+    statement.result = &result;
+    return transaction({ statement }, QStringLiteral("users")) && result.numRowsAffected() == 1;
+}
+
+bool PgEngine::addMedia(const QVariantHash &media)
+{
+    const QVariantList variants = media.value(QStringLiteral("variants")).toList();
+    QDateTime uploaded = media.value(QStringLiteral("uploaded_at")).toDateTime();
+    if (!uploaded.isValid()) {
+        uploaded = QDateTime::currentDateTimeUtc();
+    }
+
+    SyncResult result = execSync(QStringLiteral("INSERT INTO media "
+                                                "(path, name, size, mime, width, height, hash, variants, uploaded_at) "
+                                                "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9::timestamp) "
+                                                "ON CONFLICT (path) DO UPDATE SET "
+                                                "name = EXCLUDED.name, size = EXCLUDED.size, mime = EXCLUDED.mime, "
+                                                "width = EXCLUDED.width, height = EXCLUDED.height, hash = EXCLUDED.hash, "
+                                                "variants = EXCLUDED.variants, uploaded_at = EXCLUDED.uploaded_at"),
+                                 {
+                                     media.value(QStringLiteral("path")),
+                                     media.value(QStringLiteral("name")),
+                                     media.value(QStringLiteral("size")),
+                                     media.value(QStringLiteral("mime")),
+                                     media.value(QStringLiteral("width")),
+                                     media.value(QStringLiteral("height")),
+                                     media.value(QStringLiteral("hash")),
+                                     variants.isEmpty() ? QVariant(QVariant::String) :
+                                     QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(variants)).toJson(QJsonDocument::Compact)),
+                                     uploaded.toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss"))
+                                 });
+    if (result.error()) {
+        qWarning() << "Failed to add media" << media.value(QStringLiteral("path")) << result.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool PgEngine::removeMedia(const QString &path)
+{
+    SyncResult result = execSync(QStringLiteral("DELETE FROM media WHERE path = $1"), { path });
+    if (!result.error() && result.numRowsAffected() == 1) {
+        return true;
+    }
+    qWarning() << "Failed to remove media" << path << result.errorString();
+    return false;
+}
+
+QVariantHash PgEngine::media(const QString &path)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + mediaColumns + QLatin1String("FROM media WHERE path = $1"),
+                                 { path });
+    if (!result.error() && result.size()) {
+        return createMediaHash(result[0]);
+    }
+    return QVariantHash();
+}
+
+QVariantHash PgEngine::mediaByHash(const QString &hash)
+{
+    SyncResult result = execSync(QLatin1String("SELECT ") + mediaColumns + QLatin1String("FROM media WHERE hash = $1 LIMIT 1"),
+                                 { hash });
+    if (!result.error() && result.size()) {
+        return createMediaHash(result[0]);
+    }
+    return QVariantHash();
+}
+
+bool PgEngine::setMediaVariants(const QString &hash, const QVariantList &variants)
+{
+    SyncResult result = execSync(QStringLiteral("UPDATE media SET variants = $1 WHERE hash = $2"),
+                                 {
+                                     QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(variants)).toJson(QJsonDocument::Compact)),
+                                     hash
+                                 });
+    return !result.error();
+}
+
+void PgEngine::updateMediaHtml(const QString &hash)
+{
+    SyncResult result = execSync(QStringLiteral("SELECT DISTINCT p.id, p.content FROM media m "
+                                                "JOIN media_refs r ON r.path = m.path "
+                                                "JOIN posts p ON p.id = r.post_id "
+                                                "WHERE m.hash = $1"),
+                                 { hash });
+    if (result.error() || !result.size()) {
+        return;
+    }
+
+    QList<Statement> statements;
+    for (const SyncRow &row : result) {
+        statements.append({
+                              QStringLiteral("UPDATE posts SET html = $1 WHERE id = $2"),
+                              {
+                                  Media::addSrcset(this, row.value(1).toString(), QStringLiteral("/.media/")),
+                                  row.value(0).toInt()
+                              }
+                          });
+    }
+
+    if (transaction(statements, QStringLiteral("pages"))) {
+        Q_EMIT pagesChanged();
+    }
+}
+
+QVariantList PgEngine::listMedia(int offset, int limit)
+{
+    QVariantList ret;
+    SyncResult result = execSync(QLatin1String("SELECT ") + mediaColumns +
+                                 QLatin1String("FROM media "
+                                               "ORDER BY uploaded_at DESC "
+                                               "LIMIT $1 OFFSET $2"),
+                                 { limit, offset });
+    if (!result.error()) {
+        for (const SyncRow &row : result) {
+            ret.push_back(createMediaHash(row));
+        }
+    }
+    return ret;
+}
+
+int PgEngine::countMedia()
+{
+    SyncResult result = execSync(QStringLiteral("SELECT count(*) FROM media"));
+    if (!result.error() && result.size()) {
+        return result[0].value(0).toInt();
+    }
+    return 0;
+}
+
+QVariantHash PgEngine::createMediaHash(const SyncRow &row) const
+{
+    return {
+        {QStringLiteral("id"), row.value(0)},
+        {QStringLiteral("path"), row.value(1)},
+        {QStringLiteral("name"), row.value(2)},
+        {QStringLiteral("size"), row.value(3)},
+        {QStringLiteral("mime"), row.value(4)},
+        {QStringLiteral("width"), row.value(5)},
+        {QStringLiteral("height"), row.value(6)},
+        {QStringLiteral("hash"), row.value(7)},
+        {QStringLiteral("uploaded_at"), utcValue(row.value(8))},
+        {QStringLiteral("variants"), QJsonDocument::fromJson(row.value(9).toString().toUtf8()).array().toVariantList()},
+    };
+}
+
+int PgEngine::savePageBackend(Page *page)
+{
+    QString sql;
+    QVariantList params = {
+        page->path(),
+        page->title(),
+        page->author().value(QStringLiteral("id")).toInt(),
+        page->content().get(),
+        Media::addSrcset(this, page->content().get(), QStringLiteral("/.media/")),
+        page->created().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")),
+        page->updated().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")),
+        page->publishedAt().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")),
+        page->page(),
+        page->published(),
+        page->allowComments(),
+    };
+
+    if (!page->id()) {
+        sql = QStringLiteral("INSERT INTO posts "
+                             "(path, title, author_id, content, html,"
+                             " created_at, updated_at, published_at, page, published, allow_comments, uuid) "
+                             "VALUES "
+                             "($1, $2, $3, $4, $5, $6::timestamp, $7::timestamp, $8::timestamp, $9, $10, $11, $12) "
+                             "RETURNING id");
+        params.append(page->uuid());
+    } else {
+        sql = QStringLiteral("UPDATE posts SET "
+                             "path = $1, title = $2, author_id = $3, content = $4, html = $5, "
+                             "created_at = $6::timestamp, updated_at = $7::timestamp, published_at = $8::timestamp, "
+                             "page = $9, published = $10, allow_comments = $11 "
+                             "WHERE id = $12 "
+                             "RETURNING id");
+        params.append(page->id());
+    }
+
+    QSqlDatabase db = blockingDatabase();
+    if (!db.transaction()) {
+        qCWarning(CMS_PGENGINE) << "Failed to begin transaction" << db.lastError().databaseText();
+        return 0;
+    }
+
+    SyncResult result = execSync(sql, params);
+    if (result.error() || !result.size()) {
+        qWarning() << "Failed to save page" << result.errorString();
+        db.rollback();
+        return 0;
+    }
+
+    const int id = result[0].value(0).toInt();
+    if (!writeMediaRefs(id, Media::references(page->content().get(), QStringLiteral("/.media/"))) || !db.commit()) {
+        db.rollback();
+        return 0;
+    }
+    return id;
+}
+
+void PgEngine::configureView()
+{
+    const QString theme = m_settings.value(QStringLiteral("theme"), QStringLiteral("default"));
+
+    auto app = qobject_cast<Cutelyst::Application *>(parent());
+    if (!app || m_theme == theme) {
+        return;
+    }
+    m_theme = theme;
+
+    auto view = qobject_cast<Cutelyst::CuteleeView*>(app->view());
+
+    const QDir themeDir = app->pathTo(QStringLiteral("root/themes"));
+
+    view->setIncludePaths({ themeDir.absoluteFilePath(theme) });
+
+    // Menus get the same tag libraries and settings as the other templates
+    setMenuTemplates(view->engine());
+}
+
+bool PgEngine::createDb()
+{
+    // Mirrors the SQLite schema, nodes racing on an empty
+    // database are fine as everything is IF NOT EXISTS
+    const QStringList statements = {
+        QStringLiteral("CREATE TABLE IF NOT EXISTS posts "
+                       "( id serial PRIMARY KEY "
+                       ", uuid text NOT NULL UNIQUE "
+                       ", path text NOT NULL UNIQUE "
+                       ", title text "
+                       ", content text "
+                       ", html text "
+                       ", language text "
+                       ", status text "
+                       ", meta_title text "
+                       ", meta_description text "
+                       ", page boolean NOT NULL "
+                       ", published boolean NOT NULL "
+                       ", allow_comments boolean NOT NULL "
+                       ", author_id integer "
+                       ", created_at timestamp NOT NULL "
+                       ", created_by integer "
+                       ", updated_at timestamp "
+                       ", updated_by integer "
+                       ", published_at timestamp "
+                       ", published_by integer "
+                       ")"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS settings "
+                       "( key text PRIMARY KEY "
+                       ", value text "
+                       ")"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS users "
+                       "( id serial PRIMARY KEY "
+                       ", slug text NOT NULL UNIQUE "
+                       ", email text NOT NULL UNIQUE "
+                       ", password text NOT NULL "
+                       ", json text "
+                       ", version integer NOT NULL DEFAULT 1 "
+                       ")"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS media "
+                       "( id serial PRIMARY KEY "
+                       ", path text NOT NULL UNIQUE "
+                       ", name text NOT NULL "
+                       ", size bigint NOT NULL "
+                       ", mime text "
+                       ", width integer "
+                       ", height integer "
+                       ", hash text "
+                       ", uploaded_at timestamp NOT NULL "
+                       ", variants text "
+                       ")"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS menus "
+                       "( id text PRIMARY KEY "
+                       ", name text "
+                       ", locations text "
+                       ", auto_add_pages boolean NOT NULL DEFAULT false "
+                       ", version integer NOT NULL DEFAULT 1 "
+                       ")"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS menu_entries "
+                       "( menu_id text NOT NULL REFERENCES menus(id) ON DELETE CASCADE "
+                       ", position integer NOT NULL "
+                       ", text text "
+                       ", url text "
+                       ", attr text "
+                       ", PRIMARY KEY(menu_id, position) "
+                       ")"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_created_idx ON posts (page, created_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_updated_idx ON posts (page, updated_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_title_idx ON posts (page, title)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_published_idx ON posts (page, published, published_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_author_idx ON posts (author_id, page, published, created_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_uploaded_idx ON media (uploaded_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_hash_idx ON media (hash)"),
+        QStringLiteral("CREATE TABLE IF NOT EXISTS media_refs "
+                       "( path text NOT NULL "
+                       ", post_id integer NOT NULL REFERENCES posts(id) ON DELETE CASCADE "
+                       ", PRIMARY KEY(path, post_id) "
+                       ")"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_refs_post_idx ON media_refs (post_id)"),
+        QStringLiteral("INSERT INTO settings (key, value) VALUES ('modified', '0') ON CONFLICT DO NOTHING"),
+    };
+
+    SyncResult existing = execSync(QStringLiteral("SELECT to_regclass('media_refs') IS NOT NULL"));
+    const bool hasMediaRefs = !existing.error() && existing.size() && existing[0].value(0).toBool();
+
+    for (const QString &statement : statements) {
+        if (execSync(statement).error()) {
+            qCCritical(CMS_PGENGINE) << "Error creating database" << m_connection;
+            return false;
+        }
+    }
+
+    // Which media each post shows, filled from the existing posts once
+    if (!hasMediaRefs) {
+        SyncResult posts = execSync(QStringLiteral("SELECT id, content FROM posts WHERE content LIKE '%/.media/%'"));
+        for (const SyncRow &row : posts) {
+            writeMediaRefs(row.value(0).toInt(), Media::references(row.value(1).toString(), QStringLiteral("/.media/")));
+        }
+    }
+    return true;
+}
+
+bool PgEngine::writeMediaRefs(int postId, const QStringList &paths)
+{
+    if (execSync(QStringLiteral("DELETE FROM media_refs WHERE post_id = $1"), { postId }).error()) {
+        return false;
+    }
+
+    for (const QString &path : paths) {
+        if (execSync(QStringLiteral("INSERT INTO media_refs (path, post_id) VALUES ($1, $2) ON CONFLICT DO NOTHING"),
+                     { path, postId }).error()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,220 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef PGENGINE_H
+#define PGENGINE_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QTimeZone>
+#include <QSqlDatabase>
+
+#include <adatabase.h>
+#include <aresult.h>
+
+#include "engine.h"
+
+namespace CMS {
+
+/**
+ * Keeps the content in PostgreSQL so several nodes can share it.
+ *
+ * Public pages are read with the *Async() methods, queries are
+ * pipelined on pooled connections and the worker keeps serving
+ * other requests meanwhile. Settings, menus and users are kept
+ * in memory and reloaded when another node NOTIFYs a change.
+ *
+ * The remaining synchronous methods, used by the admin pages,
+ * logins and the reloads, block on a connection of their own
+ * through Qt's QPSQL driver, so no other request is dispatched
+ * while they wait.
+ */
+class PgEngine : public Engine
+{
+    Q_OBJECT
+public:
+    explicit PgEngine(QObject *parent = 0);
+    ~PgEngine();
+
+    /**
+     * Needs the "connection" setting, a libpq URI
+     */
+    virtual bool init(const QHash<QString, QString> &settings) override;
+
+    virtual bool isAsync() const override;
+
+    virtual Page *getPage(const QString &path, QObject *parent) override;
+    virtual void getPageAsync(const QString &path, QObject *parent, PageCallback cb) override;
+
+    virtual Page *getPageById(const QString &id, QObject *parent) override;
+
+    virtual bool removePage(int id) override;
+
+    virtual QList<Page *> listPages(QObject *parent,
+                                    int offset,
+                                    int limit) override;
+
+    virtual QList<Page *> listPagesPublished(QObject *parent,
+                                             int offset,
+                                             int limit) override;
+
+    virtual QList<Page *> listPosts(QObject *parent,
+                                    int offset,
+                                    int limit) override;
+
+    virtual QList<Page *> listPostsPublished(QObject *parent,
+                                             int offset,
+                                             int limit) override;
+
+    virtual QList<Page *> listAuthorPostsPublished(QObject *parent,
+                                                   int authorId,
+                                                   int offset,
+                                                   int limit) override;
+
+    virtual void listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb) override;
+
+    virtual QList<Page *> listPagesSummary(QObject *parent,
+                                           Filters filters,
+                                           int authorId,
+                                           SortField sort,
+                                           Qt::SortOrder order,
+                                           int offset,
+                                           int limit) override;
+    virtual void listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb) override;
+
+    virtual int countPages(Filters filters, int authorId) override;
+    virtual void countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb) override;
+
+    virtual QHash<QString, QString> settings() const override;
+
+    virtual QString settingsValue(const QString &key, const QString &defaultValue = QString()) const override;
+    virtual bool setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value) override;
+    virtual bool setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values) override;
+
+    virtual QList<Menu *> menus() override;
+
+    virtual bool saveMenu(Cutelyst::Context *c, Menu *menu, bool replace) override;
+    virtual bool removeMenu(Cutelyst::Context *c, const QString &name) override;
+    virtual bool addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url) override;
+
+    virtual QHash<QString, Menu *> menuLocations() override;
+
+    virtual bool settingsIsWritable() const override;
+
+    /**
+     * Returns the cached settings, they are kept current
+     * by the notifications so nothing is queried here
+     */
+    QHash<QString, QString> loadSettings(Cutelyst::Context *c) override;
+
+    virtual QDateTime lastModified() override;
+
+    /**
+     * Counts the reloads, every local commit and
+     * notification from another node causes one
+     */
+    virtual qint64 contentVersion(Cutelyst::Context *c) override;
+
+    virtual QString addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace) override;
+    virtual bool removeUser(Cutelyst::Context *c, int id) override;
+    virtual QString updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user) override;
+    virtual bool invalidateUser(Cutelyst::Context *c, int id) override;
+    virtual QVariantList users() override;
+    virtual QHash<QString, QString> user(const QString &slug) override;
+    virtual QHash<QString, QString> user(int id) override;
+    virtual QHash<QString, QString> credentials(const QString &email) override;
+    virtual bool setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash) override;
+
+    virtual bool addMedia(const QVariantHash &media) override;
+    virtual bool removeMedia(const QString &path) override;
+    virtual QVariantHash media(const QString &path) override;
+    virtual QVariantHash mediaByHash(const QString &hash) override;
+    virtual bool setMediaVariants(const QString &hash, const QVariantList &variants) override;
+    virtual void updateMediaHtml(const QString &hash) override;
+    virtual QVariantList listMedia(int offset, int limit) override;
+    virtual int countMedia() override;
+
+    virtual bool isShared() const override;
+
+private:
+    class SyncRow;
+    class SyncResult;
+
+    struct Statement {
+        QString sql;
+        QVariantList params;
+        SyncResult *result = nullptr;
+    };
+
+    virtual int savePageBackend(Page *page) override;
+
+    void exec(const QString &sql, const QVariantList &params, QObject *receiver, ASql::AResultFn cb);
+    SyncResult execSync(const QString &sql, const QVariantList &params = QVariantList());
+    bool openBlocking();
+    QSqlDatabase blockingDatabase() const;
+
+    /**
+     * Runs \p statements in a single transaction, followed by
+     * a notification about \p changed to the other nodes
+     */
+    bool transaction(QList<Statement> statements, const QString &changed);
+
+    void listen();
+    void reload(const QString &changed);
+    void applySettings(const SyncResult &result);
+    void applyMenus(const SyncResult &result);
+    void applyUsers(const SyncResult &result);
+    QList<Statement> writeMenu(Menu *menu, bool replace) const;
+    QList<Statement> importMenus(const QString &json) const;
+    Statement touchSettings() const;
+    void configureView();
+    bool createDb();
+    /**
+     * Replaces the media references of \p postId, callers
+     * run it inside their transaction
+     */
+    bool writeMediaRefs(int postId, const QStringList &paths);
+    /**
+     * Reads pages from either an AResult or a SyncResult
+     */
+    template <typename Result>
+    QList<Page *> createPages(Result &result, QObject *parent, bool summary);
+    QVariantHash createMediaHash(const SyncRow &row) const;
+    QDateTime dateTimeValue(const QVariant &value) const;
+    QString pagesWhere(Filters filters, int authorId) const;
+    QString summaryQuery(Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, QVariantList *params) const;
+
+    QString m_connection;
+    QString m_blockingName;
+    ASql::ADatabase m_listener;
+    QString m_theme;
+    QVariantList m_users;
+    QHash<QString, int> m_usersSlug;
+    QHash<int, QHash<QString, QString> > m_usersId;
+    QHash<QString, QString> m_settings;
+    QDateTime m_settingsDateTime;
+    qint64 m_contentVersion = 0;
+    QTimeZone m_timezone;
+    QList<CMS::Menu *> m_menus;
+    QHash<QString, CMS::Menu *> m_menuLocations;
+};
+
+}
+
+#endif // PGENGINE_H
@@ -1,6 +1,10 @@
 #include "sqlengine.h"
 #include "page.h"
 #include "menu.h"
+#include "metrics.h"
+#include "sqltrace.h"
+#include "sqlwriter.h"
+#include "media.h"
 
 #include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
 #include <Cutelyst/Plugins/Utils/Sql>
@@ -12,6 +16,8 @@
 #include <QSqlQuery>
 #include <QSqlError>
 
+#include <QRunnable>
+#include <QPointer>
 #include <QRegularExpression>
 
 #include <QJsonArray>
@@ -20,73 +26,363 @@
 
 #include <QLoggingCategory>
 
+#include <memory>
+
 Q_LOGGING_CATEGORY(CMS_SQLENGINE, "cms.sqlengine")
 
 using namespace CMS;
 
-SqlEngine::SqlEngine(QObject *parent) : Engine(parent)
+namespace {
+
+class ReaderTask : public QRunnable
+{
+public:
+    explicit ReaderTask(const std::function<void ()> &task) : m_task(task) {}
+
+    void run() override
+    {
+        m_task();
+    }
+
+private:
+    std::function<void ()> m_task;
+};
+
+/**
+ * Opens this reader thread's connection the first time
+ */
+void openReader(const QString &dbPath, const SqlProfile &profile)
 {
+    const QString name = Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst"));
+    if (QSqlDatabase::contains(name)) {
+        return;
+    }
 
+    auto db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), name);
+    db.setDatabaseName(dbPath);
+    db.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
+    if (db.open()) {
+        profile.apply(db);
+    } else {
+        qCritical() << "Error opening reader database" << dbPath << db.lastError().databaseText();
+    }
 }
 
-bool SqlEngine::init(const QHash<QString, QString> &settings)
+QString databasePath(const QHash<QString, QString> &settings)
 {
     QString root = settings.value(QStringLiteral("root"));
     if (root.isEmpty()) {
         root = QDir::currentPath();
     }
+    return root + QLatin1String("/cmlyst.sqlite");
+}
 
-    const QString dbPath = root + QLatin1String("/cmlyst.sqlite");
-    bool create = !QFile::exists(dbPath);
-
-    if (QSqlDatabase::contains(QStringLiteral("cmlyst"))) {
-        return true;
+SqlProfile profileFromSettings(const QHash<QString, QString> &settings)
+{
+    QHash<QString, QString> pragmas;
+    const QStringList names = SqlProfile::names();
+    for (const QString &name : names) {
+        pragmas.insert(name, settings.value(name));
     }
+    return SqlProfile(pragmas);
+}
 
+/**
+ * Opens the main thread's connection, writes go through
+ * SqlWriter so this one only ever reads
+ */
+bool openDatabase(const QString &dbPath, const SqlProfile &profile)
+{
     auto db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst")));
     db.setDatabaseName(dbPath);
+    db.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
     if (db.open()) {
         qDebug() << "Database is open:" << dbPath << db.connectionName();
+        profile.apply(db);
+        return true;
+    }
+    qCritical() << "Error opening database" << dbPath << db.lastError().databaseText();
+    return false;
+}
+
+/**
+ * Creates the sessions table, runs on the writer
+ */
+void createSessionsTable()
+{
+    QSqlQuery query(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst"))));
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS sessions "
+                                   "( sid TEXT NOT NULL "
+                                   ", key TEXT NOT NULL "
+                                   ", value BLOB "
+                                   ", expires INTEGER "
+                                   ", PRIMARY KEY(sid, key) "
+                                   ")"))) {
+        qCritical() << "Error creating sessions table" << query.lastError().text();
+    }
+
+    if (!query.exec(QStringLiteral("CREATE INDEX IF NOT EXISTS sessions_expires_idx ON sessions (expires) WHERE key = 'expires'"))) {
+        qWarning() << "Failed to create sessions index" << query.lastError().databaseText();
+    }
+}
+
+// The fetch functions run on the calling thread, with its connection
+
+QVector<QSqlRecord> fetchPage(const QString &path)
+{
+    QVector<QSqlRecord> ret;
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, uuid, path, title, author_id, COALESCE(html, content) AS content,"
+                                                                  " created_at, updated_at, published_at, page, allow_comments, published "
+                                                                  "FROM posts "
+                                                                  "WHERE path = :path"),
+                                                   QStringLiteral("cmlyst"));
+    if (!path.isNull()) {
+        query.bindValue(QStringLiteral(":path"), path);
+    } else {
+        query.bindValue(QStringLiteral(":path"), QStringLiteral(""));
+    }
+
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        if (query.next()) {
+            ret.append(query.record());
+        }
+    } else {
+        qWarning() << "Failed to get page" << path << query.lastError().databaseText();
+    }
+    return ret;
+}
+
+QVector<QSqlRecord> fetchPostsPublished(int authorId, int offset, int limit)
+{
+    QVector<QSqlRecord> ret;
+    QSqlQuery query;
+    if (authorId > 0) {
+        query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("SELECT id, uuid, path, title, author_id, COALESCE(html, content) AS content,"
+                                   " created_at, updated_at, published_at, page, allow_comments, published "
+                                   "FROM posts "
+                                   "WHERE page = 0 AND published = 1 AND author_id = :author_id "
+                                   "ORDER BY created_at DESC "
+                                   "LIMIT :limit OFFSET :offset"
+                                   ),
+                    QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":author_id"), authorId);
+    } else {
+        query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("SELECT id, uuid, path, title, author_id, COALESCE(html, content) AS content,"
+                                   " created_at, updated_at, published_at, page, allow_comments, published "
+                                   "FROM posts "
+                                   "WHERE page = 0 AND published = 1 "
+                                   "ORDER BY published_at DESC "
+                                   "LIMIT :limit OFFSET :offset"
+                                   ),
+                    QStringLiteral("cmlyst"));
+    }
+
+    query.bindValue(QStringLiteral(":limit"), limit);
+    query.bindValue(QStringLiteral(":offset"), offset);
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        ret.reserve(limit);
+        while (query.next()) {
+            ret.append(query.record());
+        }
+    } else {
+        qWarning() << "Failed to list posts" << query.lastError().databaseText();
+    }
+    return ret;
+}
+
+QString pagesWhere(Engine::Filters filters, int authorId)
+{
+    QStringList where;
+    if (filters.testFlag(Engine::Pages) && !filters.testFlag(Engine::Posts)) {
+        where.append(QStringLiteral("page = 1"));
+    } else if (filters.testFlag(Engine::Posts) && !filters.testFlag(Engine::Pages)) {
+        where.append(QStringLiteral("page = 0"));
+    }
+
+    if (filters.testFlag(Engine::OnlyPublished)) {
+        where.append(QStringLiteral("published = 1"));
+    } else if (filters.testFlag(Engine::OnlyDrafts)) {
+        where.append(QStringLiteral("published = 0"));
+    }
+
+    if (authorId > 0) {
+        where.append(QStringLiteral("author_id = :author_id"));
+    }
+
+    if (where.isEmpty()) {
+        return QString();
+    }
+    return QLatin1String("WHERE ") + where.join(QLatin1String(" AND ")) + QLatin1Char(' ');
+}
+
+int fetchCount(Engine::Filters filters, int authorId)
+{
+    QSqlQuery query;
+    // Public listings count these on every request, the
+    // admin's filters make too many for one statement each
+    if (filters == (Engine::Posts | Engine::OnlyPublished)) {
+        if (authorId > 0) {
+            query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT count(*) FROM posts "
+                                                                "WHERE page = 0 AND published = 1 AND author_id = :author_id"),
+                                                 QStringLiteral("cmlyst"));
+        } else {
+            query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT count(*) FROM posts "
+                                                                "WHERE page = 0 AND published = 1"),
+                                                 QStringLiteral("cmlyst"));
+        }
+    } else {
+        query = Cutelyst::Sql::preparedQuery(QLatin1String("SELECT count(*) FROM posts ") + pagesWhere(filters, authorId),
+                                             Cutelyst::Sql::databaseThread(QStringLiteral("cmlyst")));
+    }
+
+    if (authorId > 0) {
+        query.bindValue(QStringLiteral(":author_id"), authorId);
+    }
+
+    if (Q_LIKELY(SqlTrace::exec(query) && query.next())) {
+        return query.value(0).toInt();
+    }
+    qWarning() << "Failed to count pages" << query.lastError().databaseText();
+    return -1;
+}
+
+QVector<QSqlRecord> fetchPagesSummary(Engine::Filters filters, int authorId, Engine::SortField sort, Qt::SortOrder order, int offset, int limit)
+{
+    QVector<QSqlRecord> ret;
+
+    QString orderBy;
+    switch (sort) {
+    case Engine::SortUpdated:
+        orderBy = QStringLiteral("updated_at");
+        break;
+    case Engine::SortPublished:
+        orderBy = QStringLiteral("published_at");
+        break;
+    case Engine::SortTitle:
+        orderBy = QStringLiteral("title");
+        break;
+    default:
+        orderBy = QStringLiteral("created_at");
+    }
+
+    if (order == Qt::DescendingOrder) {
+        orderBy.append(QLatin1String(" DESC"));
+    }
+
+    // Filters and sorting make too many statements
+    // for CPreparedSqlQueryThreadForDB, admin only
+    QSqlQuery query = Cutelyst::Sql::preparedQuery(QLatin1String("SELECT id, uuid, path, title, author_id,"
+                                                                 " created_at, updated_at, published_at, page, allow_comments, published "
+                                                                 "FROM posts ")
+                                                   + pagesWhere(filters, authorId)
+                                                   + QLatin1String("ORDER BY ") + orderBy
+                                                   + QLatin1String(" LIMIT :limit OFFSET :offset"),
+                                                   Cutelyst::Sql::databaseThread(QStringLiteral("cmlyst")));
+
+    if (authorId > 0) {
+        query.bindValue(QStringLiteral(":author_id"), authorId);
+    }
+    query.bindValue(QStringLiteral(":limit"), limit);
+    query.bindValue(QStringLiteral(":offset"), offset);
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        while (query.next()) {
+            ret.append(query.record());
+        }
+    } else {
+        qWarning() << "Failed to list pages" << query.lastError().databaseText();
+    }
+    return ret;
+}
+
+/**
+ * Media times are used for HTTP validators, so they stay in UTC
+ */
+QDateTime utcValue(const QVariant &value)
+{
+    QDateTime ret = QDateTime::fromString(value.toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+    ret.setTimeSpec(Qt::UTC);
+    return ret;
+}
+
+}
+
+SqlEngine::SqlEngine(QObject *parent) : Engine(parent)
+{
+
+}
+
+bool SqlEngine::init(const QHash<QString, QString> &settings)
+{
+    const QString dbPath = databasePath(settings);
+    bool create = !QFile::exists(dbPath);
+    m_dbPath = dbPath;
+
+    const int readerThreads = settings.value(QStringLiteral("readerThreads")).toInt();
+    if (readerThreads > 0 && !m_readers) {
+        m_readers = new QThreadPool(this);
+        m_readers->setMaxThreadCount(readerThreads);
+        // Each thread keeps its connection and prepared queries
+        m_readers->setExpiryTimeout(-1);
+    }
+
+    if (QSqlDatabase::contains(QStringLiteral("cmlyst"))) {
+        return true;
+    }
+
+    m_profile = profileFromSettings(settings);
+
+    if (!SqlWriter::start(dbPath, m_profile)) {
+        return false;
+    }
+
+    SqlWriter::exec([&] {
         if (create) {
             createDb();
             qDebug() << "Database tables created";
         }
-    } else {
-        qCritical() << "Error opening database" << dbPath << db.lastError().databaseText();
+        upgradeDb();
+    });
+
+    return openDatabase(dbPath, m_profile);
+}
+
+bool SqlEngine::initSessions(const QHash<QString, QString> &settings)
+{
+    if (QSqlDatabase::contains(QStringLiteral("cmlyst"))) {
+        return true;
+    }
+
+    const QString dbPath = databasePath(settings);
+    const SqlProfile profile = profileFromSettings(settings);
+    if (!SqlWriter::start(dbPath, profile)) {
         return false;
     }
 
-    return true;
+    SqlWriter::exec([] {
+        createSessionsTable();
+    });
+
+    return openDatabase(dbPath, profile);
 }
 
-Page *SqlEngine::createPageObj(const QSqlQuery &query, QObject *parent)
+Page *SqlEngine::createPageObj(const QSqlRecord &query, QObject *parent, bool content)
 {
     auto page = new Page(parent);
     page->setAllowComments(query.value(QStringLiteral("allow_comments")).toBool());
 
     int author_id = query.value(QStringLiteral("author_id")).toInt();
-    Author author = m_usersId.value(author_id);
+    Author author = user(author_id);
     page->setAuthor(author);
     page->setPage(query.value(QStringLiteral("page")).toBool());
-    page->setContent(query.value(QStringLiteral("content")).toString(), true);
-
-    QDateTime updated = QDateTime::fromString(query.value(QStringLiteral("updated_at")).toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
-    updated.setTimeSpec(Qt::UTC);
-    updated = updated.toTimeZone(m_timezone);
-    updated.setTimeSpec(Qt::LocalTime);
-    page->setUpdated(updated);
-
-    QDateTime created = QDateTime::fromString(query.value(QStringLiteral("created_at")).toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
-    created.setTimeSpec(Qt::UTC);
-    created = created.toTimeZone(m_timezone);
-    created.setTimeSpec(Qt::LocalTime);
-    page->setCreated(created);
-
-    QDateTime published = QDateTime::fromString(query.value(QStringLiteral("published_at")).toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
-    published.setTimeSpec(Qt::UTC);
-    published = published.toTimeZone(m_timezone);
-    published.setTimeSpec(Qt::LocalTime);
-    page->setPublishedAt(published);
+    if (content) {
+        page->setContent(query.value(QStringLiteral("content")).toString(), true);
+    }
+
+    page->setUpdated(dateTimeValue(query.value(QStringLiteral("updated_at"))));
+    page->setCreated(dateTimeValue(query.value(QStringLiteral("created_at"))));
+    page->setPublishedAt(dateTimeValue(query.value(QStringLiteral("published_at"))));
 
     page->setTitle(query.value(QStringLiteral("title")).toString());
     page->setPath(query.value(QStringLiteral("path")).toString());
@@ -97,27 +393,37 @@ Page *SqlEngine::createPageObj(const QSqlQuery &query, QObject *parent)
     return page;
 }
 
+QDateTime SqlEngine::dateTimeValue(const QVariant &value) const
+{
+    QDateTime ret = QDateTime::fromString(value.toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+    ret.setTimeSpec(Qt::UTC);
+    ret = ret.toTimeZone(m_timezone);
+    ret.setTimeSpec(Qt::LocalTime);
+    return ret;
+}
+
 Page *SqlEngine::getPage(const QString &path, QObject *parent)
 {
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, uuid, path, title, author_id, content,"
-                                                                  " created_at, updated_at, published_at, page, allow_comments, published "
-                                                                  "FROM posts "
-                                                                  "WHERE path = :path"),
-                                                   QStringLiteral("cmlyst"));
-    if (!path.isNull()) {
-        query.bindValue(QStringLiteral(":path"), path);
-    } else {
-        query.bindValue(QStringLiteral(":path"), QStringLiteral(""));
+    const QVector<QSqlRecord> records = fetchPage(path);
+    if (!records.isEmpty()) {
+        return createPageObj(records.first(), parent);
     }
+    return nullptr;
+}
 
-    if (Q_LIKELY(query.exec())) {
-        if (query.next()) {
-            return createPageObj(query, parent);
-        }
-    } else {
-        qWarning() << "Failed to get page" << path << query.lastError().databaseText();
+void SqlEngine::getPageAsync(const QString &path, QObject *parent, PageCallback cb)
+{
+    if (!m_readers) {
+        Engine::getPageAsync(path, parent, cb);
+        return;
     }
-    return nullptr;
+
+    auto records = std::make_shared<QVector<QSqlRecord>>();
+    read(parent, [records, path] {
+        *records = fetchPage(path);
+    }, [this, parent, cb, records] {
+        cb(records->isEmpty() ? nullptr : createPageObj(records->first(), parent));
+    });
 }
 
 Page *SqlEngine::getPageById(const QString &id, QObject *parent)
@@ -129,9 +435,9 @@ Page *SqlEngine::getPageById(const QString &id, QObject *parent)
                                                    QStringLiteral("cmlyst"));
     query.bindValue(QStringLiteral(":id"), id);
 
-    if (Q_LIKELY(query.exec())) {
+    if (Q_LIKELY(SqlTrace::exec(query))) {
         if (query.next()) {
-            return createPageObj(query, parent);
+            return createPageObj(query.record(), parent);
         }
         qWarning() << "Page not found for id" << id;
     } else {
@@ -142,16 +448,34 @@ Page *SqlEngine::getPageById(const QString &id, QObject *parent)
 
 bool SqlEngine::removePage(int id)
 {
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM posts "
-                                                                  "WHERE id = :id"),
-                                                   QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":id"), id);
-    if (query.exec() && query.numRowsAffected() == 1) {
+    const bool removed = SqlWriter::exec<bool>([&] () -> bool {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return false;
+        }
+
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM posts "
+                                                                      "WHERE id = :id"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), id);
+        if (!SqlTrace::exec(query) || query.numRowsAffected() != 1) {
+            qWarning() << "Failed to remove page" << id << query.lastError().databaseText() << "numRowsAffected" << query.numRowsAffected();
+            db.rollback();
+            return false;
+        }
+
+        // Left over ones would match no post anyway
+        writeMediaRefs(id, QStringList());
+        if (!touchContent() || !db.commit()) {
+            db.rollback();
+            return false;
+        }
         return true;
-    } else {
-        qWarning() << "Failed to remove page" << id << query.lastError().databaseText() << "numRowsAffected" << query.numRowsAffected();
-        return false;
+    });
+    if (removed) {
+        Q_EMIT pagesChanged();
     }
+    return removed;
 }
 
 QList<Page *> SqlEngine::listPages(QObject *parent, int offset, int limit)
@@ -169,9 +493,9 @@ QList<Page *> SqlEngine::listPages(QObject *parent, int offset, int limit)
 
     query.bindValue(QStringLiteral(":limit"), limit);
     query.bindValue(QStringLiteral(":offset"), offset);
-    if (Q_LIKELY(query.exec())) {
+    if (Q_LIKELY(SqlTrace::exec(query))) {
         while (query.next()) {
-            ret.append(createPageObj(query, parent));
+            ret.append(createPageObj(query.record(), parent));
         }
     }
     return ret;
@@ -181,7 +505,7 @@ QList<Page *> SqlEngine::listPagesPublished(QObject *parent, int offset, int lim
 {
     QList<Page *> ret;
     QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT id, uuid, path, title, author_id, content,"
+                QStringLiteral("SELECT id, uuid, path, title, author_id, COALESCE(html, content) AS content,"
                                " created_at, updated_at, published_at, page, allow_comments, published "
                                "FROM posts "
                                "WHERE page = 1 AND published = 1 "
@@ -192,9 +516,9 @@ QList<Page *> SqlEngine::listPagesPublished(QObject *parent, int offset, int lim
 
     query.bindValue(QStringLiteral(":limit"), limit);
     query.bindValue(QStringLiteral(":offset"), offset);
-    if (Q_LIKELY(query.exec())) {
+    if (Q_LIKELY(SqlTrace::exec(query))) {
         while (query.next()) {
-            ret.append(createPageObj(query, parent));
+            ret.append(createPageObj(query.record(), parent));
         }
     }
     return ret;
@@ -215,9 +539,9 @@ QList<Page *> SqlEngine::listPosts(QObject *parent, int offset, int limit)
 
     query.bindValue(QStringLiteral(":limit"), limit);
     query.bindValue(QStringLiteral(":offset"), offset);
-    if (Q_LIKELY(query.exec())) {
+    if (Q_LIKELY(SqlTrace::exec(query))) {
         while (query.next()) {
-            ret.append(createPageObj(query, parent));
+            ret.append(createPageObj(query.record(), parent));
         }
     }
     return ret;
@@ -226,22 +550,9 @@ QList<Page *> SqlEngine::listPosts(QObject *parent, int offset, int limit)
 QList<Page *> SqlEngine::listPostsPublished(QObject *parent, int offset, int limit)
 {
     QList<Page *> ret;
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT id, uuid, path, title, author_id, content,"
-                               " created_at, updated_at, published_at, page, allow_comments, published "
-                               "FROM posts "
-                               "WHERE page = 0 AND published = 1 "
-                               "ORDER BY published_at DESC "
-                               "LIMIT :limit OFFSET :offset"
-                               ),
-                QStringLiteral("cmlyst"));
-
-    query.bindValue(QStringLiteral(":limit"), limit);
-    query.bindValue(QStringLiteral(":offset"), offset);
-    if (Q_LIKELY(query.exec())) {
-        while (query.next()) {
-            ret.append(createPageObj(query, parent));
-        }
+    const QVector<QSqlRecord> records = fetchPostsPublished(0, offset, limit);
+    for (const QSqlRecord &record : records) {
+        ret.append(createPageObj(record, parent));
     }
     return ret;
 }
@@ -249,27 +560,114 @@ QList<Page *> SqlEngine::listPostsPublished(QObject *parent, int offset, int lim
 QList<Page *> SqlEngine::listAuthorPostsPublished(QObject *parent, int authorId, int offset, int limit)
 {
     QList<Page *> ret;
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT id, uuid, path, title, author_id, content,"
-                               " created_at, updated_at, published_at, page, allow_comments, published "
-                               "FROM posts "
-                               "WHERE page = 0 AND published = 1 AND author_id = :author_id "
-                               "ORDER BY created_at DESC "
-                               "LIMIT :limit OFFSET :offset"
-                               ),
-                QStringLiteral("cmlyst"));
+    const QVector<QSqlRecord> records = fetchPostsPublished(authorId, offset, limit);
+    for (const QSqlRecord &record : records) {
+        ret.append(createPageObj(record, parent));
+    }
+    return ret;
+}
 
-    query.bindValue(QStringLiteral(":author_id"), authorId);
-    query.bindValue(QStringLiteral(":limit"), limit);
-    query.bindValue(QStringLiteral(":offset"), offset);
-    if (query.exec()) {
-        while (query.next()) {
-            ret.append(createPageObj(query, parent));
+void SqlEngine::listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb)
+{
+    if (!m_readers) {
+        Engine::listPostsPublishedAsync(parent, authorId, offset, limit, cb);
+        return;
+    }
+
+    auto records = std::make_shared<QVector<QSqlRecord>>();
+    read(parent, [records, authorId, offset, limit] {
+        *records = fetchPostsPublished(authorId, offset, limit);
+    }, [this, parent, cb, records] {
+        QList<Page *> ret;
+        for (const QSqlRecord &record : *records) {
+            ret.append(createPageObj(record, parent));
         }
+        cb(ret);
+    });
+}
+
+QList<Page *> SqlEngine::listPagesSummary(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit)
+{
+    QList<Page *> ret;
+    const QVector<QSqlRecord> records = fetchPagesSummary(filters, authorId, sort, order, offset, limit);
+    for (const QSqlRecord &record : records) {
+        ret.append(createPageObj(record, parent, false));
     }
     return ret;
 }
 
+void SqlEngine::listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb)
+{
+    if (!m_readers) {
+        Engine::listPagesSummaryAsync(parent, filters, authorId, sort, order, offset, limit, cb);
+        return;
+    }
+
+    auto records = std::make_shared<QVector<QSqlRecord>>();
+    read(parent, [records, filters, authorId, sort, order, offset, limit] {
+        *records = fetchPagesSummary(filters, authorId, sort, order, offset, limit);
+    }, [this, parent, cb, records] {
+        QList<Page *> ret;
+        for (const QSqlRecord &record : *records) {
+            ret.append(createPageObj(record, parent, false));
+        }
+        cb(ret);
+    });
+}
+
+int SqlEngine::countPages(Filters filters, int authorId)
+{
+    return qMax(0, fetchCount(filters, authorId));
+}
+
+void SqlEngine::countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb)
+{
+    if (!m_readers) {
+        Engine::countPagesAsync(filters, authorId, receiver, cb);
+        return;
+    }
+
+    auto count = std::make_shared<int>(-1);
+    read(receiver, [count, filters, authorId] {
+        *count = fetchCount(filters, authorId);
+    }, [cb, count] {
+        cb(*count);
+    });
+}
+
+bool SqlEngine::isAsync() const
+{
+    return m_readers;
+}
+
+void SqlEngine::read(QObject *receiver, std::function<void ()> query, std::function<void ()> done)
+{
+    // The engine outlives the receiver, so the result is posted to
+    // it and dropped if the request is already gone. The guard is
+    // only touched on this thread, the reader just moves it back
+    QPointer<QObject> guard(receiver);
+    auto elapsed = std::make_shared<qint64>(0);
+    std::function<void ()> finished = [guard, done, elapsed] {
+        if (guard) {
+            SqlTrace::addTime(guard, *elapsed);
+            SqlTrace::ReceiverScope scope(guard);
+            done();
+        }
+    };
+
+    const QString dbPath = m_dbPath;
+    const SqlProfile profile = m_profile;
+    m_readers->start(new ReaderTask([this, dbPath, profile, query, elapsed, finished] () mutable {
+        openReader(dbPath, profile);
+
+        const qint64 start = SqlTrace::threadTime();
+        query();
+        *elapsed = SqlTrace::threadTime() - start;
+
+        QMetaObject::invokeMethod(this, std::move(finished), Qt::QueuedConnection);
+    }));
+}
+
 QHash<QString, QString> SqlEngine::settings() const
 {
     return m_settings;
@@ -282,7 +680,31 @@ QString SqlEngine::settingsValue(const QString &key, const QString &defaultValue
 
 bool SqlEngine::setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value)
 {
-    static QSqlDatabase db = QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst")));
+    return setSettingsValues(c, {
+                                 {key, value}
+                             });
+}
+
+bool SqlEngine::setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values)
+{
+    const bool ok = SqlWriter::exec<bool>([&] () -> bool {
+        return writeSettings(values);
+    });
+    if (!ok) {
+        return false;
+    }
+
+    m_settingsDate = -1;
+    m_settingsDateTime = QDateTime();
+    c->setProperty("_sql_engine_date", QVariant());
+    loadSettings(c);
+
+    return true;
+}
+
+bool SqlEngine::writeSettings(const QHash<QString, QString> &values)
+{
+    QSqlDatabase db = SqlWriter::database();
     if (!db.transaction()) {
         return false;
     }
@@ -293,34 +715,36 @@ bool SqlEngine::setSettingsValue(Cutelyst::Context *c, const QString &key, const
                                                                   "(:key, :value)"),
                                                    QStringLiteral("cmlyst"));
 
-    if (key != QLatin1String("modified")) {
-        query.bindValue(QStringLiteral(":key"), key);
-        query.bindValue(QStringLiteral(":value"), value);
-        if (!query.exec()) {
-            qWarning() << "Failed to save settings" << query.lastError().databaseText();
-            db.rollback();
-            return false;
+    auto it = values.constBegin();
+    while (it != values.constEnd()) {
+        if (it.key() == QLatin1String("menus")) {
+            // Imported data may still have menus in the old format
+            if (!importMenus(it.value())) {
+                db.rollback();
+                return false;
+            }
+        } else if (it.key() != QLatin1String("modified") && it.key() != QLatin1String("content_version")) {
+            query.bindValue(QStringLiteral(":key"), it.key());
+            query.bindValue(QStringLiteral(":value"), it.value());
+            if (!SqlTrace::exec(query)) {
+                qWarning() << "Failed to save settings" << it.key() << query.lastError().databaseText();
+                db.rollback();
+                return false;
+            }
         }
+        ++it;
     }
 
     qint64 currentDateTime = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() / 1000;
     query.bindValue(QStringLiteral(":key"), QStringLiteral("modified"));
     query.bindValue(QStringLiteral(":value"), currentDateTime);
-    if (!query.exec()) {
+    if (!SqlTrace::exec(query)) {
         qWarning() << "Failed to save settings" << query.lastError().databaseText();
         db.rollback();
         return false;
     }
 
-    if (db.commit()) {
-        m_settingsDate = -1;
-        m_settingsDateTime = QDateTime();
-        c->setProperty("_sql_engine_date", QVariant());
-        loadSettings(c);
-
-        return true;
-    }
-    return false;
+    return db.commit();
 }
 
 QList<Menu *> SqlEngine::menus()
@@ -330,60 +754,278 @@ QList<Menu *> SqlEngine::menus()
 
 bool SqlEngine::saveMenu(Cutelyst::Context *c, Menu *menu, bool replace)
 {
-    QJsonObject menusObj;
-    auto menus = m_menus;
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
 
-    if (menu) {
-        for (const auto menuIt : menus) {
-            if (menuIt->id() == menu->id()) {
-                menus.removeOne(menuIt);
-                break;
-            }
+        if (!writeMenu(menu, replace)) {
+            db.rollback();
+            return -1;
         }
-        menus.push_back(menu);
-    }
 
-    for (CMS::Menu *menu : menus) {
-        QJsonObject objMenu;
-//        objMenu.insert(QStringLiteral("id"), menu->id());
-        objMenu.insert(QStringLiteral("name"), menu->name());
+        return commitModified(&previous);
+    });
+
+    return menusCommitted(c, previous, modified);
+}
+
+bool SqlEngine::removeMenu(Cutelyst::Context *c, const QString &name)
+{
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM menu_entries WHERE menu_id = :id"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), name);
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to remove menu entries" << name << query.lastError().databaseText();
+            db.rollback();
+            return -1;
+        }
+
+        query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM menus WHERE id = :id"),
+                                             QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), name);
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to remove menu" << name << query.lastError().databaseText();
+            db.rollback();
+            return -1;
+        }
+
+        return commitModified(&previous);
+    });
 
-        QJsonArray locations;
-        const auto menuLocations = menu->locations();
-        for (const auto location : menuLocations) {
-            locations.append(location);
+    return menusCommitted(c, previous, modified);
+}
+
+bool SqlEngine::addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url)
+{
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        // Only the new row is written, the others are left untouched
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO menu_entries "
+                                                                      "(menu_id, position, text, url, attr) "
+                                                                      "SELECT :menu_id, COALESCE(MAX(position), -1) + 1, :text, :url, '' "
+                                                                      "FROM menu_entries WHERE menu_id = :entries_menu_id"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":menu_id"), menu->id());
+        query.bindValue(QStringLiteral(":text"), text);
+        query.bindValue(QStringLiteral(":url"), url);
+        query.bindValue(QStringLiteral(":entries_menu_id"), menu->id());
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to add menu entry" << menu->id() << query.lastError().databaseText();
+            db.rollback();
+            return -1;
         }
-        objMenu.insert(QStringLiteral("locations"), locations);
 
-        QJsonArray entriesJson;
-        const QList<QVariantHash> entries = menu->entries();
-        for (const auto entry : entries) {
-            entriesJson.append(QJsonObject::fromVariantHash(entry));
+        query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE menus SET version = version + 1 WHERE id = :id"),
+                                             QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), menu->id());
+        if (!SqlTrace::exec(query) || query.numRowsAffected() != 1) {
+            qWarning() << "Failed to update menu version" << menu->id() << query.lastError().databaseText();
+            db.rollback();
+            return -1;
+        }
+
+        return commitModified(&previous);
+    });
+
+    return menusCommitted(c, previous, modified);
+}
+
+bool SqlEngine::writeMenu(Menu *menu, bool replace)
+{
+    const QString locations = QString::fromUtf8(QJsonDocument(QJsonArray::fromStringList(menu->locations()))
+                                                .toJson(QJsonDocument::Compact));
+
+    QSqlQuery query;
+    if (replace) {
+        query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE menus "
+                                                            "SET name = :name, locations = :locations, "
+                                                            "auto_add_pages = :auto_add_pages, version = version + 1 "
+                                                            "WHERE id = :id"),
+                                             QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), menu->id());
+        query.bindValue(QStringLiteral(":name"), menu->name());
+        query.bindValue(QStringLiteral(":locations"), locations);
+        query.bindValue(QStringLiteral(":auto_add_pages"), menu->autoAddPages());
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to update menu" << menu->id() << query.lastError().databaseText();
+            return false;
         }
-        objMenu.insert(QStringLiteral("entries"), entriesJson);
+    }
 
-        menusObj.insert(menu->id(), objMenu);
+    if (!replace || query.numRowsAffected() == 0) {
+        query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO menus "
+                                                            "(id, name, locations, auto_add_pages, version) "
+                                                            "VALUES "
+                                                            "(:id, :name, :locations, :auto_add_pages, 1)"),
+                                             QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), menu->id());
+        query.bindValue(QStringLiteral(":name"), menu->name());
+        query.bindValue(QStringLiteral(":locations"), locations);
+        query.bindValue(QStringLiteral(":auto_add_pages"), menu->autoAddPages());
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to insert menu" << menu->id() << query.lastError().databaseText();
+            return false;
+        }
     }
 
-    QJsonDocument doc(menusObj);
-    setSettingsValue(c, QStringLiteral("menus"), QString::fromUtf8(doc.toJson(QJsonDocument::Compact)));
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM menu_entries WHERE menu_id = :id"),
+                                         QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":id"), menu->id());
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to clear menu entries" << menu->id() << query.lastError().databaseText();
+        return false;
+    }
+
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO menu_entries "
+                                                        "(menu_id, position, text, url, attr) "
+                                                        "VALUES "
+                                                        "(:menu_id, :position, :text, :url, :attr)"),
+                                         QStringLiteral("cmlyst"));
+    const QList<QVariantHash> entries = menu->entries();
+    for (int i = 0; i < entries.size(); ++i) {
+        const QVariantHash &entry = entries.at(i);
+        query.bindValue(QStringLiteral(":menu_id"), menu->id());
+        query.bindValue(QStringLiteral(":position"), i);
+        query.bindValue(QStringLiteral(":text"), entry.value(QStringLiteral("text")).toString());
+        query.bindValue(QStringLiteral(":url"), entry.value(QStringLiteral("url")).toString());
+        query.bindValue(QStringLiteral(":attr"), entry.value(QStringLiteral("attr")).toString());
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to insert menu entry" << menu->id() << query.lastError().databaseText();
+            return false;
+        }
+    }
 
     return true;
 }
 
-bool SqlEngine::removeMenu(Cutelyst::Context *c, const QString &name)
+bool SqlEngine::importMenus(const QString &json)
 {
-    for (const auto menuIt : m_menus) {
-        if (menuIt->id() == name) {
-            m_menus.removeOne(menuIt);
-            saveMenu(c, nullptr, false);
-            break;
+    // The format menus used to have when stored in settings
+    const QJsonObject menusObj = QJsonDocument::fromJson(json.toUtf8()).object();
+    auto it = menusObj.constBegin();
+    while (it != menusObj.constEnd()) {
+        const QJsonObject obj = it.value().toObject();
+
+        Menu menu(it.key());
+        menu.setName(obj.value(QStringLiteral("name")).toString());
+        menu.setAutoAddPages(obj.value(QStringLiteral("autoAddPages")).toBool());
+
+        QList<QVariantHash> entries;
+        const QJsonArray entriesJson = obj.value(QStringLiteral("entries")).toArray();
+        for (const QJsonValue &entry : entriesJson) {
+            entries.append(entry.toObject().toVariantHash());
+        }
+        menu.setEntries(entries);
+
+        QStringList locations;
+        const QJsonArray locationsJson = obj.value(QStringLiteral("locations")).toArray();
+        for (const QJsonValue &location : locationsJson) {
+            locations.append(location.toString());
+        }
+        menu.setLocations(locations);
+
+        if (!writeMenu(&menu, true)) {
+            return false;
         }
+
+        ++it;
     }
 
     return true;
 }
 
+qint64 SqlEngine::commitModified(qint64 *previous)
+{
+    QSqlDatabase db = SqlWriter::database();
+
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT value FROM settings WHERE key = 'modified'"),
+                                                   QStringLiteral("cmlyst"));
+    *previous = SqlTrace::exec(query) && query.next() ? query.value(0).toLongLong() : -1;
+
+    // Bump modified so other processes notice, they only
+    // reload the menus and users whose version changed
+    const qint64 currentDateTime = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() / 1000;
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT OR REPLACE INTO settings "
+                                                        "(key, value) "
+                                                        "VALUES "
+                                                        "('modified', :value)"),
+                                         QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":value"), currentDateTime);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to save settings" << query.lastError().databaseText();
+        db.rollback();
+        return -1;
+    }
+
+    if (!db.commit()) {
+        qWarning() << "Failed to commit" << db.lastError().databaseText();
+        db.rollback();
+        return -1;
+    }
+
+    return currentDateTime;
+}
+
+bool SqlEngine::menusCommitted(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime)
+{
+    if (currentDateTime == -1) {
+        return false;
+    }
+
+    if (keepSettings(c, previous, currentDateTime)) {
+        loadMenus();
+    }
+
+    return true;
+}
+
+bool SqlEngine::usersCommitted(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime)
+{
+    if (currentDateTime == -1) {
+        return false;
+    }
+
+    if (keepSettings(c, previous, currentDateTime)) {
+        syncUsers();
+    }
+
+    return true;
+}
+
+bool SqlEngine::keepSettings(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime)
+{
+    // If nothing else changed since our settings were loaded
+    // there is no need to reload them after the commit
+    if (previous == m_settingsDate) {
+        m_settingsDate = currentDateTime;
+        m_settingsDateTime = QDateTime::fromMSecsSinceEpoch(currentDateTime * 1000);
+        m_settings.insert(QStringLiteral("modified"), QString::number(currentDateTime));
+        c->setProperty("_sql_engine_date", currentDateTime);
+        return true;
+    }
+
+    m_settingsDate = -1;
+    m_settingsDateTime = QDateTime();
+    c->setProperty("_sql_engine_date", QVariant());
+    loadSettings(c);
+    return false;
+}
+
 QHash<QString, Menu *> SqlEngine::menuLocations()
 {
     return m_menuLocations;
@@ -398,9 +1040,20 @@ QHash<QString, QString> SqlEngine::loadSettings(Cutelyst::Context *c)
 {
     QVariant loadedDate = c->property("_sql_engine_date");
     if (loadedDate.isNull()) {
+        // Nothing was committed by other connections since
+        // the last check, so what we have is current
+        const qint64 version = dataVersion(c);
+        if (m_settingsDate != -1 && version != -1 && version == m_settingsDataVersion) {
+            Metrics::increment("cmlyst_cache_requests_total{cache=\"settings\",result=\"hit\"}");
+            c->setProperty("_sql_engine_date", m_settingsDate);
+            return m_settings;
+        }
+        Metrics::increment("cmlyst_cache_requests_total{cache=\"settings\",result=\"miss\"}");
+        m_settingsDataVersion = version;
+
         QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT value FROM settings WHERE key = 'modified'"),
                                                        QStringLiteral("cmlyst"));
-        if (query.exec() && query.next()) {
+        if (SqlTrace::exec(query) && query.next()) {
             loadedDate = query.value(0).toLongLong();
             c->setProperty("_sql_engine_date", loadedDate);
         }
@@ -410,10 +1063,11 @@ QHash<QString, QString> SqlEngine::loadSettings(Cutelyst::Context *c)
             m_settingsDate = settingsDate;
             m_settingsDateTime = QDateTime::fromMSecsSinceEpoch(settingsDate * 1000);
             m_settings.clear();
+            Metrics::increment("cmlyst_settings_reloads_total");
 
             QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT key, value FROM settings"),
                                                            QStringLiteral("cmlyst"));
-            if (query.exec()) {
+            if (SqlTrace::exec(query)) {
                 while (query.next()) {
                     m_settings.insert(query.value(0).toString(), query.value(1).toString());
                 }
@@ -429,7 +1083,7 @@ QHash<QString, QString> SqlEngine::loadSettings(Cutelyst::Context *c)
             }
 
             loadMenus();
-            loadUsers();
+            syncUsers();
 
             configureView(c);
         }
@@ -438,13 +1092,76 @@ QHash<QString, QString> SqlEngine::loadSettings(Cutelyst::Context *c)
     return m_settings;
 }
 
+void SqlEngine::warmup(Cutelyst::Context *c)
+{
+    // Also loads the timezone, menus and the theme
+    loadSettings(c);
+
+    users();
+
+    // Reads the index CMDispatcher looks paths up in
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT count(path) FROM posts WHERE path > ''"),
+                                                   QStringLiteral("cmlyst"));
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to read the posts path index" << query.lastError().databaseText();
+    }
+
+    // Prepares the lookup statement and renders the menus
+    delete getPage(m_settings.value(QStringLiteral("page_on_front")), c);
+    menusHtml(QString());
+}
+
+qint64 SqlEngine::dataVersion(Cutelyst::Context *c)
+{
+    QVariant version = c->property("_sql_data_version");
+    if (version.isNull()) {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("PRAGMA data_version"),
+                                                       QStringLiteral("cmlyst"));
+        if (SqlTrace::exec(query) && query.next()) {
+            version = query.value(0).toLongLong();
+        } else {
+            version = -1;
+        }
+        c->setProperty("_sql_data_version", version);
+    }
+    return version.toLongLong();
+}
+
 QDateTime SqlEngine::lastModified()
 {
     return m_settingsDateTime;
 }
 
+qint64 SqlEngine::contentVersion(Cutelyst::Context *c)
+{
+    Q_UNUSED(c)
+    // Not data_version, every session write changes that
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT value FROM settings WHERE key = 'content_version'"),
+                                                   QStringLiteral("cmlyst"));
+    if (!SqlTrace::exec(query)) {
+        return -1;
+    }
+    return query.next() ? query.value(0).toLongLong() : 0;
+}
+
 QString SqlEngine::addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace)
 {
+    qint64 previous = 0;
+    qint64 modified = -1;
+    const QString slug = SqlWriter::exec<QString>([&] () -> QString {
+        return writeUser(user, replace, &previous, &modified);
+    });
+    if (slug.isEmpty() || !usersCommitted(c, previous, modified)) {
+        return QString();
+    }
+
+    return slug;
+}
+
+QString SqlEngine::writeUser(const Cutelyst::ParamsMultiMap &user, bool replace, qint64 *previous, qint64 *modified)
+{
+    QSqlDatabase db = SqlWriter::database();
+
     QSqlQuery query;
     if (replace) {
         query = CPreparedSqlQueryThreadForDB(
@@ -479,184 +1196,732 @@ QString SqlEngine::addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap
                name.left(150).toHtmlEscaped());
     query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
 
-    if (!query.exec()) {
+    if (!db.transaction()) {
+        return QString();
+    }
+
+    // A replace might have changed the row of another id,
+    // so with replace everything is dropped
+    if (!SqlTrace::exec(query) || !logUserChange(replace ? 0 : query.lastInsertId().toInt())) {
         qDebug() << "Failed to add new user:" << query.lastError().databaseText() << user;
+        db.rollback();
         return QString();
     }
 
-    setSettingsValue(c, QStringLiteral("modified"), QString());
+    *modified = commitModified(previous);
+    if (*modified == -1) {
+        return QString();
+    }
 
     return slug;
 }
 
 bool SqlEngine::removeUser(Cutelyst::Context *c, int id)
 {
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("DELETE FROM users WHERE id = :id"),
-                QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":id"), id);
-    if (query.exec() && query.numRowsAffected() == 1) {
-        setSettingsValue(c, QStringLiteral("modified"), QString());
-        return true;
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("DELETE FROM users WHERE id = :id"),
+                    QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), id);
+        if (!SqlTrace::exec(query) || query.numRowsAffected() != 1 || !logUserChange(id)) {
+            db.rollback();
+            return -1;
+        }
+        return commitModified(&previous);
+    });
+
+    return usersCommitted(c, previous, modified);
+}
+
+QString SqlEngine::updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user)
+{
+    const int id = this->user(slug).value(QStringLiteral("id")).toInt();
+    if (!id) {
+        return QString();
     }
-    return false;
+
+    QJsonObject obj;
+    obj.insert(QStringLiteral("location"),
+               user.value(QStringLiteral("location")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("facebook"),
+               user.value(QStringLiteral("facebook")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("twitter"),
+               user.value(QStringLiteral("twitter")).left(100).toHtmlEscaped());
+    obj.insert(QStringLiteral("website"),
+               user.value(QStringLiteral("website")).left(100).toHtmlEscaped());
+    const QString name = user.value(QStringLiteral("name"));
+    obj.insert(QStringLiteral("name"),
+               name.left(150).toHtmlEscaped());
+    obj.insert(QStringLiteral("bio"),
+               user.value(QStringLiteral("bio")).left(200).toHtmlEscaped());
+
+    QString newSlug = user.value(QStringLiteral("slug"));
+    if (newSlug.isEmpty()) {
+        newSlug  = name.section(QLatin1Char(' '), 0, 0);
+    }
+    newSlug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
+    newSlug = newSlug.left(50).toLower().toHtmlEscaped();
+
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE users SET "
+                                                                      "slug = :slug, "
+                                                                      "email = :email, "
+                                                                      "json = :json "
+                                                                      "WHERE id = :id "),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), id);
+        query.bindValue(QStringLiteral(":slug"), newSlug);
+        query.bindValue(QStringLiteral(":email"), user.value(QStringLiteral("email")).left(200).toHtmlEscaped());
+        query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
+
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        if (!SqlTrace::exec(query) || !logUserChange(id)) {
+            qWarning() << "Failed to update user:" << id << query.lastError().databaseText();
+            db.rollback();
+            return -1;
+        }
+        return commitModified(&previous);
+    });
+    if (!usersCommitted(c, previous, modified)) {
+        return QString();
+    }
+
+    return newSlug;
+}
+
+bool SqlEngine::invalidateUser(Cutelyst::Context *c, int id)
+{
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        if (!logUserChange(id)) {
+            db.rollback();
+            return -1;
+        }
+        return commitModified(&previous);
+    });
+
+    return usersCommitted(c, previous, modified);
 }
 
 QVariantList SqlEngine::users()
 {
+    if (!m_usersLoaded) {
+        m_users.clear();
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, slug, email, json, version "
+                                                                      "FROM users "),
+                                                       QStringLiteral("cmlyst"));
+        if (Q_LIKELY(SqlTrace::exec(query))) {
+            while (query.next()) {
+                m_users.push_back(QVariant::fromValue(cacheUser(query)));
+            }
+            m_usersLoaded = true;
+        }
+    }
     return m_users;
 }
 
 QHash<QString, QString> SqlEngine::user(const QString &slug)
 {
-    return m_usersSlug.value(slug);
+    auto it = m_usersSlug.constFind(slug);
+    if (it != m_usersSlug.constEnd()) {
+        Metrics::increment("cmlyst_cache_requests_total{cache=\"users\",result=\"hit\"}");
+        return m_usersId.value(it.value());
+    }
+    if (m_usersMissing.contains(slug)) {
+        Metrics::increment("cmlyst_cache_requests_total{cache=\"users\",result=\"hit\"}");
+        return QHash<QString, QString>();
+    }
+    Metrics::increment("cmlyst_cache_requests_total{cache=\"users\",result=\"miss\"}");
+
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, slug, email, json, version "
+                                                                  "FROM users WHERE slug = :slug"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":slug"), slug);
+    if (SqlTrace::exec(query)) {
+        if (query.next()) {
+            return cacheUser(query);
+        }
+        // Anyone can ask for any slug, so keep this bounded
+        if (m_usersMissing.size() >= 1024) {
+            m_usersMissing.clear();
+        }
+        m_usersMissing.insert(slug);
+    }
+    return QHash<QString, QString>();
 }
 
 QHash<QString, QString> SqlEngine::user(int id)
 {
-    return m_usersId.value(id);
+    auto it = m_usersId.constFind(id);
+    if (it != m_usersId.constEnd()) {
+        Metrics::increment("cmlyst_cache_requests_total{cache=\"users\",result=\"hit\"}");
+        return it.value();
+    }
+    Metrics::increment("cmlyst_cache_requests_total{cache=\"users\",result=\"miss\"}");
+
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, slug, email, json, version "
+                                                                  "FROM users WHERE id = :id"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":id"), id);
+    if (SqlTrace::exec(query)) {
+        if (query.next()) {
+            return cacheUser(query);
+        }
+        // Remember authors that no longer exist too
+        m_usersId.insert(id, QHash<QString, QString>());
+    }
+    return QHash<QString, QString>();
 }
 
-int SqlEngine::savePageBackend(Page *page)
+QHash<QString, QString> SqlEngine::credentials(const QString &email)
 {
-    QSqlQuery query;
-    if (!page->id()) {
-        query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO posts "
-                                                            "(path, uuid, title, author_id, content, html,"
-                                                            " created_at, updated_at, published_at, page, published, allow_comments, published) "
-                                                            "VALUES "
-                                                            "(:path, :uuid, :title, :author_id, :content, :html,"
-                                                            " :created_at, :updated_at, :published_at, :page, :published, :allow_comments, :published)"),
-                                             QStringLiteral("cmlyst"));
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, email, password, version "
+                                                                  "FROM users WHERE email = :email"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":email"), email);
+    if (SqlTrace::exec(query) && query.next()) {
+        return {
+            {QStringLiteral("id"), query.value(0).toString()},
+            {QStringLiteral("email"), query.value(1).toString()},
+            {QStringLiteral("password"), query.value(2).toString()},
+            {QStringLiteral("version"), query.value(3).toString()},
+        };
+    }
+    return QHash<QString, QString>();
+}
+
+bool SqlEngine::setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash)
+{
+    qint64 previous = 0;
+    const qint64 modified = SqlWriter::exec<qint64>([&] () -> qint64 {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return -1;
+        }
+
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE users SET password = :password, version = version + 1 "
+                                                                      "WHERE id = :id AND password = :oldpw"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":id"), id);
+        query.bindValue(QStringLiteral(":password"), newHash);
+        query.bindValue(QStringLiteral(":oldpw"), oldHash);
+        if (!SqlTrace::exec(query) || query.numRowsAffected() != 1 || !logUserChange(id)) {
+            qWarning() << "Failed to change password" << id << query.lastError().databaseText();
+            db.rollback();
+            return -1;
+        }
+        return commitModified(&previous);
+    });
+
+    return usersCommitted(c, previous, modified);
+}
+
+bool SqlEngine::addMedia(const QVariantHash &media)
+{
+    return SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT OR REPLACE INTO media "
+                                                                      "(path, name, size, mime, width, height, hash, variants, uploaded_at) "
+                                                                      "VALUES "
+                                                                      "(:path, :name, :size, :mime, :width, :height, :hash, :variants, :uploaded_at)"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":path"), media.value(QStringLiteral("path")));
+        query.bindValue(QStringLiteral(":name"), media.value(QStringLiteral("name")));
+        query.bindValue(QStringLiteral(":size"), media.value(QStringLiteral("size")));
+        query.bindValue(QStringLiteral(":mime"), media.value(QStringLiteral("mime")));
+        query.bindValue(QStringLiteral(":width"), media.value(QStringLiteral("width")));
+        query.bindValue(QStringLiteral(":height"), media.value(QStringLiteral("height")));
+        query.bindValue(QStringLiteral(":hash"), media.value(QStringLiteral("hash")));
+        const QVariantList variants = media.value(QStringLiteral("variants")).toList();
+        if (variants.isEmpty()) {
+            query.bindValue(QStringLiteral(":variants"), QVariant(QVariant::String));
+        } else {
+            query.bindValue(QStringLiteral(":variants"), QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(variants)).toJson(QJsonDocument::Compact)));
+        }
+
+        QDateTime uploaded = media.value(QStringLiteral("uploaded_at")).toDateTime();
+        if (!uploaded.isValid()) {
+            uploaded = QDateTime::currentDateTimeUtc();
+        }
+        query.bindValue(QStringLiteral(":uploaded_at"), uploaded.toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
+
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to add media" << media.value(QStringLiteral("path")) << query.lastError().databaseText();
+            return false;
+        }
+        return true;
+    });
+}
+
+bool SqlEngine::removeMedia(const QString &path)
+{
+    return SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM media WHERE path = :path"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":path"), path);
+        if (SqlTrace::exec(query) && query.numRowsAffected() == 1) {
+            return true;
+        }
+        qWarning() << "Failed to remove media" << path << query.lastError().databaseText();
+        return false;
+    });
+}
+
+QVariantHash SqlEngine::media(const QString &path)
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, path, name, size, mime, width, height, hash, uploaded_at, variants "
+                                                                  "FROM media "
+                                                                  "WHERE path = :path"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":path"), path);
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        if (query.next()) {
+            return createMediaHash(query);
+        }
     } else {
-        query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE posts SET "
-                                                            "path = :path, title = :title, author_id = :author_id, content = :content, html = :html, "
-                                                            "created_at = :created_at, updated_at = :updated_at, published_at = :published_at,"
-                                                            "page = :page, published = :published, allow_comments = :allow_comments, published = :published "
-                                                            "WHERE id = :id"),
-                                             QStringLiteral("cmlyst"));
-        query.bindValue(QStringLiteral(":id"), page->id());
+        qWarning() << "Failed to get media" << path << query.lastError().databaseText();
     }
+    return QVariantHash();
+}
 
-    query.bindValue(QStringLiteral(":path"), page->path());
-    query.bindValue(QStringLiteral(":uuid"), page->uuid());
-    query.bindValue(QStringLiteral(":title"), page->title());
-    query.bindValue(QStringLiteral(":author_id"), page->author().value(QStringLiteral("id")).toInt());
-    query.bindValue(QStringLiteral(":content"), page->content().get());
-    query.bindValue(QStringLiteral(":html"), page->content().get());
-    query.bindValue(QStringLiteral(":created_at"), page->created().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
-    query.bindValue(QStringLiteral(":updated_at"), page->updated().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
-    query.bindValue(QStringLiteral(":published_at"), page->publishedAt().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
-    query.bindValue(QStringLiteral(":page"), page->page());
-    query.bindValue(QStringLiteral(":published"), page->published());
-    query.bindValue(QStringLiteral(":allow_comments"), page->allowComments());
-    query.bindValue(QStringLiteral(":published"), page->published());
-    if (!query.exec()) {
-        qWarning() << "Failed to save page" << query.lastError().databaseText();
-        return 0;
+QVariantList SqlEngine::listMedia(int offset, int limit)
+{
+    QVariantList ret;
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, path, name, size, mime, width, height, hash, uploaded_at, variants "
+                                                                  "FROM media "
+                                                                  "ORDER BY uploaded_at DESC "
+                                                                  "LIMIT :limit OFFSET :offset"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":limit"), limit);
+    query.bindValue(QStringLiteral(":offset"), offset);
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        while (query.next()) {
+            ret.push_back(createMediaHash(query));
+        }
+    } else {
+        qWarning() << "Failed to list media" << query.lastError().databaseText();
     }
+    return ret;
+}
 
-    if (page->id()) {
-        return page->id();
+int SqlEngine::countMedia()
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT count(*) FROM media"),
+                                                   QStringLiteral("cmlyst"));
+    if (Q_LIKELY(SqlTrace::exec(query) && query.next())) {
+        return query.value(0).toInt();
     }
-    return query.lastInsertId().toInt();
+    qWarning() << "Failed to count media" << query.lastError().databaseText();
+    return 0;
 }
 
-void SqlEngine::loadMenus()
+QVariantHash SqlEngine::createMediaHash(const QSqlQuery &query) const
 {
-    QList<CMS::Menu *> menus;
-    QHash<QString, CMS::Menu *> menuLocations;
+    return {
+        {QStringLiteral("id"), query.value(0)},
+        {QStringLiteral("path"), query.value(1)},
+        {QStringLiteral("name"), query.value(2)},
+        {QStringLiteral("size"), query.value(3)},
+        {QStringLiteral("mime"), query.value(4)},
+        {QStringLiteral("width"), query.value(5)},
+        {QStringLiteral("height"), query.value(6)},
+        {QStringLiteral("hash"), query.value(7)},
+        {QStringLiteral("uploaded_at"), utcValue(query.value(8))},
+        {QStringLiteral("variants"), QJsonDocument::fromJson(query.value(9).toString().toUtf8()).array().toVariantList()},
+    };
+}
 
-    const QString menusSetting = settingsValue(QStringLiteral("menus"));
-    QJsonDocument doc = QJsonDocument::fromJson(menusSetting.toUtf8());
-    const QJsonObject menusObj = doc.object();
+QVariantHash SqlEngine::mediaByHash(const QString &hash)
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, path, name, size, mime, width, height, hash, uploaded_at, variants "
+                                                                  "FROM media "
+                                                                  "WHERE hash = :hash "
+                                                                  "LIMIT 1"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":hash"), hash);
+    if (Q_LIKELY(SqlTrace::exec(query))) {
+        if (query.next()) {
+            return createMediaHash(query);
+        }
+    } else {
+        qWarning() << "Failed to get media by hash" << hash << query.lastError().databaseText();
+    }
+    return QVariantHash();
+}
 
-    auto it = menusObj.constBegin();
-    while (it != menusObj.constEnd()) {
-//    for (const QJsonValue &value : menusObj) {
-//        qDebug() << Q_FUNC_INFO << value;
-        QJsonObject obj = it.value().toObject();
-//        Menu *menu = new Menu(obj.value(QStringLiteral("id")).toString());
-        Menu *menu = new Menu(it.key());
+bool SqlEngine::setMediaVariants(const QString &hash, const QVariantList &variants)
+{
+    return SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE media SET variants = :variants WHERE hash = :hash"),
+                                                       QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":variants"), QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(variants)).toJson(QJsonDocument::Compact)));
+        query.bindValue(QStringLiteral(":hash"), hash);
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to save media variants" << hash << query.lastError().databaseText();
+            return false;
+        }
+        return true;
+    });
+}
 
-        menu->setName(obj.value(QStringLiteral("name")).toString());
-        menu->setAutoAddPages(obj.value(QStringLiteral("autoAddPages")).toBool());
+int SqlEngine::savePageBackend(Page *page)
+{
+    // Done here, with our connection, so public reads don't have to
+    const QString html = Media::addSrcset(this, page->content().get(), QStringLiteral("/.media/"));
+    const QStringList refs = Media::references(page->content().get(), QStringLiteral("/.media/"));
+
+    return SqlWriter::exec<int>([&] () -> int {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            qWarning() << "Failed to begin saving page" << db.lastError().databaseText();
+            return 0;
+        }
 
-        QList<QVariantHash> urls;
-        const QJsonArray urlsJson = obj.value(QStringLiteral("entries")).toArray();
-        for (const QJsonValue &url : urlsJson) {
-            urls.append(url.toObject().toVariantHash());
+        QSqlQuery query;
+        if (!page->id()) {
+            query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO posts "
+                                                                "(path, uuid, title, author_id, content, html,"
+                                                                " created_at, updated_at, published_at, page, published, allow_comments, published) "
+                                                                "VALUES "
+                                                                "(:path, :uuid, :title, :author_id, :content, :html,"
+                                                                " :created_at, :updated_at, :published_at, :page, :published, :allow_comments, :published)"),
+                                                 QStringLiteral("cmlyst"));
+        } else {
+            query = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE posts SET "
+                                                                "path = :path, title = :title, author_id = :author_id, content = :content, html = :html, "
+                                                                "created_at = :created_at, updated_at = :updated_at, published_at = :published_at,"
+                                                                "page = :page, published = :published, allow_comments = :allow_comments, published = :published "
+                                                                "WHERE id = :id"),
+                                                 QStringLiteral("cmlyst"));
+            query.bindValue(QStringLiteral(":id"), page->id());
         }
-        menu->setEntries(urls);
 
-        QStringList locations;
-        const QJsonArray locationsJson = obj.value(QStringLiteral("locations")).toArray();
-        for (const QJsonValue &location : locationsJson) {
-            locations.append(location.toString());
+        query.bindValue(QStringLiteral(":path"), page->path());
+        query.bindValue(QStringLiteral(":uuid"), page->uuid());
+        query.bindValue(QStringLiteral(":title"), page->title());
+        query.bindValue(QStringLiteral(":author_id"), page->author().value(QStringLiteral("id")).toInt());
+        query.bindValue(QStringLiteral(":content"), page->content().get());
+        query.bindValue(QStringLiteral(":html"), html);
+        query.bindValue(QStringLiteral(":created_at"), page->created().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
+        query.bindValue(QStringLiteral(":updated_at"), page->updated().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
+        query.bindValue(QStringLiteral(":published_at"), page->publishedAt().toUTC().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
+        query.bindValue(QStringLiteral(":page"), page->page());
+        query.bindValue(QStringLiteral(":published"), page->published());
+        query.bindValue(QStringLiteral(":allow_comments"), page->allowComments());
+        query.bindValue(QStringLiteral(":published"), page->published());
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to save page" << query.lastError().databaseText();
+            db.rollback();
+            return 0;
         }
-        menu->setLocations(locations);
 
-        bool added = false;
-        for (const QString &location : locations) {
-            if (!menuLocations.contains(location)) {
-                menuLocations.insert(location, menu);
-                added = true;
+        const int id = page->id() ? page->id() : query.lastInsertId().toInt();
+        if (!writeMediaRefs(id, refs) || !touchContent() || !db.commit()) {
+            db.rollback();
+            return 0;
+        }
+        return id;
+    });
+}
+
+bool SqlEngine::touchContent()
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT OR REPLACE INTO settings "
+                                                                  "(key, value) "
+                                                                  "VALUES "
+                                                                  "('content_version', COALESCE((SELECT value FROM settings WHERE key = 'content_version'), 0) + 1)"),
+                                                   QStringLiteral("cmlyst"));
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to bump the content version" << query.lastError().databaseText();
+        return false;
+    }
+    return true;
+}
+
+bool SqlEngine::writeMediaRefs(int postId, const QStringList &paths)
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM media_refs WHERE post_id = :post_id"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":post_id"), postId);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to clear media references" << postId << query.lastError().databaseText();
+        return false;
+    }
+
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT OR IGNORE INTO media_refs (path, post_id) VALUES (:path, :post_id)"),
+                                         QStringLiteral("cmlyst"));
+    for (const QString &path : paths) {
+        query.bindValue(QStringLiteral(":path"), path);
+        query.bindValue(QStringLiteral(":post_id"), postId);
+        if (!SqlTrace::exec(query)) {
+            qWarning() << "Failed to save media reference" << postId << path << query.lastError().databaseText();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SqlEngine::updateMediaHtml(const QString &hash)
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT DISTINCT p.id, p.content FROM media m "
+                                                                  "JOIN media_refs r ON r.path = m.path "
+                                                                  "JOIN posts p ON p.id = r.post_id "
+                                                                  "WHERE m.hash = :hash"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":hash"), hash);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to find pages showing media" << hash << query.lastError().databaseText();
+        return;
+    }
+
+    QHash<int, QString> pages;
+    while (query.next()) {
+        pages.insert(query.value(0).toInt(), Media::addSrcset(this, query.value(1).toString(), QStringLiteral("/.media/")));
+    }
+    if (pages.isEmpty()) {
+        return;
+    }
+
+    const bool ok = SqlWriter::exec<bool>([&] () -> bool {
+        QSqlDatabase db = SqlWriter::database();
+        if (!db.transaction()) {
+            return false;
+        }
+
+        QSqlQuery update = CPreparedSqlQueryThreadForDB(QStringLiteral("UPDATE posts SET html = :html WHERE id = :id"),
+                                                        QStringLiteral("cmlyst"));
+        auto it = pages.constBegin();
+        while (it != pages.constEnd()) {
+            update.bindValue(QStringLiteral(":html"), it.value());
+            update.bindValue(QStringLiteral(":id"), it.key());
+            if (!SqlTrace::exec(update)) {
+                qWarning() << "Failed to update page html" << it.key() << update.lastError().databaseText();
+                db.rollback();
+                return false;
             }
+            ++it;
         }
 
-        menus.push_back(menu);
+        if (!touchContent() || !db.commit()) {
+            db.rollback();
+            return false;
+        }
+        return true;
+    });
 
-        ++it;
+    if (ok) {
+        Q_EMIT pagesChanged();
+    }
+}
+
+void SqlEngine::loadMenus()
+{
+    QHash<QString, CMS::Menu *> current;
+    for (CMS::Menu *menu : m_menus) {
+        current.insert(menu->id(), menu);
+    }
+
+    QList<CMS::Menu *> menus;
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, version FROM menus ORDER BY id"),
+                                                   QStringLiteral("cmlyst"));
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to list menus" << query.lastError().databaseText();
+        return;
+    }
+
+    // Only menus that are new or had their version changed are read
+    while (query.next()) {
+        const QString id = query.value(0).toString();
+        CMS::Menu *menu = current.take(id);
+        if (!menu) {
+            menu = new Menu(id, this);
+            loadMenu(menu);
+        } else if (menu->version() != query.value(1).toInt()) {
+            loadMenu(menu);
+        }
+        menus.push_back(menu);
     }
 
-    qDeleteAll(m_menus);
+    // What is left was removed
+    qDeleteAll(current);
+
+    QHash<QString, CMS::Menu *> menuLocations;
+    for (CMS::Menu *menu : menus) {
+        const QStringList locations = menu->locations();
+        for (const QString &location : locations) {
+            if (!menuLocations.contains(location)) {
+                menuLocations.insert(location, menu);
+            }
+        }
+    }
 
     m_menus = menus;
     m_menuLocations = menuLocations;
 }
 
-void SqlEngine::loadUsers()
+void SqlEngine::loadMenu(Menu *menu)
 {
-    m_users.clear();
-    m_usersSlug.clear();
-    m_usersId.clear();
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT id, slug, email, json "
-                                                                  "FROM users "),
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT name, locations, auto_add_pages, version "
+                                                                  "FROM menus WHERE id = :id"),
                                                    QStringLiteral("cmlyst"));
-    if (Q_LIKELY(query.exec())) {
+    query.bindValue(QStringLiteral(":id"), menu->id());
+    if (!SqlTrace::exec(query) || !query.next()) {
+        qWarning() << "Failed to load menu" << menu->id() << query.lastError().databaseText();
+        return;
+    }
+
+    menu->setName(query.value(0).toString());
+
+    QStringList locations;
+    const QJsonArray locationsJson = QJsonDocument::fromJson(query.value(1).toString().toUtf8()).array();
+    for (const QJsonValue &location : locationsJson) {
+        locations.append(location.toString());
+    }
+    menu->setLocations(locations);
+    menu->setAutoAddPages(query.value(2).toBool());
+    menu->setVersion(query.value(3).toInt());
+
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT text, url, attr FROM menu_entries "
+                                                        "WHERE menu_id = :id ORDER BY position"),
+                                         QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":id"), menu->id());
+    QList<QVariantHash> entries;
+    if (SqlTrace::exec(query)) {
         while (query.next()) {
-            QHash<QString, QString> user;
-
-            const QString id = query.value(0).toString();
-            user.insert(QStringLiteral("id"), id);
-            const QString slug = query.value(1).toString();
-            user.insert(QStringLiteral("slug"), slug);
-            user.insert(QStringLiteral("email"), query.value(2).toString());
-
-            QJsonDocument doc = QJsonDocument::fromJson(query.value(3).toString().toUtf8());
-            QJsonObject obj = doc.object();
-
-            const QStringList fields = {
-                QStringLiteral("name"),
-                QStringLiteral("bio"),
-                QStringLiteral("location"),
-                QStringLiteral("website"),
-                QStringLiteral("twitter"),
-                QStringLiteral("facebook"),
-                QStringLiteral("image"),
-                QStringLiteral("cover"),
-                QStringLiteral("url"),
-            };
-
-            for (const QString &field : fields) {
-                user.insert(field, obj.value(field).toString());
-            }
+            entries.append({
+                               {QStringLiteral("text"), query.value(0).toString()},
+                               {QStringLiteral("url"), query.value(1).toString()},
+                               {QStringLiteral("attr"), query.value(2).toString()}
+                           });
+        }
+    }
+    menu->setEntries(entries);
+}
 
-            m_users.push_back(QVariant::fromValue(user));
-            m_usersSlug.insert(slug, user);
-            m_usersId.insert(id.toInt(), user);
+void SqlEngine::syncUsers()
+{
+    if (m_usersLogSeq == -1) {
+        // Users cached before we knew where the log was may
+        // have changed since, start over from this point
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT COALESCE(MAX(seq), 0) FROM users_log"),
+                                                       QStringLiteral("cmlyst"));
+        if (SqlTrace::exec(query) && query.next()) {
+            m_usersLogSeq = query.value(0).toLongLong();
+            forgetUser(0);
         }
+        return;
+    }
+
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("SELECT seq, user_id FROM users_log "
+                                                                  "WHERE seq > :seq ORDER BY seq"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":seq"), m_usersLogSeq);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to read users log" << query.lastError().databaseText();
+        forgetUser(0);
+        return;
+    }
+
+    while (query.next()) {
+        const qint64 seq = query.value(0).toLongLong();
+        // A gap means the log was trimmed past what we have seen
+        if (seq != m_usersLogSeq + 1) {
+            forgetUser(0);
+        }
+        forgetUser(query.value(1).toInt());
+        m_usersLogSeq = seq;
+    }
+}
+
+QHash<QString, QString> SqlEngine::cacheUser(const QSqlQuery &query)
+{
+    QHash<QString, QString> user;
+
+    const QString id = query.value(0).toString();
+    user.insert(QStringLiteral("id"), id);
+    const QString slug = query.value(1).toString();
+    user.insert(QStringLiteral("slug"), slug);
+    user.insert(QStringLiteral("email"), query.value(2).toString());
+    user.insert(QStringLiteral("version"), query.value(4).toString());
+
+    QJsonDocument doc = QJsonDocument::fromJson(query.value(3).toString().toUtf8());
+    QJsonObject obj = doc.object();
+
+    static const QStringList fields = {
+        QStringLiteral("name"),
+        QStringLiteral("bio"),
+        QStringLiteral("location"),
+        QStringLiteral("website"),
+        QStringLiteral("twitter"),
+        QStringLiteral("facebook"),
+        QStringLiteral("image"),
+        QStringLiteral("cover"),
+        QStringLiteral("url"),
+    };
+
+    for (const QString &field : fields) {
+        user.insert(field, obj.value(field).toString());
+    }
+
+    m_usersSlug.insert(slug, id.toInt());
+    m_usersId.insert(id.toInt(), user);
+
+    return user;
+}
+
+void SqlEngine::forgetUser(int id)
+{
+    m_usersLoaded = false;
+    m_users.clear();
+    // The user may now own one of the slugs that had none
+    m_usersMissing.clear();
+
+    if (id == 0) {
+        m_usersSlug.clear();
+        m_usersId.clear();
+        return;
     }
+
+    const QString slug = m_usersId.take(id).value(QStringLiteral("slug"));
+    if (!slug.isEmpty()) {
+        m_usersSlug.remove(slug);
+    }
+}
+
+bool SqlEngine::logUserChange(int id)
+{
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(QStringLiteral("INSERT INTO users_log (user_id) VALUES (:user_id)"),
+                                                   QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":user_id"), id);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to log user change" << id << query.lastError().databaseText();
+        return false;
+    }
+
+    // Processes that are this far behind drop all users
+    const qint64 seq = query.lastInsertId().toLongLong();
+    query = CPreparedSqlQueryThreadForDB(QStringLiteral("DELETE FROM users_log WHERE seq <= :seq"),
+                                         QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":seq"), seq - 1000);
+    if (!SqlTrace::exec(query)) {
+        qWarning() << "Failed to trim users log" << query.lastError().databaseText();
+    }
+    return true;
 }
 
 void SqlEngine::configureView(Cutelyst::Context *c)
@@ -673,6 +1938,9 @@ void SqlEngine::configureView(Cutelyst::Context *c)
         const QDir themeDir = app->pathTo(QStringLiteral("root/themes"));
 
         view->setIncludePaths({ themeDir.absoluteFilePath(theme) });
+
+        // Menus get the same tag libraries and settings as the other templates
+        setMenuTemplates(view->engine());
     }
 }
 
@@ -729,3 +1997,131 @@ void SqlEngine::createDb()
         exit(1);
     }
 }
+
+void SqlEngine::upgradeDb()
+{
+    QSqlQuery query(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst"))));
+
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS media "
+                                   "( id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT "
+                                   ", path TEXT NOT NULL UNIQUE "
+                                   ", name TEXT NOT NULL "
+                                   ", size INTEGER NOT NULL "
+                                   ", mime TEXT "
+                                   ", width INTEGER "
+                                   ", height INTEGER "
+                                   ", hash TEXT "
+                                   ", uploaded_at datetime NOT NULL "
+                                   ")"))) {
+        qCritical() << "Error creating media table" << query.lastError().text();
+    }
+    addColumn(QStringLiteral("media"), QStringLiteral("variants"), QStringLiteral("TEXT"));
+
+    createSessionsTable();
+
+    // Bumped when credentials change, see SqlUserStore::fromSession()
+    addColumn(QStringLiteral("users"), QStringLiteral("version"), QStringLiteral("INTEGER NOT NULL DEFAULT 1"));
+
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS users_log "
+                                   "( seq INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT "
+                                   ", user_id INTEGER NOT NULL "
+                                   ")"))) {
+        qCritical() << "Error creating users_log table" << query.lastError().text();
+    }
+
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS menus "
+                                   "( id TEXT NOT NULL PRIMARY KEY "
+                                   ", name TEXT "
+                                   ", locations TEXT "
+                                   ", auto_add_pages INTEGER NOT NULL DEFAULT 0 "
+                                   ", version INTEGER NOT NULL DEFAULT 1 "
+                                   ")"))) {
+        qCritical() << "Error creating menus table" << query.lastError().text();
+    }
+
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS menu_entries "
+                                   "( menu_id TEXT NOT NULL REFERENCES menus(id) ON DELETE CASCADE "
+                                   ", position INTEGER NOT NULL "
+                                   ", text TEXT "
+                                   ", url TEXT "
+                                   ", attr TEXT "
+                                   ", PRIMARY KEY(menu_id, position) "
+                                   ")"))) {
+        qCritical() << "Error creating menu_entries table" << query.lastError().text();
+    }
+
+    // Which media each post shows, filled from the existing posts once
+    const bool hasMediaRefs = query.exec(QStringLiteral("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'media_refs'")) && query.next();
+    if (!query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS media_refs "
+                                   "( path TEXT NOT NULL "
+                                   ", post_id INTEGER NOT NULL "
+                                   ", PRIMARY KEY(path, post_id) "
+                                   ")"))) {
+        qCritical() << "Error creating media_refs table" << query.lastError().text();
+    } else if (!hasMediaRefs) {
+        QHash<int, QStringList> refs;
+        if (query.exec(QStringLiteral("SELECT id, content FROM posts WHERE content LIKE '%/.media/%'"))) {
+            while (query.next()) {
+                refs.insert(query.value(0).toInt(), Media::references(query.value(1).toString(), QStringLiteral("/.media/")));
+            }
+        }
+        auto it = refs.constBegin();
+        while (it != refs.constEnd()) {
+            writeMediaRefs(it.key(), it.value());
+            ++it;
+        }
+    }
+
+    // Menus used to be a JSON blob in settings
+    if (query.exec(QStringLiteral("SELECT value FROM settings WHERE key = 'menus'")) && query.next()) {
+        const QString menus = query.value(0).toString();
+        QSqlDatabase db = QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst")));
+        if (db.transaction()) {
+            if (importMenus(menus) && query.exec(QStringLiteral("DELETE FROM settings WHERE key = 'menus'"))) {
+                db.commit();
+                qDebug() << "Menus moved out of settings";
+            } else {
+                qCritical() << "Error moving menus out of settings" << query.lastError().text();
+                db.rollback();
+            }
+        }
+    }
+
+    // Cover the listings ORDER BY and WHERE clauses, IF NOT EXISTS
+    // makes this cheap for databases that already have them
+    const QStringList indexes = {
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_created_idx ON posts (page, created_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_updated_idx ON posts (page, updated_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_title_idx ON posts (page, title)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_page_published_idx ON posts (page, published, published_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS posts_author_idx ON posts (author_id, page, published, created_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_uploaded_idx ON media (uploaded_at)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_hash_idx ON media (hash)"),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS media_refs_post_idx ON media_refs (post_id)"),
+    };
+
+    for (const QString &index : indexes) {
+        if (!query.exec(index)) {
+            qWarning() << "Failed to create index" << index << query.lastError().databaseText();
+        }
+    }
+}
+
+void SqlEngine::addColumn(const QString &table, const QString &column, const QString &definition)
+{
+    QSqlQuery query(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst"))));
+    if (!query.exec(QLatin1String("PRAGMA table_info(") + table + QLatin1Char(')'))) {
+        qWarning() << "Failed to get table info" << table << query.lastError().databaseText();
+        return;
+    }
+
+    while (query.next()) {
+        if (query.value(1).toString() == column) {
+            return;
+        }
+    }
+
+    if (!query.exec(QLatin1String("ALTER TABLE ") + table + QLatin1String(" ADD COLUMN ") + column + QLatin1Char(' ') + definition)) {
+        qCritical() << "Error adding column" << table << column << query.lastError().text();
+    }
+}
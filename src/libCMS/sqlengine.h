@@ -4,10 +4,13 @@
 #include <QObject>
 #include <QDateTime>
 #include <QTimeZone>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QThreadPool>
+#include <QSet>
 
 #include "engine.h"
-
-class QSqlQuery;
+#include "sqlprofile.h"
 
 namespace Cutelyst {
 class Context;
@@ -24,8 +27,21 @@ public:
 
     virtual bool init(const QHash<QString, QString> &settings) override;
 
+    /**
+     * Opens only what SqlSessionStore needs, for nodes whose
+     * content comes from another engine
+     */
+    static bool initSessions(const QHash<QString, QString> &settings);
+
     virtual Page *getPage(const QString &path, QObject *parent) override;
 
+    /**
+     * True when init() got "readerThreads", the async methods
+     * then run their query on one of those threads
+     */
+    virtual bool isAsync() const override;
+    virtual void getPageAsync(const QString &path, QObject *parent, PageCallback cb) override;
+
     virtual Page *getPageById(const QString &id, QObject *parent) override;
 
     virtual bool removePage(int id) override;
@@ -55,15 +71,31 @@ public:
                                                    int offset,
                                                    int limit) override;
 
+    virtual void listPostsPublishedAsync(QObject *parent, int authorId, int offset, int limit, PagesCallback cb) override;
+
+    virtual QList<Page *> listPagesSummary(QObject *parent,
+                                           Filters filters,
+                                           int authorId,
+                                           SortField sort,
+                                           Qt::SortOrder order,
+                                           int offset,
+                                           int limit) override;
+    virtual void listPagesSummaryAsync(QObject *parent, Filters filters, int authorId, SortField sort, Qt::SortOrder order, int offset, int limit, PagesCallback cb) override;
+
+    virtual int countPages(Filters filters, int authorId) override;
+    virtual void countPagesAsync(Filters filters, int authorId, QObject *receiver, CountCallback cb) override;
+
     virtual QHash<QString, QString> settings() const override;
 
     virtual QString settingsValue(const QString &key, const QString &defaultValue = QString()) const override;
     virtual bool setSettingsValue(Cutelyst::Context *c, const QString &key, const QString &value) override;
+    virtual bool setSettingsValues(Cutelyst::Context *c, const QHash<QString, QString> &values) override;
 
     virtual QList<Menu *> menus() override;
 
     virtual bool saveMenu(Cutelyst::Context *c, Menu *menu, bool replace) override;
     virtual bool removeMenu(Cutelyst::Context *c, const QString &name) override;
+    virtual bool addMenuEntry(Cutelyst::Context *c, Menu *menu, const QString &text, const QString &url) override;
 
     virtual QHash<QString, Menu *> menuLocations() override;
 
@@ -71,33 +103,98 @@ public:
 
     QHash<QString, QString> loadSettings(Cutelyst::Context *c) override;
 
+    /**
+     * Loads what requests would otherwise load lazily, so
+     * the first ones after a fork don't pay for it
+     */
+    void warmup(Cutelyst::Context *c);
+
     virtual QDateTime lastModified() override;
+    virtual qint64 contentVersion(Cutelyst::Context *c) override;
+
+    /**
+     * Returns SQLite's data_version for this thread's connection,
+     * it only changes when other connections commit, read once
+     * per request
+     */
+    static qint64 dataVersion(Cutelyst::Context *c);
 
     virtual QString addUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &user, bool replace) override;
     virtual bool removeUser(Cutelyst::Context *c, int id) override;
+    virtual QString updateUser(Cutelyst::Context *c, const QString &slug, const Cutelyst::ParamsMultiMap &user) override;
+    virtual bool invalidateUser(Cutelyst::Context *c, int id) override;
     virtual QVariantList users() override;
     virtual QHash<QString, QString> user(const QString &slug) override;
     virtual QHash<QString, QString> user(int id) override;
+    virtual QHash<QString, QString> credentials(const QString &email) override;
+    virtual bool setPassword(Cutelyst::Context *c, int id, const QString &oldHash, const QString &newHash) override;
+
+    virtual bool addMedia(const QVariantHash &media) override;
+    virtual bool removeMedia(const QString &path) override;
+    virtual QVariantHash media(const QString &path) override;
+    virtual QVariantHash mediaByHash(const QString &hash) override;
+    virtual bool setMediaVariants(const QString &hash, const QVariantList &variants) override;
+    virtual void updateMediaHtml(const QString &hash) override;
+    virtual QVariantList listMedia(int offset, int limit) override;
+    virtual int countMedia() override;
 
 private:
     virtual int savePageBackend(Page *page) override;
 
     void loadMenus();
-    void loadUsers();
+    void loadMenu(Menu *menu);
+    bool writeMenu(Menu *menu, bool replace);
+    bool importMenus(const QString &json);
+    bool writeSettings(const QHash<QString, QString> &values);
+    qint64 commitModified(qint64 *previous);
+    bool menusCommitted(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime);
+    bool usersCommitted(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime);
+    bool keepSettings(Cutelyst::Context *c, qint64 previous, qint64 currentDateTime);
+    QString writeUser(const Cutelyst::ParamsMultiMap &user, bool replace, qint64 *previous, qint64 *modified);
+    void syncUsers();
+    QHash<QString, QString> cacheUser(const QSqlQuery &query);
+    void forgetUser(int id);
+    bool logUserChange(int id);
     void configureView(Cutelyst::Context *c);
     void createDb();
-    Page *createPageObj(const QSqlQuery &query, QObject *parent);
+    void upgradeDb();
+    /**
+     * Replaces the media references of \p postId, runs on the writer
+     */
+    bool writeMediaRefs(int postId, const QStringList &paths);
+    /**
+     * Bumps the content_version setting, runs on the writer
+     * inside the transaction that changed posts
+     */
+    bool touchContent();
+    void addColumn(const QString &table, const QString &column, const QString &definition);
+    Page *createPageObj(const QSqlRecord &query, QObject *parent, bool content = true);
+    QVariantHash createMediaHash(const QSqlQuery &query) const;
+    QDateTime dateTimeValue(const QVariant &value) const;
+
+    /**
+     * Runs \p query on a reader thread, then \p done on ours
+     * unless \p receiver was destroyed meanwhile
+     */
+    void read(QObject *receiver, std::function<void()> query, std::function<void()> done);
 
     QString m_theme;
     QVariantList m_users;
-    QHash<QString, QHash<QString, QString> > m_usersSlug;
+    QHash<QString, int> m_usersSlug;
+    QSet<QString> m_usersMissing;
     QHash<int, QHash<QString, QString> > m_usersId;
+    qint64 m_usersLogSeq = -1;
+    bool m_usersLoaded = false;
     QHash<QString, QString> m_settings;
     QDateTime m_settingsDateTime;
     QTimeZone m_timezone;
     qint64 m_settingsDate = -1;
+    qint64 m_settingsDataVersion = -1;
     QList<CMS::Menu *> m_menus;
     QHash<QString, CMS::Menu *> m_menuLocations;
+    QString m_dbPath;
+    SqlProfile m_profile;
+    QThreadPool *m_readers = nullptr;
 };
 
 }
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "sqlprofile.h"
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+using namespace CMS;
+
+namespace {
+
+struct Pragma {
+    const char *name;
+    const char *defaultValue;
+    QStringList keywords;
+};
+
+// Tuned for a WAL database read far more often than written,
+// NORMAL only risks the last commits on power loss, never corruption
+const QList<Pragma> &pragmas()
+{
+    static const QList<Pragma> list = {
+        {"mmap_size", "268435456", {}},
+        {"cache_size", "-16384", {}},
+        {"synchronous", "NORMAL", {QStringLiteral("OFF"), QStringLiteral("NORMAL"), QStringLiteral("FULL"), QStringLiteral("EXTRA")}},
+        {"busy_timeout", "5000", {}},
+        {"temp_store", "MEMORY", {QStringLiteral("DEFAULT"), QStringLiteral("FILE"), QStringLiteral("MEMORY")}},
+        {"wal_autocheckpoint", "1000", {}},
+    };
+    return list;
+}
+
+bool isValid(const Pragma &pragma, const QString &value)
+{
+    bool ok;
+    value.toLongLong(&ok);
+    return ok || pragma.keywords.contains(value.toUpper());
+}
+
+}
+
+SqlProfile::SqlProfile(const QHash<QString, QString> &settings)
+{
+    for (const Pragma &pragma : pragmas()) {
+        const QString name = QString::fromLatin1(pragma.name);
+        QString value = settings.value(name).trimmed();
+        if (value.isEmpty()) {
+            value = QString::fromLatin1(pragma.defaultValue);
+        } else if (!isValid(pragma, value)) {
+            qWarning() << "Invalid SQLite" << name << value << "using" << pragma.defaultValue;
+            value = QString::fromLatin1(pragma.defaultValue);
+        }
+        m_pragmas.append(qMakePair(name, value));
+    }
+}
+
+QStringList SqlProfile::names()
+{
+    QStringList ret;
+    for (const Pragma &pragma : pragmas()) {
+        ret.append(QString::fromLatin1(pragma.name));
+    }
+    return ret;
+}
+
+bool SqlProfile::apply(QSqlDatabase &db) const
+{
+    QSqlQuery query(db);
+
+    // createDb only sets it for new databases, read-only
+    // connections can't change it and just follow the file
+    if (!db.connectOptions().contains(QLatin1String("QSQLITE_OPEN_READONLY"))
+            && !query.exec(QStringLiteral("PRAGMA journal_mode = WAL"))) {
+        qWarning() << "Failed to set SQLite journal_mode" << query.lastError().databaseText();
+    }
+
+    bool ret = true;
+    QStringList effective;
+    for (const auto &pragma : m_pragmas) {
+        if (!query.exec(QLatin1String("PRAGMA ") + pragma.first + QLatin1String(" = ") + pragma.second)) {
+            qWarning() << "Failed to set SQLite" << pragma.first << pragma.second << query.lastError().databaseText();
+            ret = false;
+        }
+
+        // mmap_size is capped at compile time, so read back what was applied
+        if (query.exec(QLatin1String("PRAGMA ") + pragma.first) && query.next()) {
+            effective.append(pragma.first + QLatin1Char('=') + query.value(0).toString());
+        }
+    }
+    qInfo().noquote() << "SQLite profile" << db.connectionName() << effective.join(QLatin1Char(' '));
+
+    return ret;
+}
@@ -0,0 +1,57 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_SQLPROFILE_H
+#define CMS_SQLPROFILE_H
+
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+
+class QSqlDatabase;
+
+namespace CMS {
+
+/**
+ * The PRAGMAs applied to every SQLite connection right after
+ * it's opened, keyed by PRAGMA name, missing ones get the defaults
+ */
+class SqlProfile
+{
+public:
+    explicit SqlProfile(const QHash<QString, QString> &settings = QHash<QString, QString>());
+
+    /**
+     * Returns the PRAGMA names that can be configured
+     */
+    static QStringList names();
+
+    /**
+     * Applies the profile to the open connection \p db
+     * and logs the values SQLite reports back
+     */
+    bool apply(QSqlDatabase &db) const;
+
+private:
+    QList<QPair<QString, QString>> m_pragmas;
+};
+
+}
+
+#endif // CMS_SQLPROFILE_H
@@ -0,0 +1,246 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "sqltrace.h"
+#include "metrics.h"
+
+#include <Cutelyst/Plugins/Utils/Sql>
+
+#include <QSqlDatabase>
+#include <QVariant>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QCryptographicHash>
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(CMLYST_SQL, "cmlyst.sql")
+// Values hold session data, password hashes and emails, so they
+// are only logged when this is enabled with QT_LOGGING_RULES
+Q_LOGGING_CATEGORY(CMLYST_SQL_VALUES, "cmlyst.sql.values", QtWarningMsg)
+
+using namespace CMS;
+
+namespace {
+
+struct Statement {
+    QString sql;
+    QByteArray id;
+    QByteArray metric;
+    quint64 count = 0;
+    quint64 slow = 0;
+    qint64 total = 0;
+    qint64 max = 0;
+    qint64 explainedAt = 0;
+};
+
+QMutex s_mutex;
+QHash<QString, Statement> s_statements;
+std::atomic<qint64> s_threshold(100 * 1000000LL);
+thread_local qint64 s_threadTime = 0;
+// The request being handled, reset when another one starts
+thread_local QPointer<QObject> s_receiver;
+
+// A slow statement has its plan logged at most once per minute
+const qint64 ExplainInterval = 60000;
+
+/**
+ * Describes the bound values without showing them
+ */
+QString redacted(const QMap<QString, QVariant> &values)
+{
+    QStringList ret;
+    auto it = values.constBegin();
+    while (it != values.constEnd()) {
+        const QVariant &value = it.value();
+        if (value.isNull()) {
+            ret.append(it.key() + QLatin1String(" null"));
+        } else {
+            ret.append(it.key() + QLatin1Char(' ') + QLatin1String(value.typeName())
+                       + QLatin1Char('(') + QString::number(value.toString().size()) + QLatin1Char(')'));
+        }
+        ++it;
+    }
+    return ret.join(QLatin1String(", "));
+}
+
+void explain(const QSqlQuery &query)
+{
+    QSqlQuery plan(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst"))));
+    if (!plan.prepare(QLatin1String("EXPLAIN QUERY PLAN ") + query.lastQuery())) {
+        qCWarning(CMLYST_SQL) << "Failed to prepare query plan" << plan.lastError().databaseText();
+        return;
+    }
+
+    const QMap<QString, QVariant> values = query.boundValues();
+    auto it = values.constBegin();
+    while (it != values.constEnd()) {
+        plan.bindValue(it.key(), it.value());
+        ++it;
+    }
+
+    if (!plan.exec()) {
+        qCWarning(CMLYST_SQL) << "Failed to get query plan" << plan.lastError().databaseText();
+        return;
+    }
+
+    while (plan.next()) {
+        // id, parent, notused, detail
+        qCWarning(CMLYST_SQL).noquote() << "  plan:" << plan.value(3).toString();
+    }
+}
+
+}
+
+bool SqlTrace::exec(QSqlQuery &query)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const bool ret = query.exec();
+    const qint64 elapsed = timer.nsecsElapsed();
+    s_threadTime += elapsed;
+    if (s_receiver) {
+        addTime(s_receiver, elapsed);
+    }
+
+    const qint64 threshold = s_threshold.load();
+    const bool slow = threshold > 0 && elapsed >= threshold;
+    bool explainPlan = false;
+    QByteArray id;
+    QByteArray metric;
+    {
+        const QString sql = query.lastQuery();
+
+        QMutexLocker locker(&s_mutex);
+        Statement &statement = s_statements[sql];
+        if (statement.metric.isNull()) {
+            statement.sql = sql.simplified();
+            // Statements share long column lists, so the series is keyed
+            // by a hash of the whole text, /.admin/queries maps it back
+            statement.id = QCryptographicHash::hash(statement.sql.toUtf8(), QCryptographicHash::Sha1).toHex().left(12);
+            statement.metric = "cmlyst_sql_duration_seconds{statement=\"" + statement.id + "\"}";
+        }
+        ++statement.count;
+        statement.total += elapsed;
+        statement.max = qMax(statement.max, elapsed);
+
+        if (slow) {
+            ++statement.slow;
+            const qint64 now = QDateTime::currentMSecsSinceEpoch();
+            if (now - statement.explainedAt >= ExplainInterval) {
+                statement.explainedAt = now;
+                explainPlan = true;
+            }
+        }
+        id = statement.id;
+        metric = statement.metric;
+    }
+
+    Metrics::observe(metric, elapsed);
+
+    if (slow) {
+        qCWarning(CMLYST_SQL).noquote() << "Slow query" << id << QString::number(elapsed / 1e6, 'f', 2) << "ms:"
+                                        << query.lastQuery().simplified();
+        qCWarning(CMLYST_SQL).noquote() << "  values:" << redacted(query.boundValues());
+        qCDebug(CMLYST_SQL_VALUES) << "  values:" << query.boundValues();
+        if (explainPlan) {
+            explain(query);
+        }
+    }
+
+    return ret;
+}
+
+void SqlTrace::setSlowThreshold(int msecs)
+{
+    s_threshold = qint64(qMax(0, msecs)) * 1000000LL;
+}
+
+qint64 SqlTrace::threadTime()
+{
+    return s_threadTime;
+}
+
+void SqlTrace::addThreadTime(qint64 nsecs)
+{
+    s_threadTime += nsecs;
+    if (s_receiver) {
+        addTime(s_receiver, nsecs);
+    }
+}
+
+void SqlTrace::addTime(QObject *receiver, qint64 nsecs)
+{
+    receiver->setProperty("_sql_time", time(receiver) + nsecs);
+}
+
+qint64 SqlTrace::time(const QObject *receiver)
+{
+    return receiver->property("_sql_time").toLongLong();
+}
+
+void SqlTrace::setReceiver(QObject *receiver)
+{
+    s_receiver = receiver;
+}
+
+SqlTrace::ReceiverScope::ReceiverScope(QObject *receiver) : m_previous(s_receiver)
+{
+    s_receiver = receiver;
+}
+
+SqlTrace::ReceiverScope::~ReceiverScope()
+{
+    s_receiver = m_previous;
+}
+
+QByteArray SqlTrace::report()
+{
+    QVector<Statement> statements;
+    {
+        QMutexLocker locker(&s_mutex);
+        statements.reserve(s_statements.size());
+        for (const Statement &statement : s_statements) {
+            statements.append(statement);
+        }
+    }
+
+    std::sort(statements.begin(), statements.end(), [] (const Statement &a, const Statement &b) {
+        return a.total > b.total;
+    });
+
+    QByteArray ret = "     count   total ms     avg ms     max ms    slow  id            statement\n";
+    for (const Statement &statement : statements) {
+        ret += QByteArray::number(statement.count).rightJustified(10) + ' ' +
+                QByteArray::number(statement.total / 1e6, 'f', 2).rightJustified(10) + ' ' +
+                QByteArray::number(statement.total / 1e6 / qMax<quint64>(1, statement.count), 'f', 3).rightJustified(10) + ' ' +
+                QByteArray::number(statement.max / 1e6, 'f', 3).rightJustified(10) + ' ' +
+                QByteArray::number(statement.slow).rightJustified(7) + "  " +
+                statement.id + "  " + statement.sql.toUtf8() + '\n';
+    }
+    return ret;
+}
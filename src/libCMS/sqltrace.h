@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_SQLTRACE_H
+#define CMS_SQLTRACE_H
+
+#include <QByteArray>
+#include <QPointer>
+
+class QSqlQuery;
+
+namespace CMS {
+
+/**
+ * Times prepared statements, statements slower than the
+ * threshold are logged with their query plan and the names,
+ * types and sizes of their bound values, the values themselves
+ * only with the cmlyst.sql.values debug category enabled
+ */
+class SqlTrace
+{
+public:
+    /**
+     * Executes \p query recording its time per statement
+     */
+    static bool exec(QSqlQuery &query);
+
+    /**
+     * Statements taking \p msecs or more are logged, 0 disables it
+     */
+    static void setSlowThreshold(int msecs);
+
+    /**
+     * Returns the nanoseconds spent executing statements
+     * on the calling thread since it started
+     */
+    static qint64 threadTime();
+
+    /**
+     * Adds \p nsecs another thread spent on statements to the
+     * calling thread's time, which waited for them
+     */
+    static void addThreadTime(qint64 nsecs);
+
+    /**
+     * Adds \p nsecs a reader thread spent on statements for
+     * \p receiver, the Context the query ran for
+     */
+    static void addTime(QObject *receiver, qint64 nsecs);
+
+    /**
+     * Returns the time added to \p receiver by addTime()
+     */
+    static qint64 time(const QObject *receiver);
+
+    /**
+     * Statements run on the calling thread are also added to
+     * \p receiver with addTime() until another one is set,
+     * nullptr stops it
+     */
+    static void setReceiver(QObject *receiver);
+
+    /**
+     * Sets the receiver while a detached request runs again,
+     * the previous one is restored when it goes out of scope
+     */
+    class ReceiverScope
+    {
+    public:
+        explicit ReceiverScope(QObject *receiver);
+        ~ReceiverScope();
+
+    private:
+        QPointer<QObject> m_previous;
+    };
+
+    /**
+     * Returns a text table with the totals of each
+     * statement run by this process, slowest first,
+     * along with the id its metrics are labelled with
+     */
+    static QByteArray report();
+};
+
+}
+
+#endif // CMS_SQLTRACE_H
@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "sqlwriter.h"
+#include "sqltrace.h"
+
+#include <Cutelyst/Plugins/Utils/Sql>
+
+#include <QSqlError>
+#include <QThread>
+#include <QMutex>
+#include <QDebug>
+
+#include <atomic>
+
+using namespace CMS;
+
+namespace {
+
+QMutex s_mutex;
+std::atomic<QObject *> s_receiver(nullptr);
+
+}
+
+bool SqlWriter::start(const QString &dbPath, const SqlProfile &profile)
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_receiver.load()) {
+        return true;
+    }
+
+    auto thread = new QThread;
+    thread->setObjectName(QStringLiteral("cmlyst-writer"));
+    thread->start();
+
+    auto receiver = new QObject;
+    receiver->moveToThread(thread);
+
+    bool ok = false;
+    QMetaObject::invokeMethod(receiver, [dbPath, &profile, &ok] {
+        auto db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst")));
+        db.setDatabaseName(dbPath);
+        ok = db.open();
+        if (ok) {
+            profile.apply(db);
+        } else {
+            qCritical() << "Error opening the writer database" << dbPath << db.lastError().databaseText();
+        }
+    }, Qt::BlockingQueuedConnection);
+
+    if (!ok) {
+        thread->quit();
+        thread->wait();
+        delete receiver;
+        delete thread;
+        return false;
+    }
+
+    // Lives as long as the process
+    s_receiver = receiver;
+    return true;
+}
+
+void SqlWriter::exec(const std::function<void ()> &job)
+{
+    QObject *receiver = s_receiver.load();
+    if (!receiver || QThread::currentThread() == receiver->thread()) {
+        job();
+        return;
+    }
+
+    // The caller waits for it, so the writer's time counts as its own
+    qint64 elapsed = 0;
+    QMetaObject::invokeMethod(receiver, [&job, &elapsed] {
+        const qint64 start = SqlTrace::threadTime();
+        job();
+        elapsed = SqlTrace::threadTime() - start;
+    }, Qt::BlockingQueuedConnection);
+    SqlTrace::addThreadTime(elapsed);
+}
+
+QSqlDatabase SqlWriter::database()
+{
+    return QSqlDatabase::database(Cutelyst::Sql::databaseNameThread(QStringLiteral("cmlyst")));
+}
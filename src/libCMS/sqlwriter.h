@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef CMS_SQLWRITER_H
+#define CMS_SQLWRITER_H
+
+#include <QSqlDatabase>
+
+#include "sqlprofile.h"
+
+#include <functional>
+
+namespace CMS {
+
+/**
+ * Owns the only read-write SQLite connection of the process, on
+ * a thread of its own. Writes are queued to it and run one at a
+ * time, the worker and reader connections are opened read-only
+ */
+class SqlWriter
+{
+public:
+    /**
+     * Starts the writer thread with its connection to \p dbPath
+     * configured with \p profile, once started further calls
+     * just return true
+     */
+    static bool start(const QString &dbPath, const SqlProfile &profile);
+
+    /**
+     * Runs \p job on the writer thread and waits for it, jobs run
+     * in the order they were queued. Inside a job prepared queries
+     * of the "cmlyst" thread connection use the writer's.
+     * Without a writer, e.g. in tools, it runs on the calling thread
+     */
+    static void exec(const std::function<void()> &job);
+
+    template <typename T>
+    static T exec(const std::function<T()> &job)
+    {
+        T ret = T();
+        exec([&ret, &job] {
+            ret = job();
+        });
+        return ret;
+    }
+
+    /**
+     * Returns the read-write connection, only valid inside a job
+     */
+    static QSqlDatabase database();
+};
+
+}
+
+#endif // CMS_SQLWRITER_H
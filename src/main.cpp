@@ -16,10 +16,96 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
 
 #include <Cutelyst/Server/server.h>
 
 #include "cmlyst.h"
+#include "cmengine.h"
+#include "staticexport.h"
+
+#include "libCMS/packengine.h"
+
+/**
+ * Renders the whole site to a directory and/or a pack and exits
+ */
+static int exportSite(QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Renders the site to files a web server can serve"));
+    parser.addHelpOption();
+    const QCommandLineOption exportOpt(QStringLiteral("export"), QStringLiteral("Directory the files are written to."), QStringLiteral("dir"));
+    const QCommandLineOption iniOpt(QStringLiteral("ini"), QStringLiteral("Configuration file of the site."), QStringLiteral("file"));
+    const QCommandLineOption baseUrlOpt(QStringLiteral("base-url"), QStringLiteral("Address the site is published at, defaults to StaticExportBaseUrl."), QStringLiteral("url"));
+    const QCommandLineOption packOpt(QStringLiteral("export-pack"), QStringLiteral("Pack file for read-only replicas."), QStringLiteral("file"));
+    parser.addOptions({ exportOpt, iniOpt, baseUrlOpt, packOpt });
+    parser.process(app);
+
+    if (!parser.isSet(exportOpt) && !parser.isSet(packOpt)) {
+        parser.showHelp(1);
+    }
+
+    QVariantMap config;
+    if (parser.isSet(iniOpt)) {
+        config = Cutelyst::Engine::loadIniConfig(QFileInfo(parser.value(iniOpt)).absoluteFilePath());
+    }
+    const QString dir = QFileInfo(parser.value(exportOpt)).absoluteFilePath();
+
+    // Like --chdir2 of the server, themes are found from there
+    QDir::setCurrent(QStringLiteral(CMLYST_ROOT));
+
+    auto cmlyst = new CMlyst;
+    ExportEngine engine(cmlyst);
+    engine.setConfig(config);
+    if (!engine.init()) {
+        qCritical() << "Failed to initialize the application";
+        return 1;
+    }
+
+    auto cms = dynamic_cast<CMEngine *>(cmlyst->controller(QStringLiteral("Root")));
+    if (!cms || !cms->engine) {
+        qCritical() << "Application has no CMS engine";
+        return 1;
+    }
+
+    if (parser.isSet(packOpt)) {
+        const QString packFile = QFileInfo(parser.value(packOpt)).absoluteFilePath();
+        QElapsedTimer timer;
+        timer.start();
+        if (!CMS::PackEngine::write(cms->engine, packFile)) {
+            return 1;
+        }
+        qDebug() << "Pack written to" << packFile << "in" << timer.elapsed() << "ms";
+
+        if (!parser.isSet(exportOpt)) {
+            return 0;
+        }
+    }
+
+    QString baseUrl = parser.value(baseUrlOpt);
+    if (baseUrl.isEmpty()) {
+        baseUrl = cmlyst->config(QStringLiteral("StaticExportBaseUrl"), QStringLiteral("http://localhost")).toString();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int ret = 1;
+    StaticExport staticExport(cmlyst, cms->engine, dir, QUrl(baseUrl));
+    QObject::connect(&staticExport, &StaticExport::finished, &app, [&app, &ret] (bool ok) {
+        ret = ok ? 0 : 1;
+        app.quit();
+    });
+    staticExport.update();
+    app.exec();
+
+    qDebug() << "Site exported to" << dir << "in" << timer.elapsed() << "ms";
+    return ret;
+}
 
 int main(int argc, char *argv[])
 {
@@ -36,6 +122,11 @@ int main(int argc, char *argv[])
 
     QCoreApplication app(argc, argv);
 
+    const QStringList arguments = app.arguments();
+    if (arguments.contains(QStringLiteral("--export")) || arguments.contains(QStringLiteral("--export-pack"))) {
+        return exportSite(app);
+    }
+
     server.parseCommandLine(app.arguments());
 
     return server.exec(new CMlyst{});
@@ -0,0 +1,321 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "mediaserver.h"
+
+#include <Cutelyst/Application>
+
+#include "libCMS/media.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QRegularExpression>
+#include <QStringBuilder>
+
+namespace {
+
+// The server copies a QByteArray body into its write buffer,
+// so only small files are mapped, bigger ones are streamed
+const qint64 maxMapped = 256 * 1024;
+
+/**
+ * Reads \p length bytes of \p file from \p start, for
+ * ranges too big to be mapped
+ */
+class RangeDevice : public QIODevice
+{
+public:
+    RangeDevice(QFile *file, qint64 start, qint64 length, QObject *parent)
+        : QIODevice(parent)
+        , m_file(file)
+        , m_start(start)
+        , m_length(length)
+    {
+        m_file->seek(m_start);
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    bool isSequential() const override
+    {
+        return false;
+    }
+
+    qint64 size() const override
+    {
+        return m_length;
+    }
+
+    bool seek(qint64 pos) override
+    {
+        return QIODevice::seek(pos) && m_file->seek(m_start + pos);
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        maxSize = qMin(maxSize, m_length - pos());
+        if (maxSize <= 0) {
+            return 0;
+        }
+        return m_file->read(data, maxSize);
+    }
+
+    qint64 writeData(const char *data, qint64 maxSize) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(maxSize)
+        return -1;
+    }
+
+private:
+    QFile *m_file;
+    qint64 m_start;
+    qint64 m_length;
+};
+
+// Stored content and its variants, other files under objects/
+// like in-progress uploads are never served
+const QRegularExpression objectRe(QStringLiteral("^objects/([0-9a-f]{2})/\\1[0-9a-f]{62}(-(\\d+w|thumb)\\.(png|jpg))?$"));
+
+enum RangeResult {
+    RangeNone,
+    RangeSatisfiable,
+    RangeNotSatisfiable
+};
+
+// Only single byte ranges are honored, anything else
+// gets the whole file as the RFC allows
+RangeResult parseRange(const QString &range, qint64 size, qint64 &start, qint64 &end)
+{
+    if (!range.startsWith(QLatin1String("bytes=")) || range.contains(QLatin1Char(','))) {
+        return RangeNone;
+    }
+
+    const QStringRef spec = range.midRef(6).trimmed();
+    const int dash = spec.indexOf(QLatin1Char('-'));
+    if (dash == -1) {
+        return RangeNone;
+    }
+
+    bool ok;
+    if (dash == 0) {
+        // Suffix range, the last N bytes
+        const qint64 suffix = spec.mid(1).toLongLong(&ok);
+        if (!ok || suffix < 0) {
+            return RangeNone;
+        }
+        if (suffix == 0 || size == 0) {
+            return RangeNotSatisfiable;
+        }
+        start = qMax<qint64>(0, size - suffix);
+        end = size - 1;
+        return RangeSatisfiable;
+    }
+
+    start = spec.left(dash).toLongLong(&ok);
+    if (!ok || start < 0) {
+        return RangeNone;
+    }
+
+    const QStringRef last = spec.mid(dash + 1);
+    if (last.isEmpty()) {
+        end = size - 1;
+    } else {
+        end = last.toLongLong(&ok);
+        if (!ok || end < start) {
+            return RangeNone;
+        }
+        end = qMin(end, size - 1);
+    }
+
+    if (start >= size) {
+        return RangeNotSatisfiable;
+    }
+    return RangeSatisfiable;
+}
+
+bool etagMatches(const QString &header, const QString &etag)
+{
+    const QStringList tags = header.split(QLatin1Char(','));
+    for (const QString &tag : tags) {
+        QString value = tag.trimmed();
+        if (value == QLatin1String("*")) {
+            return true;
+        }
+        if (value.startsWith(QLatin1String("W/"))) {
+            value.remove(0, 2);
+        }
+        if (value == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+MediaServer::MediaServer(QObject *app) : Controller(app)
+{
+}
+
+MediaServer::~MediaServer()
+{
+}
+
+void MediaServer::file(Context *c, const QStringList &path)
+{
+    const static QDir mediaDir(c->config(QStringLiteral("DataLocation")).toString() + QLatin1String("/media"));
+    const static QString cacheControl = QLatin1String("public, max-age=") +
+            QString::number(c->config(QStringLiteral("MediaCacheMaxAge"), 2592000).toInt());
+
+    Response *res = c->response();
+
+    for (const QString &part : path) {
+        if (part.isEmpty() || part == QLatin1String("..") || part == QLatin1String(".")) {
+            res->setStatus(Response::NotFound);
+            return;
+        }
+    }
+    const QString mediaPath = path.join(QLatin1Char('/'));
+
+    QString objectPath;
+    QString etag;
+    QString mime;
+    QDateTime lastModified;
+    bool immutable = false;
+    if (mediaPath.startsWith(QLatin1String("objects/"))) {
+        if (!objectRe.match(mediaPath).hasMatch()) {
+            res->setStatus(Response::NotFound);
+            return;
+        }
+
+        // Stored content and variants are named after their
+        // content hash so they never change
+        objectPath = mediaPath;
+        etag = QFileInfo(mediaPath).completeBaseName();
+        immutable = true;
+    } else {
+        const QVariantHash media = engine->media(mediaPath);
+        const QString hash = media.value(QStringLiteral("hash")).toString();
+        if (!hash.isEmpty()) {
+            objectPath = CMS::Media::objectPath(hash);
+            etag = hash;
+            mime = media.value(QStringLiteral("mime")).toString();
+            lastModified = media.value(QStringLiteral("uploaded_at")).toDateTime();
+        } else {
+            // Files stored by name before the catalog existed keep
+            // working at their old URLs until they are reconciled
+            const QFileInfo legacy(mediaDir.absoluteFilePath(mediaPath));
+            if (!legacy.isFile()) {
+                res->setStatus(Response::NotFound);
+                return;
+            }
+            objectPath = mediaPath;
+            etag = QString::number(legacy.lastModified().toMSecsSinceEpoch(), 16) + QLatin1Char('-')
+                    + QString::number(legacy.size(), 16);
+        }
+    }
+
+    auto file = new QFile(mediaDir.absoluteFilePath(objectPath), c);
+    if (!file->open(QIODevice::ReadOnly)) {
+        res->setStatus(Response::NotFound);
+        return;
+    }
+
+    if (mime.isEmpty()) {
+        static QMimeDatabase db;
+        mime = db.mimeTypeForFile(file->fileName()).name();
+    }
+    if (!lastModified.isValid()) {
+        lastModified = QFileInfo(*file).lastModified();
+    }
+    etag = QLatin1Char('"') + etag + QLatin1Char('"');
+
+    Request *req = c->request();
+    Headers &headers = res->headers();
+    headers.setLastModified(lastModified);
+    headers.setHeader(QStringLiteral("ETag"), etag);
+    headers.setHeader(QStringLiteral("Cache-Control"), immutable ? cacheControl + QLatin1String(", immutable") : cacheControl);
+    headers.setHeader(QStringLiteral("Accept-Ranges"), QStringLiteral("bytes"));
+
+    const QString ifNoneMatch = req->headers().header(QStringLiteral("If-None-Match"));
+    if (!ifNoneMatch.isEmpty()) {
+        if (etagMatches(ifNoneMatch, etag)) {
+            res->setStatus(Response::NotModified);
+            return;
+        }
+    } else {
+        const QDateTime clientDate = req->headers().ifModifiedSinceDateTime();
+        if (clientDate.isValid() && lastModified.toSecsSinceEpoch() <= clientDate.toSecsSinceEpoch()) {
+            res->setStatus(Response::NotModified);
+            return;
+        }
+    }
+
+    headers.setContentType(mime);
+
+    const qint64 size = file->size();
+    qint64 start = 0;
+    qint64 end = size - 1;
+
+    const QString range = req->headers().header(QStringLiteral("Range"));
+    const QString ifRange = req->headers().header(QStringLiteral("If-Range"));
+    if (!range.isEmpty() && (ifRange.isEmpty() || ifRange == etag)) {
+        switch (parseRange(range, size, start, end)) {
+        case RangeSatisfiable:
+            res->setStatus(Response::PartialContent);
+            headers.setHeader(QStringLiteral("Content-Range"),
+                              QLatin1String("bytes ") % QString::number(start) % QLatin1Char('-') %
+                              QString::number(end) % QLatin1Char('/') % QString::number(size));
+            break;
+        case RangeNotSatisfiable:
+            res->setStatus(Response::RequestedRangeNotSatisfiable);
+            headers.setHeader(QStringLiteral("Content-Range"), QLatin1String("bytes */") + QString::number(size));
+            return;
+        case RangeNone:
+            break;
+        }
+    }
+
+    const qint64 length = end - start + 1;
+    if (length <= 0) {
+        res->setBody(QByteArray());
+        return;
+    }
+
+    // Small bodies are mapped instead of read, the mapping lives
+    // as long as the file which is owned by the context, so until
+    // the response is written
+    uchar *data = length <= maxMapped ? file->map(start, length) : nullptr;
+    if (data) {
+        res->setBody(QByteArray::fromRawData(reinterpret_cast<const char *>(data), int(length)));
+    } else if (length == size) {
+        res->setBody(file);
+    } else {
+        res->setBody(new RangeDevice(file, start, length, c));
+    }
+}
+
+bool MediaServer::End(Context *c)
+{
+    Q_UNUSED(c)
+    return true;
+}
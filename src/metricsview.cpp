@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "metricsview.h"
+
+#include <Cutelyst/Context>
+
+#include <QElapsedTimer>
+
+#include "servertiming.h"
+
+#include "libCMS/metrics.h"
+
+MetricsView::MetricsView(QObject *parent, const QString &name) : CuteleeView(parent, name)
+{
+}
+
+QByteArray MetricsView::render(Context *c) const
+{
+    ServerTiming::Scope timing(c, "render");
+
+    if (!CMS::Metrics::isEnabled()) {
+        return CuteleeView::render(c);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray ret = CuteleeView::render(c);
+
+    const QString templateName = c->stash(QStringLiteral("template")).toString();
+    CMS::Metrics::observe("cmlyst_template_render_duration_seconds{template=\"" +
+                          CMS::Metrics::label(templateName) + "\"}", timer.nsecsElapsed());
+
+    return ret;
+}
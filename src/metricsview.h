@@ -0,0 +1,40 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef METRICSVIEW_H
+#define METRICSVIEW_H
+
+#include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
+
+using namespace Cutelyst;
+
+/**
+ * CuteleeView that records render times per template,
+ * for Metrics and ServerTiming
+ */
+class MetricsView : public CuteleeView
+{
+    Q_OBJECT
+public:
+    explicit MetricsView(QObject *parent = nullptr, const QString &name = QString());
+
+    virtual QByteArray render(Context *c) const override;
+};
+
+#endif // METRICSVIEW_H
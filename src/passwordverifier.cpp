@@ -0,0 +1,124 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "passwordverifier.h"
+
+#include <Cutelyst/Plugins/Authentication/credentialpassword.h>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QPointer>
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <memory>
+
+#include "libCMS/metrics.h"
+#include "libCMS/sqltrace.h"
+
+Q_LOGGING_CATEGORY(CMLYST_LOGIN, "cmlyst.login")
+
+using namespace Cutelyst;
+
+namespace {
+
+std::atomic<int> s_pending(0);
+std::atomic<int> s_maxPending(32);
+
+QThreadPool *verifierPool()
+{
+    static QThreadPool *pool = [] {
+        auto pool = new QThreadPool;
+        pool->setMaxThreadCount(2);
+        return pool;
+    }();
+    return pool;
+}
+
+QObject *threadAnchor()
+{
+    // Never deleted, like the pool, so a job finishing
+    // during shutdown still has somewhere to post to
+    static thread_local QObject *anchor = new QObject;
+    return anchor;
+}
+
+class VerifyJob : public QRunnable
+{
+public:
+    VerifyJob(QObject *anchor, const QByteArray &password, const QByteArray &hash,
+              const std::shared_ptr<bool> &result, std::function<void()> finished)
+        : m_anchor(anchor)
+        , m_password(password)
+        , m_hash(hash)
+        , m_result(result)
+        , m_finished(std::move(finished))
+    {
+    }
+
+    void run() override
+    {
+        *m_result = CredentialPassword::validatePassword(m_password, m_hash);
+        --s_pending;
+
+        QMetaObject::invokeMethod(m_anchor, std::move(m_finished), Qt::QueuedConnection);
+    }
+
+private:
+    QObject *m_anchor;
+    QByteArray m_password;
+    QByteArray m_hash;
+    std::shared_ptr<bool> m_result;
+    std::function<void()> m_finished;
+};
+
+}
+
+void PasswordVerifier::setLimits(int threads, int maxPending)
+{
+    verifierPool()->setMaxThreadCount(qMax(1, threads));
+    s_maxPending = qMax(threads, maxPending);
+}
+
+bool PasswordVerifier::verify(QObject *receiver, const QByteArray &password, const QByteArray &hash, std::function<void(bool)> callback)
+{
+    // Past the limit fail fast, a burst of logins must
+    // not build a backlog that takes minutes to drain
+    if (++s_pending > s_maxPending) {
+        --s_pending;
+        CMS::Metrics::increment("cmlyst_login_rejected_total");
+        qCWarning(CMLYST_LOGIN) << "Password verification queue full, rejecting login" << s_maxPending.load();
+        return false;
+    }
+
+    // The guard is only ever touched on the receiver's thread,
+    // the job just carries the closure back to it
+    QPointer<QObject> guard(receiver);
+    auto result = std::make_shared<bool>(false);
+    std::function<void()> finished = [guard, callback, result] {
+        if (guard) {
+            CMS::SqlTrace::ReceiverScope scope(guard);
+            callback(*result);
+        }
+    };
+
+    qCDebug(CMLYST_LOGIN) << "Password verifications pending" << s_pending.load();
+    verifierPool()->start(new VerifyJob(threadAnchor(), password, hash, result, std::move(finished)));
+    return true;
+}
@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef PASSWORDVERIFIER_H
+#define PASSWORDVERIFIER_H
+
+#include <QByteArray>
+
+#include <functional>
+
+class QObject;
+
+class PasswordVerifier
+{
+public:
+    /**
+     * Sets how many hashes are computed at the same
+     * time and how many may wait for a thread
+     */
+    static void setLimits(int threads, int maxPending);
+
+    /**
+     * Validates \p password against \p hash on the verifier pool and
+     * calls \p callback on the calling thread unless \p receiver was
+     * destroyed, returns false without calling it when the queue is full
+     */
+    static bool verify(QObject *receiver,
+                       const QByteArray &password,
+                       const QByteArray &hash,
+                       std::function<void(bool)> callback);
+};
+
+#endif // PASSWORDVERIFIER_H
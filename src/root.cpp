@@ -23,16 +23,16 @@
 #include <Cutelyst/Context>
 #include <Cutelyst/Plugins/Authentication/authentication.h>
 #include <Cutelyst/Plugins/View/Cutelee/cuteleeview.h>
-#include <Cutelyst/Plugins/Utils/Sql>
 #include <Cutelyst/Plugins/Utils/Pagination>
 
 #include <cutelee/safestring.h>
 
-#include <QSqlQuery>
-
 #include <QBuffer>
+#include <QTimeZone>
 #include <QDebug>
 
+#include <memory>
+
 #include "libCMS/page.h"
 #include "libCMS/menu.h"
 
@@ -55,6 +55,15 @@ void Root::notFound(Context *c)
     c->res()->setStatus(404);
 }
 
+void Root::ready(Context *c)
+{
+    // Before warmup finished CMlyst answers 503 without dispatching
+    Response *res = c->res();
+    res->setContentType(QStringLiteral("text/plain"));
+    res->headers().setHeader(QStringLiteral("Cache-Control"), QStringLiteral("no-store"));
+    res->setBody(QByteArrayLiteral("ready\n"));
+}
+
 bool Root::End(Context *c)
 {
     const QString theme = engine->settingsValue(QStringLiteral("theme"), QStringLiteral("default"));
@@ -62,22 +71,44 @@ bool Root::End(Context *c)
     const QString staticTheme = QLatin1String("/static/themes/") + theme;
     c->setStash(QStringLiteral("basetheme"), c->uriFor(staticTheme).toString());
 
+    // Rendered per request, the engine is shared with the others
+    if (c->stash().contains(QStringLiteral("template"))) {
+        c->setStash(QStringLiteral("menus_html"), engine->menusHtml(QLatin1Char('/') + c->req()->path()));
+    }
+
     return true;
 }
 
 void Root::page(Cutelyst::Context *c)
 {
-    Response *res = c->res();
-    Request *req = c->req();
-
     // Get the desired page (dispatcher already found it)
     auto page = c->stash(QStringLiteral("page")).value<CMS::Page *>();
-//    QVariantHash page = c->stash(QStringLiteral("page")).toHash();
+    if (page) {
+        showPage(c, page);
+        return;
+    }
+
+    // Async engines leave the lookup to us
+    c->detachAsync();
+    engine->getPageAsync(c->stash(QStringLiteral("page_path")).toString(), c, [this, c] (CMS::Page *page) {
+        if (page && page->published()) {
+            c->setStash(QStringLiteral("page"), QVariant::fromValue(page));
+            showPage(c, page);
+        } else {
+            notFound(c);
+        }
+        c->attachAsync();
+    });
+}
+
+void Root::showPage(Context *c, CMS::Page *page)
+{
+    Response *res = c->res();
+    Request *req = c->req();
 
     // See if the page has changed, if the settings have changed
 //     and have a newer date use that instead
     QDateTime currentDateTime = qMax(page->updated(), engine->lastModified());
-//    QDateTime currentDateTime = qMax(page.value(QStringLiteral("modified")).toDateTime(), engine->lastModified());
     const QDateTime clientDate = req->headers().ifModifiedSinceDateTime();
     if (clientDate.isValid() && currentDateTime == clientDate) {
         res->setStatus(Response::NotModified);
@@ -85,9 +116,6 @@ void Root::page(Cutelyst::Context *c)
     }
     res->headers().setLastModified(currentDateTime);
 
-    QString cmsPagePath = QLatin1Char('/') + c->req()->path();
-    engine->setProperty("pagePath", cmsPagePath);
-
     auto settings = engine->settings();
     const QString cms_head = settings.value(QStringLiteral("cms_head"));
     if (!cms_head.isEmpty()) {
@@ -129,34 +157,16 @@ void Root::lastPosts(Context *c)
 
     const auto settings = engine->settings();
     const int postsPerPage = settings.value(QStringLiteral("posts_per_page"), QStringLiteral("10")).toInt();
-    int offset;
-
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT count(*) FROM posts WHERE page = 0 AND published = 1"),
-                QStringLiteral("cmlyst"));
-    if (Q_LIKELY(query.exec() && query.next())) {
-        int rows = query.value(0).toInt();
-        Pagination pagination(rows,
-                              postsPerPage,
-                              c->req()->queryParam(QStringLiteral("page"), QStringLiteral("1")).toInt());
-        offset = pagination.offset();
-        c->setStash(QStringLiteral("pagination"), pagination);
-    } else {
-        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("notFound"))));
-        return;
-    }
 
-    const QList<CMS::Page *> posts = engine->listPostsPublished(c, offset, postsPerPage);
-
-    QString cmsPagePath = QLatin1Char('/') + c->req()->path();
-    engine->setProperty("pagePath", cmsPagePath);
-    c->stash({
-                 {QStringLiteral("template"), QStringLiteral("posts.html")},
-                 {QStringLiteral("meta_title"), settings.value(QStringLiteral("title"))},
-                 {QStringLiteral("meta_description"), settings.value(QStringLiteral("tagline"))},
-                 {QStringLiteral("cms"), QVariant::fromValue(engine)},
-                 {QStringLiteral("posts"), QVariant::fromValue(posts)}
-             });
+    listPosts(c, 0, postsPerPage, [this, c, settings] (const QList<CMS::Page *> &posts) {
+        c->stash({
+                     {QStringLiteral("template"), QStringLiteral("posts.html")},
+                     {QStringLiteral("meta_title"), settings.value(QStringLiteral("title"))},
+                     {QStringLiteral("meta_description"), settings.value(QStringLiteral("tagline"))},
+                     {QStringLiteral("cms"), QVariant::fromValue(engine)},
+                     {QStringLiteral("posts"), QVariant::fromValue(posts)}
+                 });
+    });
 }
 
 void Root::feed(Context *c)
@@ -177,50 +187,49 @@ void Root::feed(Context *c)
     headers.setLastModified(currentDateTime);
     headers.setContentType(QStringLiteral("text/xml; charset=UTF-8"));
 
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT p.title, p.path, u.slug, p.published_at, p.content "
-                               "FROM posts p "
-                               "LEFT JOIN users u ON u.id = p.author_id "
-                               "WHERE page = 0 AND published = 1 "
-                               "ORDER BY published_at DESC "
-                               "LIMIT :limit "
-                               ),
-                QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":limit"), 10);
-
-    auto settings = engine->settings();
+    const bool async = engine->isAsync();
+    if (async) {
+        c->detachAsync();
+    }
 
-    auto buffer = new QBuffer(c);
-    buffer->open(QIODevice::ReadWrite);
-    res->setBody(buffer);
+    engine->listPostsPublishedAsync(c, 0, 0, 10, [this, c, async, currentDateTime] (const QList<CMS::Page *> &posts) {
+        Request *req = c->req();
+        auto settings = engine->settings();
 
-    RSSWriter writer(buffer);
+        auto buffer = new QBuffer(c);
+        buffer->open(QIODevice::ReadWrite);
+        c->res()->setBody(buffer);
 
-    writer.startRSS();
-    writer.writeStartChannel();
-    writer.writeChannelTitle(settings.value(QStringLiteral("title")));
-    writer.writeChannelFeedLink(c->uriFor(c->action()).toString());
-    writer.writeChannelLink(req->base());
-    writer.writeChannelDescription(settings.value(QStringLiteral("tagline")));
+        RSSWriter writer(buffer);
 
-    if (Q_LIKELY(query.exec())) {
+        writer.startRSS();
+        writer.writeStartChannel();
+        writer.writeChannelTitle(settings.value(QStringLiteral("title")));
+        writer.writeChannelFeedLink(c->uriFor(c->action()).toString());
+        writer.writeChannelLink(req->base());
+        writer.writeChannelDescription(settings.value(QStringLiteral("tagline")));
         writer.writeChannelLastBuildDate(currentDateTime);
 
-        while (query.next()) {
+        // Engines hand out dates in the site time zone
+        const QTimeZone timezone(settings.value(QStringLiteral("timezone")).toUtf8());
+
+        for (CMS::Page *post : posts) {
             writer.writeStartItem();
 
-            writer.writeItemTitle(query.value(0).toString());
+            writer.writeItemTitle(post->title());
 
-            const QString link = c->uriFor(query.value(1).toString()).toString();
+            const QString link = c->uriFor(post->path()).toString();
             writer.writeItemLink(link);
             writer.writeItemCommentsLink(link + QLatin1String("#comments"));
-            writer.writeItemCreator(query.value(2).toString());
+            writer.writeItemCreator(post->author().value(QStringLiteral("slug")));
 
-            QDateTime published = QDateTime::fromString(query.value(3).toString(), QStringLiteral("yyyy-MM-dd HH:mm:ss"));
-            published.setTimeSpec(Qt::UTC);
-            writer.writeItemPubDate(published);
+            QDateTime published = post->publishedAt();
+            if (timezone.isValid()) {
+                published.setTimeZone(timezone);
+            }
+            writer.writeItemPubDate(published.toUTC());
 
-            const QString content = query.value(4).toString();
+            const QString content = post->content().get();
             writer.writeItemDescription(content.left(300));
             writer.writeItemContent(content);
 
@@ -228,8 +237,12 @@ void Root::feed(Context *c)
         }
 
         writer.writeEndChannel();
-    }
-    writer.endRSS();
+        writer.endRSS();
+
+        if (async) {
+            c->attachAsync();
+        }
+    });
 }
 
 void Root::author(Context *c, const QString &slug)
@@ -254,49 +267,77 @@ void Root::author(Context *c, const QString &slug)
 
     const auto settings = engine->settings();
     const int postsPerPage = settings.value(QStringLiteral("posts_per_page"), QStringLiteral("10")).toInt();
-    int offset;
-
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT count(*) FROM posts WHERE page = 0 AND published = 1 AND author_id = :author_id"),
-                QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":author_id"), authorId);
-    if (Q_LIKELY(query.exec() && query.next())) {
-        int rows = query.value(0).toInt();
-        Pagination pagination(rows,
-                              postsPerPage,
-                              c->req()->queryParam(QStringLiteral("page"), QStringLiteral("1")).toInt());
-        offset = pagination.offset();
-        c->setStash(QStringLiteral("pagination"), pagination);
-        c->setStash(QStringLiteral("posts_count"), rows);
-    } else {
-        c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("notFound"))));
-        return;
-    }
 
-    QList<CMS::Page *> posts;
-    posts = engine->listAuthorPostsPublished(c,
-                                             authorId,
-                                             offset,
-                                             postsPerPage);
+    listPosts(c, authorId, postsPerPage, [this, c, settings, authorData] (const QList<CMS::Page *> &posts) {
+        const QString cms_head = settings.value(QStringLiteral("cms_head"));
+        if (!cms_head.isEmpty()) {
+            const Cutelee::SafeString safe(cms_head, true);
+            c->setStash(QStringLiteral("cms_head"), QVariant::fromValue(safe));
+        }
+
+        const QString cms_foot = settings.value(QStringLiteral("cms_foot"));
+        if (!cms_foot.isEmpty()) {
+            const Cutelee::SafeString safe(cms_foot, true);
+            c->setStash(QStringLiteral("cms_foot"), QVariant::fromValue(safe));
+        }
 
-    const QString cms_head = settings.value(QStringLiteral("cms_head"));
-    if (!cms_head.isEmpty()) {
-        const Cutelee::SafeString safe(cms_head, true);
-        c->setStash(QStringLiteral("cms_head"), QVariant::fromValue(safe));
+        c->stash({
+                     {QStringLiteral("template"), QStringLiteral("author.html")},
+                     {QStringLiteral("meta_title"), settings.value(QStringLiteral("title"))},
+                     {QStringLiteral("meta_description"), settings.value(QStringLiteral("tagline"))},
+                     {QStringLiteral("cms"), QVariant::fromValue(engine)},
+                     {QStringLiteral("author"), QVariant::fromValue(authorData)},
+                     {QStringLiteral("posts"), QVariant::fromValue(posts)}
+                 });
+    });
+}
+
+void Root::listPosts(Context *c, int authorId, int postsPerPage, std::function<void (const QList<CMS::Page *> &)> done)
+{
+    int currentPage = c->req()->queryParam(QStringLiteral("page"), QStringLiteral("1")).toInt();
+    if (currentPage < 1) {
+        currentPage = 1;
     }
 
-    const QString cms_foot = settings.value(QStringLiteral("cms_foot"));
-    if (!cms_foot.isEmpty()) {
-        const Cutelee::SafeString safe(cms_foot, true);
-        c->setStash(QStringLiteral("cms_foot"), QVariant::fromValue(safe));
+    const bool async = engine->isAsync();
+    if (async) {
+        c->detachAsync();
     }
 
-    c->stash({
-                 {QStringLiteral("template"), QStringLiteral("author.html")},
-                 {QStringLiteral("meta_title"), settings.value(QStringLiteral("title"))},
-                 {QStringLiteral("meta_description"), settings.value(QStringLiteral("tagline"))},
-                 {QStringLiteral("cms"), QVariant::fromValue(engine)},
-                 {QStringLiteral("author"), QVariant::fromValue(authorData)},
-                 {QStringLiteral("posts"), QVariant::fromValue(posts)}
-             });
+    // Both queries are sent right away, async engines pipeline them
+    auto posts = std::make_shared<QList<CMS::Page *>>();
+    auto pending = std::make_shared<int>(2);
+    auto finished = [this, c, async, done, posts, pending] {
+        if (--(*pending) > 0) {
+            return;
+        }
+
+        if (c->stash(QStringLiteral("pagination")).isNull()) {
+            c->response()->redirect(c->uriFor(CActionFor(QStringLiteral("notFound"))));
+        } else {
+            done(*posts);
+        }
+
+        if (async) {
+            c->attachAsync();
+        }
+    };
+
+    engine->countPagesAsync(CMS::Engine::Posts | CMS::Engine::OnlyPublished, authorId, c,
+                            [c, authorId, postsPerPage, currentPage, finished] (int rows) {
+        if (rows >= 0) {
+            Pagination pagination(rows, postsPerPage, currentPage);
+            c->setStash(QStringLiteral("pagination"), pagination);
+            if (authorId > 0) {
+                c->setStash(QStringLiteral("posts_count"), rows);
+            }
+        }
+        finished();
+    });
+
+    engine->listPostsPublishedAsync(c, authorId, (currentPage - 1) * postsPerPage, postsPerPage,
+                                    [posts, finished] (const QList<CMS::Page *> &result) {
+        *posts = result;
+        finished();
+    });
 }
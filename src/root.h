@@ -23,12 +23,15 @@
 #include <Cutelyst/Controller>
 #include <QDir>
 
+#include <functional>
+
 #include "cmengine.h"
 
 using namespace Cutelyst;
 
 namespace CMS {
 class Engine;
+class Page;
 }
 
 class Root : public Controller, public CMEngine
@@ -43,6 +46,12 @@ public:
     C_ATTR(notFound, :Path)
     void notFound(Context *c);
 
+    /**
+     * 200 once the worker finished warming up, 503 before
+     */
+    C_ATTR(ready, :Path(.ready) :Args(0))
+    void ready(Context *c);
+
     C_ATTR(page, :Page)
     void page(Cutelyst::Context *c);
 
@@ -58,6 +67,15 @@ public:
 private:
     C_ATTR(End, :ActionClass(RenderView))
     bool End(Context *c);
+
+    void showPage(Context *c, CMS::Page *page);
+
+    /**
+     * Stashes the pagination and calls \p done with the posts of
+     * the requested page, the Context is detached meanwhile
+     * when the engine is async
+     */
+    void listPosts(Context *c, int authorId, int postsPerPage, std::function<void(const QList<CMS::Page *> &)> done);
 };
 
 #endif // ROOT_H
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "servertiming.h"
+
+#include <Cutelyst/Context>
+#include <Cutelyst/Request>
+#include <Cutelyst/Response>
+#include <Cutelyst/Plugins/Authentication/authentication.h>
+
+#include <atomic>
+
+#include "libCMS/sqltrace.h"
+
+using namespace Cutelyst;
+
+namespace {
+
+std::atomic<bool> s_alwaysOn(false);
+
+QElapsedTimer &clock()
+{
+    static QElapsedTimer timer;
+    if (!timer.isValid()) {
+        timer.start();
+    }
+    return timer;
+}
+
+QByteArray propertyName(const char *metric)
+{
+    return QByteArrayLiteral("_timing_") + metric;
+}
+
+QString entry(const QString &name, qint64 nsecs)
+{
+    return name + QLatin1String(";dur=") + QString::number(nsecs / 1e6, 'f', 2);
+}
+
+}
+
+void ServerTiming::setAlwaysOn(bool on)
+{
+    // Started here so the first request doesn't race on it
+    clock();
+    s_alwaysOn = on;
+}
+
+void ServerTiming::begin(Context *c)
+{
+    // SQL is counted per request, detached ones would otherwise
+    // get the statements of the requests run meanwhile
+    if (s_alwaysOn || c->req()->cookie(cookieName()) == QLatin1String("1")) {
+        c->setProperty("_timing_start", clock().nsecsElapsed());
+        CMS::SqlTrace::setReceiver(c);
+    } else {
+        CMS::SqlTrace::setReceiver(nullptr);
+    }
+}
+
+bool ServerTiming::isActive(Context *c)
+{
+    return c->property("_timing_start").isValid();
+}
+
+void ServerTiming::add(Context *c, const char *metric, qint64 nsecs)
+{
+    const QByteArray name = propertyName(metric);
+    c->setProperty(name.constData(), c->property(name.constData()).toLongLong() + nsecs);
+}
+
+void ServerTiming::finish(Context *c)
+{
+    if (!isActive(c)) {
+        return;
+    }
+    CMS::SqlTrace::setReceiver(nullptr);
+
+    // The cookie alone is not enough to see the timings
+    if (!s_alwaysOn && !Authentication::userExists(c)) {
+        return;
+    }
+
+    const qint64 total = clock().nsecsElapsed() - c->property("_timing_start").toLongLong();
+    const qint64 sql = CMS::SqlTrace::time(c);
+    const qint64 match = c->property("_timing_match").toLongLong();
+    const qint64 render = c->property("_timing_render").toLongLong();
+
+    // SQL is also part of match and stash, so it is not subtracted
+    const QStringList entries = {
+        entry(QStringLiteral("match"), match),
+        entry(QStringLiteral("sql"), sql),
+        entry(QStringLiteral("stash"), qMax<qint64>(0, total - match - render)),
+        entry(QStringLiteral("render"), render),
+        entry(QStringLiteral("total"), total),
+    };
+    c->res()->setHeader(QStringLiteral("Server-Timing"), entries.join(QLatin1String(", ")));
+}
+
+QString ServerTiming::cookieName()
+{
+    return QStringLiteral("cmlyst_timing");
+}
+
+ServerTiming::Scope::Scope(Context *c, const char *metric) : m_c(c), m_metric(metric)
+{
+    if (isActive(c)) {
+        m_timer.start();
+    }
+}
+
+ServerTiming::Scope::~Scope()
+{
+    if (m_timer.isValid()) {
+        add(m_c, m_metric, m_timer.nsecsElapsed());
+    }
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef SERVERTIMING_H
+#define SERVERTIMING_H
+
+#include <QElapsedTimer>
+
+namespace Cutelyst {
+class Context;
+}
+
+/**
+ * Adds a Server-Timing header splitting the request time into
+ * dispatcher matching, SQL, stash preparation and rendering.
+ *
+ * Enabled for every request by the ServerTiming config key, or
+ * for logged in admins that have the cookie set by /.admin/timing
+ */
+class ServerTiming
+{
+public:
+    static void setAlwaysOn(bool on);
+
+    /**
+     * Starts timing \p c if it is enabled for it
+     */
+    static void begin(Cutelyst::Context *c);
+
+    static bool isActive(Cutelyst::Context *c);
+
+    /**
+     * Adds \p nsecs to the \p metric total of \p c
+     */
+    static void add(Cutelyst::Context *c, const char *metric, qint64 nsecs);
+
+    /**
+     * Sets the header, must run before the response is finalized
+     */
+    static void finish(Cutelyst::Context *c);
+
+    static QString cookieName();
+
+    /**
+     * Adds the time until it goes out of scope to \p metric
+     */
+    class Scope
+    {
+    public:
+        Scope(Cutelyst::Context *c, const char *metric);
+        ~Scope();
+
+    private:
+        Cutelyst::Context *m_c;
+        const char *m_metric;
+        QElapsedTimer m_timer;
+    };
+};
+
+#endif // SERVERTIMING_H
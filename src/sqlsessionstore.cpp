@@ -0,0 +1,248 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "sqlsessionstore.h"
+
+#include <Cutelyst/Context>
+#include <Cutelyst/Engine>
+#include <Cutelyst/Plugins/Utils/Sql>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QTimer>
+
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include <QLoggingCategory>
+
+#include "libCMS/sqlengine.h"
+#include "libCMS/metrics.h"
+#include "libCMS/sqltrace.h"
+#include "libCMS/sqlwriter.h"
+
+using namespace Cutelyst;
+
+// Expiry updates closer than this to the stored value are skipped,
+// so a busy admin session isn't written on every request
+static const quint64 expiresSlack = 60;
+
+// Rows deleted per statement when sweeping
+static const int sweepBatch = 500;
+
+// Sessions kept in memory before the cache is dropped
+static const int cacheSize = 1000;
+
+SqlSessionStore::SqlSessionStore(int sweepInterval, QObject *parent) : SessionStore(parent)
+  , m_sweepInterval(sweepInterval)
+{
+}
+
+QVariant SqlSessionStore::getSessionData(Context *c, const QString &sid, const QString &key, const QVariant &defaultValue)
+{
+    startSweeping(c);
+    syncCache(c);
+
+    auto sessionIt = m_cache.constFind(sid);
+    if (sessionIt != m_cache.constEnd()) {
+        auto it = sessionIt.value().constFind(key);
+        if (it != sessionIt.value().constEnd()) {
+            CMS::Metrics::increment("cmlyst_cache_requests_total{cache=\"sessions\",result=\"hit\"}");
+            return it.value().isValid() ? it.value() : defaultValue;
+        }
+    }
+    CMS::Metrics::increment("cmlyst_cache_requests_total{cache=\"sessions\",result=\"miss\"}");
+
+    QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                QStringLiteral("SELECT value FROM sessions WHERE sid = :sid AND key = :key"),
+                QStringLiteral("cmlyst"));
+    query.bindValue(QStringLiteral(":sid"), sid);
+    query.bindValue(QStringLiteral(":key"), key);
+    if (!CMS::SqlTrace::exec(query)) {
+        qWarning() << "Failed to get session data" << query.lastError().databaseText();
+        return defaultValue;
+    }
+
+    if (m_cache.size() > cacheSize) {
+        m_cache.clear();
+    }
+
+    if (!query.next()) {
+        // Remember misses too, most requests have no flash data
+        m_cache[sid].insert(key, QVariant());
+        return defaultValue;
+    }
+
+    QVariant ret;
+    QByteArray data = query.value(0).toByteArray();
+    QDataStream stream(&data, QIODevice::ReadOnly);
+    stream >> ret;
+    m_cache[sid].insert(key, ret);
+
+    if (key == QLatin1String("expires")) {
+        m_expiresWritten.insert(sid, ret.toULongLong());
+    }
+
+    return ret;
+}
+
+bool SqlSessionStore::storeSessionData(Context *c, const QString &sid, const QString &key, const QVariant &value)
+{
+    startSweeping(c);
+    syncCache(c);
+
+    QVariant expires;
+    if (key == QLatin1String("expires")) {
+        const quint64 newExpires = value.toULongLong();
+        auto it = m_expiresWritten.constFind(sid);
+        if (it != m_expiresWritten.constEnd() && newExpires >= it.value() && newExpires - it.value() < expiresSlack) {
+            m_cache[sid].insert(key, value);
+            return true;
+        }
+        m_expiresWritten.insert(sid, newExpires);
+        expires = newExpires;
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << value;
+
+    const bool ok = CMS::SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("INSERT OR REPLACE INTO sessions "
+                                   "(sid, key, value, expires) "
+                                   "VALUES "
+                                   "(:sid, :key, :value, :expires)"),
+                    QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":sid"), sid);
+        query.bindValue(QStringLiteral(":key"), key);
+        query.bindValue(QStringLiteral(":value"), data);
+        query.bindValue(QStringLiteral(":expires"), expires);
+        if (!CMS::SqlTrace::exec(query)) {
+            qWarning() << "Failed to store session data" << query.lastError().databaseText();
+            return false;
+        }
+        return true;
+    });
+    if (!ok) {
+        m_cache.remove(sid);
+        return false;
+    }
+    m_cache[sid].insert(key, value);
+    return true;
+}
+
+bool SqlSessionStore::deleteSessionData(Context *c, const QString &sid, const QString &key)
+{
+    syncCache(c);
+    m_cache[sid].insert(key, QVariant());
+    if (key == QLatin1String("expires")) {
+        m_expiresWritten.remove(sid);
+    }
+
+    return CMS::SqlWriter::exec<bool>([&] () -> bool {
+        QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                    QStringLiteral("DELETE FROM sessions WHERE sid = :sid AND key = :key"),
+                    QStringLiteral("cmlyst"));
+        query.bindValue(QStringLiteral(":sid"), sid);
+        query.bindValue(QStringLiteral(":key"), key);
+        if (!CMS::SqlTrace::exec(query)) {
+            qWarning() << "Failed to delete session data" << query.lastError().databaseText();
+            return false;
+        }
+        return true;
+    });
+}
+
+bool SqlSessionStore::deleteExpiredSessions(Context *c, quint64 expires)
+{
+    Q_UNUSED(c)
+    m_cache.clear();
+    return sweep(expires) >= 0;
+}
+
+void SqlSessionStore::startSweeping(Context *c)
+{
+    // Created on first use so it lives in the worker, not in the
+    // process that loaded the application before forking
+    if (m_sweepTimer || m_sweepInterval <= 0) {
+        return;
+    }
+
+    // The table is shared, a single worker sweeps it
+    // like the static export is kept by a single one
+    if (c->engine()->workerId() != 0 || c->engine()->workerCore() != 0) {
+        m_sweepInterval = 0;
+        return;
+    }
+
+    m_sweepTimer = new QTimer(this);
+    m_sweepTimer->setInterval(m_sweepInterval * 1000);
+    connect(m_sweepTimer, &QTimer::timeout, this, [this] {
+        const int removed = sweep(QDateTime::currentMSecsSinceEpoch() / 1000);
+        if (removed > 0) {
+            qDebug() << "Removed expired sessions" << removed;
+        }
+        m_expiresWritten.clear();
+        m_cache.clear();
+    });
+    m_sweepTimer->start();
+}
+
+void SqlSessionStore::syncCache(Context *c)
+{
+    // data_version changes when any other connection commits,
+    // which includes our own writes made through SqlWriter
+    const qint64 version = CMS::SqlEngine::dataVersion(c);
+    if (version == -1 || version != m_cacheDataVersion) {
+        m_cache.clear();
+        m_cacheDataVersion = version;
+    }
+}
+
+int SqlSessionStore::sweep(quint64 expires)
+{
+    // Small batches keep the write lock short, each one is
+    // a separate writer job so other writes get in between
+    int removed = 0;
+    Q_FOREVER {
+        const int rows = CMS::SqlWriter::exec<int>([&] () -> int {
+            QSqlQuery query = CPreparedSqlQueryThreadForDB(
+                        QStringLiteral("DELETE FROM sessions WHERE sid IN "
+                                       "(SELECT sid FROM sessions WHERE key = 'expires' AND expires < :expires LIMIT :limit)"),
+                        QStringLiteral("cmlyst"));
+            query.bindValue(QStringLiteral(":expires"), expires);
+            query.bindValue(QStringLiteral(":limit"), sweepBatch);
+            if (!CMS::SqlTrace::exec(query)) {
+                qWarning() << "Failed to remove expired sessions" << query.lastError().databaseText();
+                return -1;
+            }
+            return query.numRowsAffected();
+        });
+        if (rows == -1) {
+            return -1;
+        }
+
+        removed += rows;
+        if (rows == 0) {
+            break;
+        }
+    }
+    return removed;
+}
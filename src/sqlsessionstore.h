@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef SQLSESSIONSTORE_H
+#define SQLSESSIONSTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <Cutelyst/Plugins/Session/Session>
+
+class QTimer;
+
+/**
+ * Keeps sessions in the site database so all workers
+ * share them, expired ones are removed in batches
+ */
+class SqlSessionStore : public Cutelyst::SessionStore
+{
+    Q_OBJECT
+public:
+    explicit SqlSessionStore(int sweepInterval, QObject *parent = 0);
+
+    virtual QVariant getSessionData(Cutelyst::Context *c, const QString &sid, const QString &key, const QVariant &defaultValue) override;
+    virtual bool storeSessionData(Cutelyst::Context *c, const QString &sid, const QString &key, const QVariant &value) override;
+    virtual bool deleteSessionData(Cutelyst::Context *c, const QString &sid, const QString &key) override;
+    virtual bool deleteExpiredSessions(Cutelyst::Context *c, quint64 expires) override;
+
+private:
+    void startSweeping(Cutelyst::Context *c);
+    int sweep(quint64 expires);
+    void syncCache(Cutelyst::Context *c);
+
+    QTimer *m_sweepTimer = nullptr;
+    QHash<QString, quint64> m_expiresWritten;
+    QHash<QString, QHash<QString, QVariant> > m_cache;
+    qint64 m_cacheDataVersion = -1;
+    int m_sweepInterval;
+};
+
+#endif // SQLSESSIONSTORE_H
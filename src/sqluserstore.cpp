@@ -9,11 +9,13 @@
 #include <QJsonObject>
 
 #include <QSqlQuery>
-#include <QSqlRecord>
 #include <QSqlError>
 
 #include <QLoggingCategory>
 
+#include "libCMS/sqltrace.h"
+#include "libCMS/sqlwriter.h"
+
 using namespace Cutelyst;
 
 SqlUserStore::SqlUserStore(QObject *parent) : AuthenticationStore(parent)
@@ -24,72 +26,89 @@ SqlUserStore::SqlUserStore(QObject *parent) : AuthenticationStore(parent)
 Cutelyst::AuthenticationUser SqlUserStore::findUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &userinfo)
 {
     Q_UNUSED(c)
-    QSqlQuery query = CPreparedSqlQueryThreadForDB(
-                QStringLiteral("SELECT * FROM users WHERE email = :email"),
-                QStringLiteral("cmlyst"));
-    query.bindValue(QStringLiteral(":email"), userinfo.value(QStringLiteral("email")));
-    if (query.exec() && query.next()) {
-        QVariant userId = query.value(QStringLiteral("id"));
-
-        AuthenticationUser user(userId.toString());
-
-        int columns = query.record().count();
-        // send column headers
-        QStringList cols;
-        const QSqlRecord record = query.record();
-        for (int j = 0; j < columns; ++j) {
-            cols.append(record.fieldName(j));
-        }
-
-        for (int j = 0; j < columns; ++j) {
-            user.insert(cols.at(j), query.value(j));
-        }
-
+    const QHash<QString, QString> credentials = engine->credentials(userinfo.value(QStringLiteral("email")));
+    if (!credentials.isEmpty()) {
+        AuthenticationUser user(credentials.value(QStringLiteral("id")));
+        user.insert(QStringLiteral("email"), credentials.value(QStringLiteral("email")));
+        user.insert(QStringLiteral("password"), credentials.value(QStringLiteral("password")));
+        user.insert(QStringLiteral("version"), credentials.value(QStringLiteral("version")));
         return user;
     }
 
     return AuthenticationUser();
 }
 
-QString SqlUserStore::addUser(const ParamsMultiMap &user, bool replace)
+QVariant SqlUserStore::forSession(Context *c, const AuthenticationUser &user)
 {
-    QSqlQuery query;
-    if (replace) {
-        query = CPreparedSqlQueryThreadForDB(
-                    QStringLiteral("INSERT OR REPLACE INTO users "
-                                   "(slug, email, password, json) "
-                                   "VALUES "
-                                   "(:slug, :email, :password, :json)"),
-                    QStringLiteral("cmlyst"));
-    } else {
-        query = CPreparedSqlQueryThreadForDB(
-                    QStringLiteral("INSERT INTO users "
-                                   "(slug, email, password, json) "
-                                   "VALUES "
-                                   "(:slug, :email, :password, :json)"),
-                    QStringLiteral("cmlyst"));
+    Q_UNUSED(c)
+    return QVariantHash{
+        {QStringLiteral("id"), user.id()},
+        {QStringLiteral("version"), user.value(QStringLiteral("version"))},
+    };
+}
+
+AuthenticationUser SqlUserStore::fromSession(Context *c, const QVariant &frozenUser)
+{
+    Q_UNUSED(c)
+    const QVariantHash session = frozenUser.toHash();
+    const QHash<QString, QString> data = engine->user(session.value(QStringLiteral("id")).toInt());
+
+    // Changing the password bumps the version, which
+    // ends the sessions that were started before it
+    if (data.isEmpty() || data.value(QStringLiteral("version")) != session.value(QStringLiteral("version")).toString()) {
+        return AuthenticationUser();
     }
 
-    const QString name = user.value(QStringLiteral("name"));
-    QString slug = name;
-    if (slug.isEmpty()) {
-        slug  = name.section(QLatin1Char(' '), 0, 0);
+    AuthenticationUser user(data.value(QStringLiteral("id")));
+    auto it = data.constBegin();
+    while (it != data.constEnd()) {
+        user.insert(it.key(), it.value());
+        ++it;
     }
-    slug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
-    slug = slug.left(50).toLower().toHtmlEscaped();
-    query.bindValue(QStringLiteral(":slug"), slug);
+    return user;
+}
+
+QString SqlUserStore::addUser(const ParamsMultiMap &user, bool replace)
+{
+    return CMS::SqlWriter::exec<QString>([&] () -> QString {
+        QSqlQuery query;
+        if (replace) {
+            query = CPreparedSqlQueryThreadForDB(
+                        QStringLiteral("INSERT OR REPLACE INTO users "
+                                       "(slug, email, password, json) "
+                                       "VALUES "
+                                       "(:slug, :email, :password, :json)"),
+                        QStringLiteral("cmlyst"));
+        } else {
+            query = CPreparedSqlQueryThreadForDB(
+                        QStringLiteral("INSERT INTO users "
+                                       "(slug, email, password, json) "
+                                       "VALUES "
+                                       "(:slug, :email, :password, :json)"),
+                        QStringLiteral("cmlyst"));
+        }
 
-    query.bindValue(QStringLiteral(":email"), user.value(QStringLiteral("email")));
-    query.bindValue(QStringLiteral(":password"), user.value(QStringLiteral("password")));
+        const QString name = user.value(QStringLiteral("name"));
+        QString slug = name;
+        if (slug.isEmpty()) {
+            slug  = name.section(QLatin1Char(' '), 0, 0);
+        }
+        slug.remove(QRegularExpression(QStringLiteral("[^\\w]")));
+        slug = slug.left(50).toLower().toHtmlEscaped();
+        query.bindValue(QStringLiteral(":slug"), slug);
 
-    QJsonObject obj;
-    obj.insert(QStringLiteral("name"),
-               name.left(150).toHtmlEscaped());
-    query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
+        query.bindValue(QStringLiteral(":email"), user.value(QStringLiteral("email")));
+        query.bindValue(QStringLiteral(":password"), user.value(QStringLiteral("password")));
 
-    if (!query.exec()) {
-        qDebug() << "Failed to add new user:" << query.lastError().databaseText() << user;
-        return QString();
-    }
-    return slug;
+        QJsonObject obj;
+        obj.insert(QStringLiteral("name"),
+                   name.left(150).toHtmlEscaped());
+        query.bindValue(QStringLiteral(":json"), QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
+
+        if (!CMS::SqlTrace::exec(query)) {
+            qDebug() << "Failed to add new user:" << query.lastError().databaseText() << user;
+            return QString();
+        }
+        return slug;
+    });
 }
@@ -4,7 +4,9 @@
 #include <QObject>
 #include <Cutelyst/Plugins/Authentication/authenticationstore.h>
 
-class SqlUserStore : public Cutelyst::AuthenticationStore
+#include "cmengine.h"
+
+class SqlUserStore : public Cutelyst::AuthenticationStore, public CMEngine
 {
     Q_OBJECT
 public:
@@ -12,6 +14,13 @@ public:
 
     virtual Cutelyst::AuthenticationUser findUser(Cutelyst::Context *c, const Cutelyst::ParamsMultiMap &userinfo);
 
+    /**
+     * Only the user id and version are kept in the session,
+     * the profile comes from the engine user cache
+     */
+    virtual QVariant forSession(Cutelyst::Context *c, const Cutelyst::AuthenticationUser &user) override;
+    virtual Cutelyst::AuthenticationUser fromSession(Cutelyst::Context *c, const QVariant &frozenUser) override;
+
     QString addUser(const Cutelyst::ParamsMultiMap &user, bool replace);
 };
 
@@ -0,0 +1,371 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "staticexport.h"
+
+#include <Cutelyst/Application>
+#include <Cutelyst/Context>
+#include <Cutelyst/EngineRequest>
+#include <Cutelyst/Headers>
+#include <Cutelyst/Response>
+
+#include <QHostAddress>
+#include <QSaveFile>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSet>
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
+
+#include "libCMS/page.h"
+
+using namespace Cutelyst;
+
+namespace {
+
+class ExportRequest : public EngineRequest
+{
+public:
+    qint64 doWrite(const char *data, qint64 len) override
+    {
+        body.append(data, int(len));
+        return len;
+    }
+
+    bool writeHeaders(quint16 status, const Headers &headers) override
+    {
+        statusCode = status;
+        contentType = headers.contentType();
+        return true;
+    }
+
+    void processingFinished() override
+    {
+        done();
+    }
+
+    quint16 statusCode = 0;
+    QString contentType;
+    QByteArray body;
+    std::function<void()> done;
+};
+
+const QLatin1String pageQuery("?page=");
+
+QString listingKey(const QString &path, int page)
+{
+    if (page > 1) {
+        return path + pageQuery + QString::number(page);
+    }
+    return path;
+}
+
+}
+
+StaticExport::StaticExport(Application *app, CMS::Engine *engine, const QString &dir, const QUrl &baseUrl, QObject *parent)
+    : QObject(parent)
+    , m_app(app)
+    , m_engine(engine)
+    , m_dir(QDir(dir).absolutePath())
+    , m_baseUrl(baseUrl)
+{
+    connect(engine, &CMS::Engine::pagesChanged, this, &StaticExport::update);
+}
+
+void StaticExport::update()
+{
+    // Changes arriving while writing are picked up right after
+    if (m_busy) {
+        m_rescan = true;
+        return;
+    }
+
+    m_busy = true;
+    m_ok = true;
+    QTimer::singleShot(0, this, &StaticExport::scan);
+}
+
+void StaticExport::scan()
+{
+    Context c(m_app);
+    m_engine->loadSettings(&c);
+
+    // Themes, menus and users can show up on every file
+    const QDateTime modified = m_engine->lastModified();
+    const bool full = m_files.isEmpty() || modified != m_settingsModified;
+
+    // No post was committed since the last scan, so listing
+    // every published one again would find no change
+    const qint64 version = m_engine->contentVersion(&c);
+    if (!full && version != -1 && version == m_contentVersion) {
+        renderNext();
+        return;
+    }
+    m_settingsModified = modified;
+    m_contentVersion = version;
+
+    // A single listing that every file is planned from, async
+    // engines read it while this worker keeps serving requests
+    m_engine->listPagesSummaryAsync(this, CMS::Engine::OnlyPublished, 0, CMS::Engine::SortPublished, Qt::DescendingOrder,
+                                    0, std::numeric_limits<int>::max(), [this, full] (const QList<CMS::Page *> &published) {
+        plan(published, full);
+        qDeleteAll(published);
+        renderNext();
+    });
+}
+
+void StaticExport::plan(const QList<CMS::Page *> &published, bool full)
+{
+    const auto settings = m_engine->settings();
+
+    QHash<QString, QDateTime> pages;
+    QStringList posts;
+    QHash<int, QList<CMS::Page *>> authorPosts;
+    for (CMS::Page *page : published) {
+        pages.insert(page->path(), page->updated());
+        if (!page->page()) {
+            posts.append(page->path());
+            authorPosts[page->author().value(QStringLiteral("id")).toInt()].append(page);
+        }
+    }
+
+    QSet<QString> changed;
+    auto it = pages.constBegin();
+    while (it != pages.constEnd()) {
+        if (full || !m_files.contains(it.key()) || m_pages.value(it.key()) != it.value()) {
+            changed.insert(it.key());
+            enqueue(it.key());
+        }
+        ++it;
+    }
+
+    // Listings at the same path are written again below
+    const QStringList gone = m_pages.keys();
+    for (const QString &path : gone) {
+        if (!pages.contains(path)) {
+            changed.insert(path);
+            remove(path);
+        }
+    }
+
+    const int postsPerPage = qMax(1, settings.value(QStringLiteral("posts_per_page"), QStringLiteral("10")).toInt());
+    const bool showPostsOnFront = settings.value(QStringLiteral("show_on_front"), QStringLiteral("posts")) == QLatin1String("posts");
+
+    QHash<QString, QStringList> listings;
+    if (showPostsOnFront) {
+        addListing(listings, QString(), posts, postsPerPage);
+    } else {
+        const QString postsPath = settings.value(QStringLiteral("page_for_posts"));
+        if (!postsPath.isEmpty()) {
+            addListing(listings, postsPath, posts, postsPerPage);
+        }
+        listings.insert(QString(), { settings.value(QStringLiteral("page_on_front")) });
+    }
+    listings.insert(QStringLiteral(".feed"), posts.mid(0, 10));
+
+    const QVariantList users = m_engine->users();
+    for (const QVariant &user : users) {
+        const auto data = user.value<QHash<QString, QString>>();
+        QList<CMS::Page *> own = authorPosts.value(data.value(QStringLiteral("id")).toInt());
+        // Author pages list the newest created first
+        std::stable_sort(own.begin(), own.end(), [] (CMS::Page *a, CMS::Page *b) {
+            return a->created() > b->created();
+        });
+
+        QStringList paths;
+        for (CMS::Page *page : own) {
+            paths.append(page->path());
+        }
+        addListing(listings, QLatin1String(".author/") + data.value(QStringLiteral("slug")), paths, postsPerPage);
+    }
+
+    auto listingIt = listings.constBegin();
+    while (listingIt != listings.constEnd()) {
+        const QStringList &members = listingIt.value();
+        bool dirty = full || !m_files.contains(listingIt.key()) || m_listings.value(listingIt.key()) != members;
+        for (int i = 0; !dirty && i < members.size(); ++i) {
+            dirty = changed.contains(members.at(i));
+        }
+        if (dirty) {
+            enqueue(listingIt.key());
+        }
+        ++listingIt;
+    }
+
+    const QStringList oldListings = m_listings.keys();
+    for (const QString &key : oldListings) {
+        if (!listings.contains(key) && !pages.contains(key)) {
+            remove(key);
+        }
+    }
+
+    m_pages = pages;
+    m_listings = listings;
+}
+
+void StaticExport::addListing(QHash<QString, QStringList> &listings, const QString &path, const QStringList &posts, int postsPerPage)
+{
+    // The first page exists even without posts
+    int page = 1;
+    do {
+        listings.insert(listingKey(path, page), posts.mid((page - 1) * postsPerPage, postsPerPage));
+        ++page;
+    } while ((page - 1) * postsPerPage < posts.size());
+}
+
+void StaticExport::enqueue(const QString &key)
+{
+    if (!m_queue.contains(key)) {
+        m_queue.append(key);
+    }
+}
+
+void StaticExport::renderNext()
+{
+    if (m_queue.isEmpty()) {
+        m_busy = false;
+        if (m_rescan) {
+            m_rescan = false;
+            update();
+        } else {
+            Q_EMIT finished(m_ok);
+        }
+        return;
+    }
+
+    const QString key = m_queue.takeFirst();
+    const int queryPos = key.indexOf(pageQuery);
+
+    auto req = new ExportRequest;
+    req->method = QStringLiteral("GET");
+    if (queryPos == -1) {
+        req->setPath(key);
+    } else {
+        req->setPath(key.left(queryPos));
+        req->query = key.mid(queryPos + 1).toLatin1();
+    }
+    req->protocol = QStringLiteral("HTTP/1.1");
+    req->isSecure = m_baseUrl.scheme() == QLatin1String("https");
+    req->serverAddress = m_baseUrl.host();
+    req->remoteAddress = QHostAddress(QHostAddress::LocalHost);
+    req->headers.setHeader(QStringLiteral("Host"), m_baseUrl.authority());
+    req->elapsed.start();
+
+    // Called from within the engine, the request is only
+    // deleted and the next one started after it returns
+    req->done = [this, req, key] {
+        QTimer::singleShot(0, this, [this, req, key] {
+            store(key, req->statusCode, req->contentType, req->body);
+            delete req;
+            renderNext();
+        });
+    };
+
+    m_app->engine()->processRequest(req);
+}
+
+void StaticExport::store(const QString &key, quint16 status, const QString &contentType, const QByteArray &body)
+{
+    if (status == Response::NotFound) {
+        remove(key);
+        return;
+    }
+
+    if (status != Response::OK) {
+        qWarning() << "Static export of" << key << "returned" << status;
+        // Rendered again on the next update, which has to scan
+        m_pages.remove(key);
+        m_listings.remove(key);
+        m_contentVersion = -1;
+        m_ok = false;
+        return;
+    }
+
+    // Pages become directories with an index so their links
+    // keep working, listing pages get a suffix since web
+    // servers look files up without the query
+    QString path = key;
+    QString suffix;
+    const int queryPos = key.indexOf(pageQuery);
+    if (queryPos != -1) {
+        path = key.left(queryPos);
+        suffix = QLatin1String(".page-") + key.mid(queryPos + pageQuery.size());
+    }
+
+    if (path.split(QLatin1Char('/')).contains(QStringLiteral(".."))) {
+        qWarning() << "Static export skipped unsafe path" << path;
+        return;
+    }
+
+    QString fileName = m_dir;
+    if (contentType.contains(QLatin1String("xml"))) {
+        fileName += QLatin1Char('/') + path + suffix + QLatin1String(".xml");
+    } else {
+        if (!path.isEmpty()) {
+            fileName += QLatin1Char('/') + path;
+        }
+        fileName += QLatin1String("/index") + suffix + QLatin1String(".html");
+    }
+
+    QSaveFile file(fileName);
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath()) || !file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open static export file" << fileName << file.errorString();
+        m_ok = false;
+        return;
+    }
+
+    file.write(body);
+    if (!file.commit()) {
+        qWarning() << "Failed to write static export file" << fileName << file.errorString();
+        m_ok = false;
+        return;
+    }
+
+    const QString previous = m_files.value(key);
+    if (!previous.isEmpty() && previous != fileName) {
+        QFile::remove(previous);
+    }
+    m_files.insert(key, fileName);
+}
+
+void StaticExport::remove(const QString &key)
+{
+    const QString fileName = m_files.take(key);
+    if (!fileName.isEmpty()) {
+        QFile::remove(fileName);
+    }
+}
+
+ExportEngine::ExportEngine(Application *app, const QVariantMap &opts) : Engine(app, 0, opts)
+{
+}
+
+int ExportEngine::workerId() const
+{
+    return 0;
+}
+
+bool ExportEngine::init()
+{
+    return initApplication() && postForkApplication();
+}
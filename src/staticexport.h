@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef STATICEXPORT_H
+#define STATICEXPORT_H
+
+#include <Cutelyst/Engine>
+
+#include <QObject>
+#include <QDateTime>
+#include <QStringList>
+#include <QHash>
+#include <QUrl>
+
+#include "libCMS/engine.h"
+
+/**
+ * Renders the published pages, the posts listings, the author
+ * pages and the feed to files a web server can serve directly.
+ *
+ * Every update() compares the site with what was last written:
+ * pages are rendered again when their updated date changes, a
+ * listing when the posts it shows change or one of them was
+ * rendered again, and everything once the settings change.
+ * Updates are skipped when the engine's contentVersion() shows
+ * no post was committed since the last one, otherwise a single
+ * listing of the published posts and pages is read, away from
+ * the worker for async engines.
+ */
+class StaticExport : public QObject
+{
+    Q_OBJECT
+public:
+    StaticExport(Cutelyst::Application *app, CMS::Engine *engine, const QString &dir, const QUrl &baseUrl, QObject *parent = nullptr);
+
+    /**
+     * Writes what changed since the last update, requests
+     * go through the application one at a time so the event
+     * loop keeps serving others in between
+     */
+    void update();
+
+Q_SIGNALS:
+    /**
+     * Emitted when an update is done, \p ok is false
+     * if some file failed to render or write
+     */
+    void finished(bool ok);
+
+private:
+    void scan();
+    void plan(const QList<CMS::Page *> &published, bool full);
+    void renderNext();
+    void store(const QString &key, quint16 status, const QString &contentType, const QByteArray &body);
+    void remove(const QString &key);
+    void addListing(QHash<QString, QStringList> &listings, const QString &path, const QStringList &posts, int postsPerPage);
+    void enqueue(const QString &key);
+
+    Cutelyst::Application *m_app;
+    CMS::Engine *m_engine;
+    QString m_dir;
+    QUrl m_baseUrl;
+
+    // What each written file was made of, the dependency map
+    QHash<QString, QDateTime> m_pages;
+    QHash<QString, QStringList> m_listings;
+    QHash<QString, QString> m_files;
+    QDateTime m_settingsModified;
+    qint64 m_contentVersion = -1;
+
+    QStringList m_queue;
+    bool m_busy = false;
+    bool m_rescan = false;
+    bool m_ok = true;
+};
+
+/**
+ * Runs the application without a server for "cmlystd --export"
+ */
+class ExportEngine : public Cutelyst::Engine
+{
+    Q_OBJECT
+public:
+    explicit ExportEngine(Cutelyst::Application *app, const QVariantMap &opts = QVariantMap());
+
+    virtual int workerId() const override;
+
+    virtual bool init() override;
+};
+
+#endif // STATICEXPORT_H
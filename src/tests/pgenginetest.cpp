@@ -0,0 +1,252 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "libCMS/pgengine.h"
+#include "libCMS/page.h"
+
+#include <Cutelyst/ParamsMultiMap>
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QUuid>
+#include <QDir>
+
+using namespace CMS;
+
+class PgEngineTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void getPage();
+    void listings();
+    void counts();
+    void notify();
+
+private:
+    bool startServer();
+    QString tool(const QString &name) const;
+    Page *addPost(const QString &path, const QString &title, bool page, const QDateTime &publishedAt);
+
+    QTemporaryDir m_dir;
+    QString m_binDir;
+    QString m_connection;
+    PgEngine *m_engine = nullptr;
+    int m_authorId = 0;
+};
+
+QString PgEngineTest::tool(const QString &name) const
+{
+    if (!m_binDir.isEmpty()) {
+        return QDir(m_binDir).filePath(name);
+    }
+    return QStandardPaths::findExecutable(name);
+}
+
+bool PgEngineTest::startServer()
+{
+    // Debian keeps the server tools out of PATH
+    QProcess pgConfig;
+    pgConfig.start(QStringLiteral("pg_config"), { QStringLiteral("--bindir") });
+    if (pgConfig.waitForFinished() && pgConfig.exitCode() == 0) {
+        m_binDir = QString::fromLocal8Bit(pgConfig.readAllStandardOutput()).trimmed();
+        if (!QFile::exists(tool(QStringLiteral("initdb")))) {
+            m_binDir.clear();
+        }
+    }
+
+    const QString initdb = tool(QStringLiteral("initdb"));
+    const QString pgCtl = tool(QStringLiteral("pg_ctl"));
+    if (initdb.isEmpty() || pgCtl.isEmpty() || !m_dir.isValid()) {
+        return false;
+    }
+
+    const QString data = m_dir.filePath(QStringLiteral("data"));
+    // initdb refuses to run as root, the test is then skipped
+    if (QProcess::execute(initdb, {
+                          QStringLiteral("-D"), data,
+                          QStringLiteral("-U"), QStringLiteral("cmlyst"),
+                          QStringLiteral("-A"), QStringLiteral("trust")
+                          }) != 0) {
+        return false;
+    }
+
+    // Only a socket in the temporary dir, so it never clashes with a running server
+    const QString port = QString::number(20000 + (QCoreApplication::applicationPid() % 10000));
+    const QString options = QLatin1String("-k ") + m_dir.path() +
+            QLatin1String(" -c listen_addresses='' -p ") + port;
+    if (QProcess::execute(pgCtl, {
+                          QStringLiteral("-D"), data,
+                          QStringLiteral("-l"), m_dir.filePath(QStringLiteral("server.log")),
+                          QStringLiteral("-o"), options,
+                          QStringLiteral("-w"), QStringLiteral("start")
+                          }) != 0) {
+        return false;
+    }
+
+    m_connection = QLatin1String("postgresql:///postgres?host=") + m_dir.path() +
+            QLatin1String("&port=") + port + QLatin1String("&user=cmlyst");
+    return true;
+}
+
+void PgEngineTest::initTestCase()
+{
+    m_connection = qEnvironmentVariable("CMLYST_TEST_PG");
+    if (m_connection.isEmpty() && !startServer()) {
+        QSKIP("Set CMLYST_TEST_PG or install the PostgreSQL server tools to run this test");
+    }
+
+    m_engine = new PgEngine(this);
+    QVERIFY(m_engine->init({ { QStringLiteral("connection"), m_connection } }));
+
+    Cutelyst::ParamsMultiMap user;
+    user.insert(QStringLiteral("name"), QStringLiteral("Writer"));
+    user.insert(QStringLiteral("email"), QStringLiteral("writer@example.com"));
+    user.insert(QStringLiteral("password"), QStringLiteral("x"));
+    const QString slug = m_engine->addUser(nullptr, user, true);
+    QVERIFY(!slug.isEmpty());
+    m_authorId = m_engine->user(slug).value(QStringLiteral("id")).toInt();
+    QVERIFY(m_authorId > 0);
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QVERIFY(addPost(QStringLiteral("about"), QStringLiteral("About"), true, now));
+    QVERIFY(addPost(QStringLiteral("first"), QStringLiteral("First"), false, now.addSecs(-60)));
+    QVERIFY(addPost(QStringLiteral("second"), QStringLiteral("Second"), false, now));
+}
+
+void PgEngineTest::cleanupTestCase()
+{
+    delete m_engine;
+    m_engine = nullptr;
+
+    // Only set when startServer() ran
+    const QString pid = m_dir.filePath(QStringLiteral("data/postmaster.pid"));
+    if (QFile::exists(pid)) {
+        QProcess::execute(tool(QStringLiteral("pg_ctl")), {
+                              QStringLiteral("-D"), m_dir.filePath(QStringLiteral("data")),
+                              QStringLiteral("-m"), QStringLiteral("fast"),
+                              QStringLiteral("-w"), QStringLiteral("stop")
+                          });
+    }
+}
+
+Page *PgEngineTest::addPost(const QString &path, const QString &title, bool page, const QDateTime &publishedAt)
+{
+    // Paths are unique, a server given in CMLYST_TEST_PG may already have them
+    Page *existing = m_engine->getPage(path, this);
+    if (existing) {
+        return existing;
+    }
+
+    auto post = new Page(this);
+    post->setPath(path);
+    post->setTitle(title);
+    post->setUuid(QUuid::createUuid().toString().remove(QLatin1Char('{')).remove(QLatin1Char('}')));
+    post->setContent(QLatin1String("<p>") + title + QLatin1String("</p>"), true);
+    post->setAuthor({ { QStringLiteral("id"), QString::number(m_authorId) } });
+    post->setCreated(publishedAt);
+    post->setUpdated(publishedAt);
+    post->setPublishedAt(publishedAt);
+    post->setPage(page);
+    post->setPublished(true);
+    post->setAllowComments(false);
+    if (!m_engine->savePage(nullptr, post)) {
+        return nullptr;
+    }
+    return post;
+}
+
+void PgEngineTest::getPage()
+{
+    Page *page = m_engine->getPage(QStringLiteral("about"), this);
+    QVERIFY(page);
+    QCOMPARE(page->title(), QStringLiteral("About"));
+    QVERIFY(page->page());
+
+    QVERIFY(!m_engine->getPage(QStringLiteral("missing"), this));
+
+    bool called = false;
+    Page *async = nullptr;
+    m_engine->getPageAsync(QStringLiteral("first"), this, [&] (Page *result) {
+        called = true;
+        async = result;
+    });
+    // The callback only runs from the event loop
+    QVERIFY(!called);
+    QTRY_VERIFY(called);
+    QVERIFY(async);
+    QCOMPARE(async->title(), QStringLiteral("First"));
+}
+
+void PgEngineTest::listings()
+{
+    QList<Page *> posts = m_engine->listPostsPublished(this, 0, 100);
+    QVERIFY(posts.size() >= 2);
+    for (Page *post : posts) {
+        QVERIFY(!post->page());
+    }
+
+    const QList<Page *> authorPosts = m_engine->listAuthorPostsPublished(this, m_authorId, 0, 100);
+    QCOMPARE(authorPosts.size(), 2);
+    QCOMPARE(authorPosts.first()->path(), QStringLiteral("second"));
+
+    bool called = false;
+    QList<Page *> async;
+    m_engine->listPostsPublishedAsync(this, m_authorId, 0, 1, [&] (const QList<Page *> &result) {
+        called = true;
+        async = result;
+    });
+    QTRY_VERIFY(called);
+    QCOMPARE(async.size(), 1);
+    QCOMPARE(async.first()->path(), QStringLiteral("second"));
+}
+
+void PgEngineTest::counts()
+{
+    const int posts = m_engine->countPages(Engine::Posts | Engine::OnlyPublished, m_authorId);
+    QCOMPARE(posts, 2);
+    QVERIFY(m_engine->countPages(Engine::Pages | Engine::OnlyPublished, 0) >= 1);
+
+    int async = -1;
+    m_engine->countPagesAsync(Engine::Posts | Engine::OnlyPublished, m_authorId, this, [&] (int count) {
+        async = count;
+    });
+    QTRY_COMPARE(async, posts);
+}
+
+void PgEngineTest::notify()
+{
+    // Another node with its own cache of the settings
+    PgEngine other;
+    QVERIFY(other.init({ { QStringLiteral("connection"), m_connection } }));
+
+    const QString title = QLatin1String("Title ") + QUuid::createUuid().toString();
+    QVERIFY(m_engine->setSettingsValue(nullptr, QStringLiteral("title"), title));
+    QCOMPARE(m_engine->settingsValue(QStringLiteral("title")), title);
+
+    QTRY_COMPARE(other.settingsValue(QStringLiteral("title")), title);
+}
+
+QTEST_GUILESS_MAIN(PgEngineTest)
+
+#include "pgenginetest.moc"
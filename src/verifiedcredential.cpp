@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#include "verifiedcredential.h"
+
+#include <Cutelyst/Context>
+#include <Cutelyst/Plugins/Authentication/authenticationrealm.h>
+
+VerifiedCredential::VerifiedCredential(QObject *parent) : AuthenticationCredential(parent)
+{
+}
+
+AuthenticationUser VerifiedCredential::authenticate(Context *c, AuthenticationRealm *realm, const ParamsMultiMap &authinfo)
+{
+    const QString verified = c->stash(QStringLiteral("_cmlyst_verified_password")).toString();
+    if (verified.isEmpty()) {
+        return AuthenticationUser();
+    }
+
+    // The hash must still be the one that was verified
+    const AuthenticationUser user = realm->findUser(c, authinfo);
+    if (!user.isNull() && user.value(QStringLiteral("password")).toString() == verified) {
+        return user;
+    }
+    return AuthenticationUser();
+}
+
+void VerifiedCredential::setVerifiedHash(Context *c, const QString &hash)
+{
+    c->setStash(QStringLiteral("_cmlyst_verified_password"), hash);
+}
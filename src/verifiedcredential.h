@@ -0,0 +1,45 @@
+/***************************************************************************
+ *   Copyright (C) 2026 agent <agent@local>                                *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; see the file COPYING. If not, write to       *
+ *   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,  *
+ *   Boston, MA 02110-1301, USA.                                           *
+ ***************************************************************************/
+
+#ifndef VERIFIEDCREDENTIAL_H
+#define VERIFIEDCREDENTIAL_H
+
+#include <Cutelyst/Plugins/Authentication/authentication.h>
+
+using namespace Cutelyst;
+
+/**
+ * Accepts a user whose password hash was already
+ * checked by PasswordVerifier for this request
+ */
+class VerifiedCredential : public AuthenticationCredential
+{
+    Q_OBJECT
+public:
+    explicit VerifiedCredential(QObject *parent = nullptr);
+
+    AuthenticationUser authenticate(Context *c, AuthenticationRealm *realm, const ParamsMultiMap &authinfo) override;
+
+    /**
+     * Marks \p hash as verified for the current request
+     */
+    static void setVerifiedHash(Context *c, const QString &hash);
+};
+
+#endif // VERIFIEDCREDENTIAL_H